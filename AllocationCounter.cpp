@@ -0,0 +1,52 @@
+#include "AllocationCounter.h"
+
+#ifdef COUNT_ALLOCATIONS
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    thread_local uint64_t t_allocations = 0;
+}
+
+void * operator new(std::size_t size)
+{
+    t_allocations++;
+    if(void * p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void * p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void * p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+bool AllocationCounter::Enabled()
+{
+    return true;
+}
+
+uint64_t AllocationCounter::Count()
+{
+    return t_allocations;
+}
+
+#else
+
+bool AllocationCounter::Enabled()
+{
+    return false;
+}
+
+uint64_t AllocationCounter::Count()
+{
+    return 0;
+}
+
+#endif
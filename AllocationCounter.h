@@ -0,0 +1,30 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <cstdint>
+
+//! Heap allocations through operator new, counted per thread
+/*!
+    Counting replaces the global operator new and delete and is only
+    compiled in with COUNT_ALLOCATIONS defined (debug builds and the
+    benchmarks); otherwise Count() stays 0 and every check passes.
+*/
+namespace AllocationCounter
+{
+    bool     Enabled();
+    uint64_t Count();                   // allocations made by the calling thread so far
+}
+
+//! Allocations made by the calling thread since construction
+class AllocationScope
+{
+public:
+    AllocationScope() : _start(AllocationCounter::Count()) {}
+
+    uint64_t Allocations() const { return AllocationCounter::Count() - _start; }
+
+private:
+    uint64_t _start;
+};
+
+#endif // ALLOCATIONCOUNTER_H
@@ -0,0 +1,571 @@
+#include "AssetCache.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    // bump when the layout of a cached artifact changes, old entries then simply miss
+    const uint64_t CACHE_VERSION = 1;
+
+    #pragma pack(push, 1)
+    struct IMGCHEADER
+    {
+        char     magic[4];                  // "IMGC"
+        uint32_t version;
+        uint32_t width;
+        uint32_t height;
+        uint32_t type;                      // ImageData::PixelType
+        uint32_t reserved[3];
+    };                                      // followed by width * height pixels
+
+    struct TEXCHEADER
+    {
+        char     magic[4];                  // "TEXC"
+        uint32_t version;
+        uint32_t format;                    // TextureData::Format
+        uint32_t opaque;
+        uint32_t levels;
+        uint32_t generate_mips;             // levels past the stored ones left to the driver
+        uint32_t reserved[2];
+    };                                      // followed by the levels, each a TEXCLEVEL and its data
+
+    struct TEXCLEVEL
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t bytes;
+        uint32_t reserved;
+    };
+    #pragma pack(pop)
+
+    const char IMGC_MAGIC[4] = {'I', 'M', 'G', 'C'};
+    const char TEXC_MAGIC[4] = {'T', 'E', 'X', 'C'};
+
+    //==========================================================================
+    //         XXH64, hashes the mapped source at memory speed
+    //==========================================================================
+    const uint64_t PRIME64_1 = 11400714785074694791ULL;
+    const uint64_t PRIME64_2 = 14029467366897019727ULL;
+    const uint64_t PRIME64_3 = 1609587929392839161ULL;
+    const uint64_t PRIME64_4 = 9650029242287828579ULL;
+    const uint64_t PRIME64_5 = 2870177450012600261ULL;
+
+    inline uint64_t Rotl(uint64_t x, int r)
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    inline uint64_t Read64(const char * p)
+    {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline uint32_t Read32(const char * p)
+    {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline uint64_t Round(uint64_t acc, uint64_t input)
+    {
+        acc += input * PRIME64_2;
+        acc = Rotl(acc, 31);
+        return acc * PRIME64_1;
+    }
+
+    inline uint64_t MergeRound(uint64_t acc, uint64_t val)
+    {
+        acc ^= Round(0, val);
+        return acc * PRIME64_1 + PRIME64_4;
+    }
+
+    uint64_t HashBytes(const char * p, size_t len, uint64_t seed)
+    {
+        const char * end = p + len;
+        uint64_t h;
+
+        if(len >= 32)
+        {
+            const char * limit = end - 32;
+            uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+            uint64_t v2 = seed + PRIME64_2;
+            uint64_t v3 = seed;
+            uint64_t v4 = seed - PRIME64_1;
+
+            do
+            {
+                v1 = Round(v1, Read64(p));
+                v2 = Round(v2, Read64(p + 8));
+                v3 = Round(v3, Read64(p + 16));
+                v4 = Round(v4, Read64(p + 24));
+                p += 32;
+            } while(p <= limit);
+
+            h = Rotl(v1, 1) + Rotl(v2, 7) + Rotl(v3, 12) + Rotl(v4, 18);
+            h = MergeRound(h, v1);
+            h = MergeRound(h, v2);
+            h = MergeRound(h, v3);
+            h = MergeRound(h, v4);
+        }
+        else
+        {
+            h = seed + PRIME64_5;
+        }
+
+        h += len;
+        for(; p + 8 <= end; p += 8)
+        {
+            h ^= Round(0, Read64(p));
+            h = Rotl(h, 27) * PRIME64_1 + PRIME64_4;
+        }
+        if(p + 4 <= end)
+        {
+            h ^= Read32(p) * PRIME64_1;
+            h = Rotl(h, 23) * PRIME64_2 + PRIME64_3;
+            p += 4;
+        }
+        for(; p < end; p++)
+        {
+            h ^= static_cast<uint8_t>(*p) * PRIME64_5;
+            h = Rotl(h, 11) * PRIME64_1;
+        }
+
+        h ^= h >> 33;
+        h *= PRIME64_2;
+        h ^= h >> 29;
+        h *= PRIME64_3;
+        h ^= h >> 32;
+
+        return h;
+    }
+
+    // unique scratch name next to the entry, renamed over it once complete
+    std::string TempPath(const std::string & entry)
+    {
+        static std::atomic<uint64_t> counter(0);
+        return entry + "." + std::to_string(counter++) + ".tmp";
+    }
+
+    bool WriteCachedImage(const std::string & fname, const ImageData & id)
+    {
+        std::ofstream ofs(fname, std::ios::out | std::ios::binary);
+        if(!ofs.is_open())
+            return false;
+
+        IMGCHEADER header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, IMGC_MAGIC, sizeof(IMGC_MAGIC));
+        header.version = CACHE_VERSION;
+        header.width = id.width;
+        header.height = id.height;
+        header.type = static_cast<uint32_t>(id.type);
+        ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+        uint32_t bytes_per_pixel = (id.type == ImageData::PixelType::pt_rgb ? 3 : 4);
+        ofs.write(reinterpret_cast<const char *>(id.data.get()),
+                  static_cast<std::streamsize>(id.width) * id.height * bytes_per_pixel);
+
+        return static_cast<bool>(ofs);
+    }
+
+    bool ReadCachedImage(const std::string & fname, ImageData & id)
+    {
+        MappedFile file;
+        if(!file.Open(fname.c_str()) || file.Size() < sizeof(IMGCHEADER))
+            return false;
+
+        IMGCHEADER header;
+        std::memcpy(&header, file.Data(), sizeof(header));
+        if(std::memcmp(header.magic, IMGC_MAGIC, sizeof(IMGC_MAGIC)) != 0 || header.version != CACHE_VERSION
+           || header.type > static_cast<uint32_t>(ImageData::PixelType::pt_rgba))
+            return false;
+
+        id.type = static_cast<ImageData::PixelType>(header.type);
+        uint32_t bytes_per_pixel = (id.type == ImageData::PixelType::pt_rgb ? 3 : 4);
+        uint64_t image_size = static_cast<uint64_t>(header.width) * header.height * bytes_per_pixel;
+        if(image_size != file.Size() - sizeof(IMGCHEADER))
+            return false;
+
+        id.width = header.width;
+        id.height = header.height;
+        id.data = std::make_unique<uint8_t[]>(image_size);
+        std::memcpy(id.data.get(), file.Data() + sizeof(IMGCHEADER), image_size);
+
+        return true;
+    }
+
+    bool WriteCachedTexture(const std::string & fname, const TextureData & tex)
+    {
+        if(tex.image)
+            return false;
+
+        std::ofstream ofs(fname, std::ios::out | std::ios::binary);
+        if(!ofs.is_open())
+            return false;
+
+        TEXCHEADER header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, TEXC_MAGIC, sizeof(TEXC_MAGIC));
+        header.version = CACHE_VERSION;
+        header.format = static_cast<uint32_t>(tex.format);
+        header.opaque = tex.opaque ? 1 : 0;
+        header.levels = static_cast<uint32_t>(tex.levels.size());
+        header.generate_mips = tex.generateMips ? 1 : 0;
+        ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+        for(const TextureData::Level & level : tex.levels)
+        {
+            TEXCLEVEL lh = {level.width, level.height, static_cast<uint32_t>(level.data.size()), 0};
+            ofs.write(reinterpret_cast<const char *>(&lh), sizeof(lh));
+            ofs.write(reinterpret_cast<const char *>(level.data.data()),
+                      static_cast<std::streamsize>(level.data.size()));
+        }
+
+        return static_cast<bool>(ofs);
+    }
+
+    // size of a level of width x height, 0 when it does not fit the 32-bit size of the level header
+    uint64_t LevelBytes(TextureData::Format format, uint32_t width, uint32_t height)
+    {
+        uint64_t bytes = format == TextureData::Format::tf_rgba8
+                             ? uint64_t(width) * height * 4
+                             : uint64_t((width + 3) / 4) * ((height + 3) / 4)
+                               * (format == TextureData::Format::tf_bc1 ? 8 : 16);
+        return bytes <= UINT32_MAX ? bytes : 0;
+    }
+
+    bool ReadCachedTexture(const std::string & fname, TextureData & tex)
+    {
+        MappedFile file;
+        if(!file.Open(fname.c_str()) || file.Size() < sizeof(TEXCHEADER))
+            return false;
+
+        TEXCHEADER header;
+        std::memcpy(&header, file.Data(), sizeof(header));
+        if(std::memcmp(header.magic, TEXC_MAGIC, sizeof(TEXC_MAGIC)) != 0 || header.version != CACHE_VERSION
+           || header.format >= static_cast<uint32_t>(TextureData::Format::tf_none)
+           || header.levels == 0 || header.levels > 32)
+            return false;
+
+        tex.format = static_cast<TextureData::Format>(header.format);
+        tex.opaque = header.opaque != 0;
+        tex.generateMips = header.generate_mips != 0;
+        tex.image.reset();
+        tex.levels.resize(header.levels);
+
+        uint64_t offset = sizeof(TEXCHEADER);
+        for(size_t i = 0; i < tex.levels.size(); i++)
+        {
+            TEXCLEVEL lh;
+            if(offset + sizeof(lh) > file.Size())
+                return false;
+            std::memcpy(&lh, file.Data() + offset, sizeof(lh));
+            offset += sizeof(lh);
+            if(offset + lh.bytes > file.Size())
+                return false;
+
+            // the levels go to the driver with these sizes, they have to hold every pixel of them
+            bool sized = i == 0 ? lh.width > 0 && lh.height > 0
+                                : lh.width == std::max(1u, tex.levels[i - 1].width / 2)
+                                  && lh.height == std::max(1u, tex.levels[i - 1].height / 2);
+            if(!sized || lh.bytes != LevelBytes(tex.format, lh.width, lh.height))
+                return false;
+
+            TextureData::Level & level = tex.levels[i];
+            level.width = lh.width;
+            level.height = lh.height;
+            level.data.assign(file.Data() + offset, file.Data() + offset + lh.bytes);
+            offset += lh.bytes;
+        }
+
+        return offset == file.Size();
+    }
+}
+
+AssetCache::AssetCache() : _maxBytes(0),
+                           _hits(0),
+                           _misses(0),
+                           _stores(0),
+                           _evictions(0)
+{
+}
+
+bool AssetCache::Open(const std::string & dir, uint64_t max_bytes)
+{
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    if(!fs::is_directory(dir, ec))
+    {
+        std::cerr << "Cannot open cache directory: " << dir << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _dir = dir;
+    _maxBytes = max_bytes;
+    Evict();
+
+    return true;
+}
+
+bool AssetCache::LoadMesh(const std::string & fname, Mesh & msh, Mesh::MshReader reader,
+                          LoadMonitor * monitor)
+{
+    if(!IsOpen() || reader == Mesh::MshReader::mr_binary)
+        return msh.LoadFromMsh(fname.c_str(), reader, monitor);
+
+    std::string entry = EntryPath(fname, "mshb");
+    if(!entry.empty() && Hit(entry))
+    {
+        Mesh cached;
+        if(cached.LoadFromMsh(entry.c_str(), Mesh::MshReader::mr_binary, monitor))
+        {
+            msh._meshes = std::move(cached._meshes);
+            msh._base_bbox = cached._base_bbox;
+            return true;
+        }
+        if(monitor && monitor->IsCancelled())
+            return false;
+        Reject(entry);
+    }
+
+    if(!msh.LoadFromMsh(fname.c_str(), reader, monitor))
+        return false;
+
+    // stored grouped by influence count, so sorting a mesh loaded from the entry
+    // finds nothing to do and leaves its arrays views of the mapped file
+    msh.SortVerticesByInfluence();
+
+    if(!entry.empty())
+    {
+        std::string tmp = TempPath(entry);
+        if(msh.SaveToMshb(tmp.c_str()))
+            Commit(tmp, entry);
+    }
+
+    return true;
+}
+
+bool AssetCache::LoadAnimation(const std::string & fname, Mesh & msh, LoadMonitor * monitor)
+{
+    std::string ext = fname.substr(fname.find_last_of(".") + 1);
+    bool binary = (ext == "anmb" || ext == "ANMB");
+    if(!IsOpen() || binary)
+        return binary ? msh.LoadFromAnmb(fname.c_str(), monitor)
+                      : msh.LoadFromAnm(fname.c_str(), monitor);
+
+    // go through a scratch mesh, SaveToAnmb writes its only animation
+    Mesh loaded;
+    std::string entry = EntryPath(fname, "anmb");
+    bool res = false;
+    if(!entry.empty() && Hit(entry))
+    {
+        res = loaded.LoadFromAnmb(entry.c_str(), monitor);
+        if(!res)
+            Reject(entry);
+    }
+
+    if(!res)
+    {
+        if(!loaded.LoadFromAnm(fname.c_str(), monitor))
+            return false;
+
+        std::string tmp = TempPath(entry);
+        if(!entry.empty() && loaded.SaveToAnmb(tmp.c_str(), false))
+            Commit(tmp, entry);
+    }
+
+    msh._anims.push_back(std::move(loaded._anims[0]));
+    msh._controller = loaded._controller;
+    return true;
+}
+
+bool AssetCache::LoadImage(const std::string & fname, ImageData & id)
+{
+    if(!IsOpen())
+        return ReadImage(fname, id);
+
+    std::string entry = EntryPath(fname, "img");
+    if(!entry.empty() && Hit(entry))
+    {
+        if(ReadCachedImage(entry, id))
+            return true;
+        Reject(entry);
+    }
+
+    if(!ReadImage(fname, id))
+        return false;
+
+    if(!entry.empty())
+    {
+        std::string tmp = TempPath(entry);
+        if(WriteCachedImage(tmp, id))
+            Commit(tmp, entry);
+    }
+
+    return true;
+}
+
+bool AssetCache::LoadTexture(const std::string & fname, const TextureOptions & opt, TextureData & tex)
+{
+    // a file usable in place is its own cache entry
+    ImageData id;
+    if(opt.ZeroCopy() && MapImage(fname, id))
+        return BuildTexture(id, opt, tex);
+
+    // the options are part of the entry name, each combination is cached on its own
+    char kind[8];
+    std::snprintf(kind, sizeof(kind), "tex%x", (opt.mipmaps ? 1 : 0) | (opt.compress ? 2 : 0)
+                                               | (static_cast<int>(opt.filter) << 2));
+
+    std::string entry = IsOpen() ? EntryPath(fname, kind) : std::string();
+    if(!entry.empty() && Hit(entry))
+    {
+        if(ReadCachedTexture(entry, tex))
+            return true;
+        Reject(entry);
+    }
+
+    if(!LoadImage(fname, id) || !BuildTexture(id, opt, tex))
+        return false;
+
+    if(!entry.empty())
+    {
+        std::string tmp = TempPath(entry);
+        if(WriteCachedTexture(tmp, tex))
+            Commit(tmp, entry);
+    }
+
+    return true;
+}
+
+AssetCache::Stats AssetCache::GetStats() const
+{
+    Stats st;
+    st.hits = _hits.load();
+    st.misses = _misses.load();
+    st.stores = _stores.load();
+    st.evictions = _evictions.load();
+    return st;
+}
+
+bool AssetCache::HashFile(const std::string & fname, uint64_t & hash)
+{
+    MappedFile file;
+    if(!file.Open(fname.c_str()))
+        return false;
+
+    hash = HashBytes(file.Data(), file.Size(), CACHE_VERSION);
+    return true;
+}
+
+std::string AssetCache::EntryPath(const std::string & source, const char * kind)
+{
+    uint64_t hash = 0;
+    if(!HashFile(source, hash))
+        return std::string();
+
+    hash = HashBytes(kind, std::strlen(kind), hash);
+
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+    return (fs::path(_dir) / (std::string(name) + "." + kind)).string();
+}
+
+bool AssetCache::Hit(const std::string & entry)
+{
+    std::error_code ec;
+    if(!fs::is_regular_file(entry, ec))
+    {
+        _misses++;
+        return false;
+    }
+
+    // the modification time doubles as the last use for eviction
+    fs::last_write_time(entry, fs::file_time_type::clock::now(), ec);
+    _hits++;
+    return true;
+}
+
+void AssetCache::Reject(const std::string & entry)
+{
+    // counted as a miss, the caller rebuilds the entry from its source
+    _hits--;
+    _misses++;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::error_code ec;
+    fs::remove(entry, ec);
+}
+
+void AssetCache::Commit(const std::string & tmp, const std::string & entry)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    std::error_code ec;
+    fs::rename(tmp, entry, ec);
+    if(ec)
+    {
+        fs::remove(tmp, ec);
+        return;
+    }
+
+    _stores++;
+    Evict();
+}
+
+void AssetCache::Evict()
+{
+    struct Entry
+    {
+        fs::path           path;
+        uint64_t           size;
+        fs::file_time_type used;
+    };
+
+    std::error_code ec;
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    for(fs::directory_iterator it(_dir, ec), end; !ec && it != end; it.increment(ec))
+    {
+        if(!it->is_regular_file(ec) || it->path().extension() == ".tmp")
+            continue;
+
+        Entry e{it->path(), it->file_size(ec), it->last_write_time(ec)};
+        total += e.size;
+        entries.push_back(std::move(e));
+    }
+
+    if(total <= _maxBytes)
+        return;
+
+    std::sort(entries.begin(), entries.end(), [](const Entry & a, const Entry & b)
+    {
+        return a.used < b.used;
+    });
+
+    // entries still mapped by a loaded mesh stay valid on POSIX, removal just fails on Windows
+    for(auto & e : entries)
+    {
+        if(total <= _maxBytes)
+            break;
+
+        if(fs::remove(e.path, ec))
+        {
+            total -= e.size;
+            _evictions++;
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef ASSETCACHE_H
+#define ASSETCACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include "Mesh.h"
+#include "ImageData.h"
+#include "TextureData.h"
+
+//! On-disk cache of parsed assets
+/*!
+    Parsed meshes, animations, decoded images and processed textures are
+    stored in binary form (.mshb, full precision .anmb, raw pixels, mip
+    chains and BC blocks) in a directory, under a name derived from a
+    hash of the source file contents, so an edited source misses
+    automatically and identical files share one entry.
+    Hits refresh the entry's modification time, which drives least
+    recently used eviction once the directory grows past its size limit.
+    All methods may be called from several threads.
+*/
+class AssetCache
+{
+public:
+    struct Stats
+    {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t stores;
+        uint64_t evictions;
+    };
+
+    AssetCache();
+
+    //! Use dir (created when missing) and keep it under max_bytes
+    bool Open(const std::string & dir, uint64_t max_bytes);
+    bool IsOpen() const { return !_dir.empty(); }
+
+    // Load through the cache; sources that already are binary bypass it.
+    // Meshes come out of a text source or the cache with their vertices
+    // grouped by Mesh::SortVerticesByInfluence()
+    bool LoadMesh(const std::string & fname, Mesh & msh, Mesh::MshReader reader,
+                  LoadMonitor * monitor = nullptr);
+    bool LoadAnimation(const std::string & fname, Mesh & msh, LoadMonitor * monitor = nullptr);
+    bool LoadImage(const std::string & fname, ImageData & id);
+    //! Image processed into a texture by the options, mip chain and compression included
+    /*! With opt.ZeroCopy() a file MapImage() takes as it is stays out of the cache, the texture maps it */
+    bool LoadTexture(const std::string & fname, const TextureOptions & opt, TextureData & tex);
+
+    Stats GetStats() const;
+
+    //! Hash of the file contents, the identity the cache entries are derived from
+    static bool HashFile(const std::string & fname, uint64_t & hash);
+
+private:
+    std::string EntryPath(const std::string & source, const char * kind);
+    bool        Hit(const std::string & entry);
+    // an entry Hit() found but could not read, stale or corrupt
+    void        Reject(const std::string & entry);
+    void        Commit(const std::string & tmp, const std::string & entry);
+    void        Evict();
+
+    std::string           _dir;
+    uint64_t              _maxBytes;
+    std::mutex            _mutex;             // guards directory scans and renames
+
+    std::atomic<uint64_t> _hits;
+    std::atomic<uint64_t> _misses;
+    std::atomic<uint64_t> _stores;
+    std::atomic<uint64_t> _evictions;
+};
+
+#endif // ASSETCACHE_H
@@ -0,0 +1,63 @@
+#include "CpuFeatures.h"
+
+#if defined(CPU_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+    struct Features
+    {
+        bool ssse3;
+        bool sse41;
+        bool avx2;
+
+        Features() : ssse3(false), sse41(false), avx2(false)
+        {
+#if defined(CPU_X86) && defined(_MSC_VER)
+            int regs[4];
+            __cpuid(regs, 0);
+            int max_leaf = regs[0];
+
+            __cpuid(regs, 1);
+            ssse3 = (regs[2] & (1 << 9)) != 0;
+            sse41 = (regs[2] & (1 << 19)) != 0;
+            bool fma = (regs[2] & (1 << 12)) != 0;
+            bool osxsave = (regs[2] & (1 << 27)) != 0;
+            bool ymm = osxsave && (_xgetbv(0) & 6) == 6;
+
+            if(max_leaf >= 7)
+            {
+                __cpuidex(regs, 7, 0);
+                avx2 = fma && ymm && (regs[1] & (1 << 5)) != 0;
+            }
+#elif defined(CPU_X86) && (defined(__GNUC__) || defined(__clang__))
+            __builtin_cpu_init();
+            ssse3 = __builtin_cpu_supports("ssse3");
+            sse41 = __builtin_cpu_supports("sse4.1");
+            avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+        }
+    };
+
+    const Features & Detected()
+    {
+        static const Features features;
+        return features;
+    }
+}
+
+bool CpuFeatures::HasSSSE3()
+{
+    return Detected().ssse3;
+}
+
+bool CpuFeatures::HasSSE41()
+{
+    return Detected().sse41;
+}
+
+bool CpuFeatures::HasAVX2()
+{
+    return Detected().avx2;
+}
@@ -0,0 +1,28 @@
+#ifndef CPUFEATURES_H
+#define CPUFEATURES_H
+
+// Kernels for optional x86 extensions are compiled per function with
+// CPU_TARGET and may only be called after the matching check below.
+// Helpers several kernels call are CPU_INLINE, so each kernel gets a
+// copy built for its extension rather than a call into SSE code
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define CPU_X86 1
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+    #define CPU_TARGET(isa) __attribute__((target(isa)))
+    #define CPU_INLINE      inline __attribute__((always_inline))
+#else
+    #define CPU_TARGET(isa)
+    #define CPU_INLINE      inline
+#endif
+
+//! Instruction set extensions of the running CPU, detected once
+namespace CpuFeatures
+{
+    bool HasSSSE3();
+    bool HasSSE41();
+    bool HasAVX2();                 // together with FMA and OS support for YMM state
+}
+
+#endif // CPUFEATURES_H
@@ -0,0 +1,137 @@
+#ifndef DATAARRAY_H
+#define DATAARRAY_H
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+//! Contiguous array that either owns its elements or views external memory
+/*!
+    Owning arrays behave like a std::vector. A view points into memory
+    kept alive by a shared backing store (e.g. a mapped binary mesh file),
+    so loaders can expose file contents without copying them. Reading
+    never copies; any mutation of a view first detaches it into an owned
+    copy, so mutable access is spelled out with MutableData().
+*/
+template<typename T>
+class DataArray
+{
+    std::vector<T>              _own;
+    const T *                   _ptr;
+    size_t                      _size;
+    std::shared_ptr<const void> _backing;       // empty for owning arrays
+
+    void Sync()
+    {
+        _ptr = _own.data();
+        _size = _own.size();
+    }
+
+    void Detach()
+    {
+        if(_backing)
+        {
+            _own.assign(_ptr, _ptr + _size);
+            _backing.reset();
+            Sync();
+        }
+    }
+
+public:
+    typedef T               value_type;
+    typedef const T *       const_iterator;
+
+    DataArray() : _ptr(nullptr), _size(0) {}
+
+    DataArray(std::vector<T> && v) : _own(std::move(v)) { Sync(); }
+
+    //! Construct a view of count elements at ptr, kept valid by backing
+    DataArray(const T * ptr, size_t count, std::shared_ptr<const void> backing)
+        : _ptr(ptr), _size(count), _backing(std::move(backing)) {}
+
+    DataArray(const DataArray& a) : _own(a._own), _backing(a._backing)
+    {
+        if(_backing)
+        {
+            _ptr = a._ptr;
+            _size = a._size;
+        }
+        else
+            Sync();
+    }
+
+    DataArray(DataArray&& a) : _own(std::move(a._own)),
+                               _ptr(a._ptr),
+                               _size(a._size),
+                               _backing(std::move(a._backing))
+    {
+        a._own.clear();
+        a.Sync();
+    }
+
+    DataArray& operator=(DataArray a)
+    {
+        std::swap(_own, a._own);
+        std::swap(_ptr, a._ptr);
+        std::swap(_size, a._size);
+        std::swap(_backing, a._backing);
+        return *this;
+    }
+
+    DataArray& operator=(std::vector<T> && v)
+    {
+        _backing.reset();
+        _own = std::move(v);
+        Sync();
+        return *this;
+    }
+
+    bool isView() const { return static_cast<bool>(_backing); }
+
+    size_t size() const { return _size; }
+    bool   empty() const { return _size == 0; }
+
+    const T * data() const { return _ptr; }
+    const T & operator[](size_t i) const { return _ptr[i]; }
+    const T & back() const { return _ptr[_size - 1]; }
+
+    const_iterator begin() const { return _ptr; }
+    const_iterator end() const { return _ptr + _size; }
+
+    T * MutableData()
+    {
+        Detach();
+        return _own.data();
+    }
+
+    void push_back(const T & v)
+    {
+        Detach();
+        _own.push_back(v);
+        Sync();
+    }
+
+    void resize(size_t count)
+    {
+        Detach();
+        _own.resize(count);
+        Sync();
+    }
+
+    void reserve(size_t count)
+    {
+        Detach();
+        _own.reserve(count);
+        Sync();
+    }
+
+    void clear()
+    {
+        _backing.reset();
+        _own.clear();
+        Sync();
+    }
+};
+
+#endif // DATAARRAY_H
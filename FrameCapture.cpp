@@ -0,0 +1,347 @@
+#include "FrameCapture.h"
+#include <QOpenGLContext>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+#ifndef GL_BGRA
+#define GL_BGRA 0x80E1
+#endif
+
+namespace
+{
+    const GLuint64 FENCE_TIMEOUT_NS = 100000000;         // per glClientWaitSync call, retried until signaled
+}
+
+FrameCapture::FrameCapture() : _gl(nullptr),
+                               _mode(Mode::cm_direct),
+                               _active(false),
+                               _sync(false),
+                               _rle(false),
+                               _width(0),
+                               _height(0),
+                               _frameBytes(0),
+                               _format(GL_BGRA),
+                               _nextIndex(0),
+                               _buffer(0),
+                               _buffers{},
+                               _fences{},
+                               _indices{},
+                               _pending{},
+                               _poolBytes(0),
+                               _allocated(0),
+                               _quit(false)
+{
+}
+
+FrameCapture::~FrameCapture()
+{
+    // GL objects go with the context, Stop() is for releasing them earlier
+    StopEncoders();
+}
+
+bool FrameCapture::Start(const std::string & dir, bool rle)
+{
+    Stop();
+
+    QOpenGLContext * ctx = QOpenGLContext::currentContext();
+    if(!ctx)
+        return false;
+
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if(ec)
+    {
+        qDebug() << "Fail to create capture directory" << dir.c_str() << ec.message().c_str();
+        return false;
+    }
+
+    _gl = ctx->extraFunctions();
+    _stats = Stats();
+    _dir = dir;
+    _rle = rle;
+
+    QPair<int, int> version = ctx->format().version();
+    bool desktop = !ctx->isOpenGLES();
+    bool map_range = version >= qMakePair(3, 0) || (desktop && ctx->hasExtension("GL_ARB_map_buffer_range"));
+    bool pbo = version >= qMakePair(3, 0) || (desktop && version >= qMakePair(2, 1))
+               || ctx->hasExtension("GL_ARB_pixel_buffer_object");
+    _sync = version >= qMakePair(3, 2) || (!desktop && version >= qMakePair(3, 0))
+            || ctx->hasExtension("GL_ARB_sync");
+    _mode = pbo && map_range ? Mode::cm_pbo : Mode::cm_direct;
+
+    // BGRA is how desktop drivers keep the framebuffer, ES only promises RGBA
+    _format = desktop ? GL_BGRA : GL_RGBA;
+
+    _width = 0;
+    _height = 0;
+    _nextIndex = 0;
+    _buffer = 0;
+    _quit = false;
+    for(uint32_t i = 0; i < NUM_ENCODERS; i++)
+        _encoders.emplace_back(&FrameCapture::EncoderLoop, this);
+
+    _active = true;
+    return true;
+}
+
+void FrameCapture::Stop()
+{
+    if(!_active)
+        return;
+
+    // frames still in the pixel buffers, oldest first
+    for(uint32_t i = 0; i < NUM_BUFFERS; i++)
+    {
+        uint32_t buffer = (_buffer + i) % NUM_BUFFERS;
+        if(_pending[buffer])
+            Collect(buffer);
+    }
+    ReleaseBuffers();
+    StopEncoders();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _pool.clear();
+    _allocated = 0;
+    _active = false;
+}
+
+void FrameCapture::Capture(int width, int height)
+{
+    if(!_active || width <= 0 || height <= 0)
+        return;
+
+    if(width != _width || height != _height)
+        Resize(width, height);
+
+    _stats.frames++;
+    if(_mode == Mode::cm_direct)
+    {
+        std::unique_ptr<uint8_t[]> pixels = AcquireFrame();
+        _gl->glReadPixels(0, 0, _width, _height, _format, GL_UNSIGNED_BYTE, pixels.get());
+        Queue(_nextIndex++, std::move(pixels));
+        return;
+    }
+
+    // queued behind this frame's draw calls, the buffer is filled when the GPU gets there
+    uint32_t buffer = _buffer;
+    if(_pending[buffer])
+        Collect(buffer);
+    _gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, _buffers[buffer]);
+    _gl->glReadPixels(0, 0, _width, _height, _format, GL_UNSIGNED_BYTE, nullptr);
+    _gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if(_sync)
+        _fences[buffer] = _gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    _indices[buffer] = _nextIndex++;
+    _pending[buffer] = true;
+
+    // the next buffer in the ring was read two frames ago
+    _buffer = (buffer + 1) % NUM_BUFFERS;
+    if(_pending[_buffer])
+        Collect(_buffer);
+}
+
+FrameCapture::Stats FrameCapture::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats;
+}
+
+void FrameCapture::Resize(int width, int height)
+{
+    for(uint32_t i = 0; i < NUM_BUFFERS; i++)
+    {
+        uint32_t buffer = (_buffer + i) % NUM_BUFFERS;
+        if(_pending[buffer])
+            Collect(buffer);
+    }
+    ReleaseBuffers();
+
+    _width = width;
+    _height = height;
+    _frameBytes = size_t(width) * height * 4;
+    _buffer = 0;
+
+    if(_mode == Mode::cm_pbo)
+    {
+        _gl->glGenBuffers(NUM_BUFFERS, _buffers);
+        for(unsigned int buffer : _buffers)
+        {
+            _gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+            _gl->glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(_frameBytes), nullptr, GL_STREAM_READ);
+        }
+        _gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    // frames of the old size still queued are freed rather than pooled once written
+    std::lock_guard<std::mutex> lock(_mutex);
+    _allocated -= static_cast<uint32_t>(_pool.size());
+    _pool.clear();
+    _poolBytes = _frameBytes;
+}
+
+void FrameCapture::Collect(uint32_t buffer)
+{
+    std::unique_ptr<uint8_t[]> pixels = AcquireFrame();
+
+    GLsync fence = _fences[buffer];
+    _fences[buffer] = nullptr;
+    if(fence)
+    {
+        // poll first so frames that do not wait are not counted
+        GLenum res = _gl->glClientWaitSync(fence, 0, 0);
+        if(res == GL_TIMEOUT_EXPIRED)
+        {
+            QElapsedTimer timer;
+            timer.start();
+            do
+            {
+                res = _gl->glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+            } while(res == GL_TIMEOUT_EXPIRED);
+
+            _stats.waits++;
+            _stats.waitMs += timer.nsecsElapsed() / 1e6;
+        }
+        _gl->glDeleteSync(fence);
+    }
+
+    _gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, _buffers[buffer]);
+    const void * mapped = _gl->glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(_frameBytes),
+                                                GL_MAP_READ_BIT);
+    bool copied = mapped != nullptr;
+    if(mapped)
+    {
+        std::memcpy(pixels.get(), mapped, _frameBytes);
+        copied = _gl->glUnmapBuffer(GL_PIXEL_PACK_BUFFER) == GL_TRUE;
+    }
+    _gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    _pending[buffer] = false;
+
+    if(copied)
+    {
+        Queue(_indices[buffer], std::move(pixels));
+        return;
+    }
+
+    // the number stays unused, the files around it show the frame is missing
+    qDebug() << "Fail to map capture buffer, frame" << _indices[buffer] << "lost";
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stats.failed++;
+    _pool.push_back(std::move(pixels));
+}
+
+void FrameCapture::ReleaseBuffers()
+{
+    for(uint32_t i = 0; i < NUM_BUFFERS; i++)
+    {
+        if(_fences[i])
+            _gl->glDeleteSync(_fences[i]);
+        _fences[i] = nullptr;
+        _pending[i] = false;
+    }
+
+    if(_buffers[0])
+        _gl->glDeleteBuffers(NUM_BUFFERS, _buffers);
+    std::fill(std::begin(_buffers), std::end(_buffers), 0u);
+}
+
+std::unique_ptr<uint8_t[]> FrameCapture::AcquireFrame()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    if(_pool.empty() && _allocated == MAX_QUEUED)
+    {
+        // the encoders fell behind, hold the frame loop rather than drop a frame
+        QElapsedTimer timer;
+        timer.start();
+        _freed.wait(lock, [this]() { return !_pool.empty() || _allocated < MAX_QUEUED; });
+        _stats.stalls++;
+        _stats.stallMs += timer.nsecsElapsed() / 1e6;
+    }
+
+    if(!_pool.empty())
+    {
+        std::unique_ptr<uint8_t[]> pixels = std::move(_pool.back());
+        _pool.pop_back();
+        return pixels;
+    }
+
+    _allocated++;
+    lock.unlock();
+    return std::unique_ptr<uint8_t[]>(new uint8_t[_frameBytes]);
+}
+
+void FrameCapture::Queue(uint64_t index, std::unique_ptr<uint8_t[]> pixels)
+{
+    Frame frame;
+    frame.index = index;
+    frame.image.width = static_cast<uint32_t>(_width);
+    frame.image.height = static_cast<uint32_t>(_height);
+    frame.image.type = ImageData::PixelType::pt_rgba;
+    frame.image.order = _format == GL_BGRA ? ImageData::ChannelOrder::co_bgr : ImageData::ChannelOrder::co_rgb;
+    frame.image.data = std::move(pixels);
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queue.push_back(std::move(frame));
+    }
+    _queued.notify_one();
+}
+
+void FrameCapture::EncoderLoop()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    for(;;)
+    {
+        _queued.wait(lock, [this]() { return _quit || !_queue.empty(); });
+        if(_queue.empty())
+            return;
+
+        Frame frame = std::move(_queue.front());
+        _queue.pop_front();
+        lock.unlock();
+
+        // the framebuffer alpha is whatever blending left, the background cleared to 0
+        uint8_t * pixels = frame.image.data.get();
+        size_t    count = size_t(frame.image.width) * frame.image.height;
+        for(size_t i = 0; i < count; i++)
+            pixels[i * 4 + 3] = 255;
+
+        char name[32];
+        std::snprintf(name, sizeof(name), "frame_%05llu.tga", static_cast<unsigned long long>(frame.index));
+        bool written = WriteTGA(_dir + "/" + name, frame.image, _rle);
+
+        lock.lock();
+        if(written)
+            _stats.written++;
+        else
+            _stats.failed++;
+
+        if(count * 4 == _poolBytes)
+            _pool.push_back(std::move(frame.image.data));
+        else
+            _allocated--;
+        _freed.notify_one();
+    }
+}
+
+void FrameCapture::StopEncoders()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _quit = true;
+    }
+    _queued.notify_all();
+
+    // the queue is drained before the encoders quit
+    for(std::thread & encoder : _encoders)
+        encoder.join();
+    _encoders.clear();
+}
+
+const char * FrameCapture::ModeName(Mode mode)
+{
+    return mode == Mode::cm_pbo ? "pixel buffer" : "direct";
+}
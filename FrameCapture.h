@@ -0,0 +1,129 @@
+#ifndef FRAMECAPTURE_H
+#define FRAMECAPTURE_H
+
+#include <QOpenGLExtraFunctions>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ImageData.h"
+
+//! Rendered frames written to numbered TGA files without stalling the frame loop
+/*!
+    Capture() starts an asynchronous glReadPixels of the frame into one of
+    three pixel pack buffers used in turn, and maps the buffer read two
+    frames earlier, by then normally done, so the GPU never waits for the
+    CPU nor the CPU for the GPU. The pixels are copied into a system
+    memory frame handed to encoder threads, which write it with WriteTGA()
+    as frame_00000.tga, frame_00001.tga, ... in the capture directory.
+
+    No frame is dropped: when every frame buffer is queued for the
+    encoders, Capture() waits for one to be written, and the time spent
+    waiting shows in the stats. Frames come out BGRA, the order both the
+    framebuffer and TGA files use, and are written opaque.
+
+    Without GL 3.0 / ES 3.0 pixel buffers are not mapped; every frame is
+    then read back synchronously.
+*/
+class FrameCapture
+{
+public:
+    enum class Mode
+    {
+        cm_pbo,
+        cm_direct
+    };
+
+    struct Stats
+    {
+        uint64_t frames;                 // read back
+        uint64_t written;
+        uint64_t failed;                 // WriteTGA() errors, the file is missing or truncated
+        uint64_t waits;                  // frames mapped before their read back finished
+        double   waitMs;
+        uint64_t stalls;                 // frames that waited for the encoders to free a buffer
+        double   stallMs;
+
+        Stats() : frames(0), written(0), failed(0), waits(0), waitMs(0.0), stalls(0), stallMs(0.0) {}
+    };
+
+    static constexpr uint32_t NUM_BUFFERS = 3;
+    static constexpr uint32_t MAX_QUEUED = 8;       // frames in system memory waiting for the encoders
+    static constexpr uint32_t NUM_ENCODERS = 2;
+
+    FrameCapture();
+    ~FrameCapture();                                 // finishes the queued frames
+
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    //! Capture into dir, created if missing; the context must be current
+    bool Start(const std::string & dir, bool rle = false);
+    //! Write the frames still in flight and release the buffers, the context must be current
+    void Stop();
+    bool IsActive() const { return _active; }
+
+    //! Read back the framebuffer bound for reading, width x height device pixels; call after the frame is drawn
+    void Capture(int width, int height);
+
+    Mode                GetMode() const { return _mode; }
+    Stats               GetStats() const;
+    const std::string & Directory() const { return _dir; }
+
+    static const char * ModeName(Mode mode);
+
+private:
+    struct Frame
+    {
+        uint64_t  index;
+        ImageData image;
+    };
+
+    // resize the pixel buffers for frames of another size, the pending ones are written first
+    void Resize(int width, int height);
+    // map a pixel buffer whose read back was issued and queue its pixels
+    void Collect(uint32_t buffer);
+    void ReleaseBuffers();
+
+    // frame memory from the pool, waits while every buffer is queued
+    std::unique_ptr<uint8_t[]> AcquireFrame();
+    void                       Queue(uint64_t index, std::unique_ptr<uint8_t[]> pixels);
+    void                       EncoderLoop();
+    void                       StopEncoders();
+
+    QOpenGLExtraFunctions * _gl;
+    Mode                    _mode;
+    bool                    _active;
+    bool                    _sync;                      // fences available
+    bool                    _rle;
+    std::string             _dir;
+    int                     _width;
+    int                     _height;
+    size_t                  _frameBytes;
+    GLenum                  _format;                    // GL_BGRA, GL_RGBA on ES
+    uint64_t                _nextIndex;                 // number of the next frame read back
+    uint32_t                _buffer;                    // pixel buffer of the next read back
+    unsigned int            _buffers[NUM_BUFFERS];
+    GLsync                  _fences[NUM_BUFFERS];
+    uint64_t                _indices[NUM_BUFFERS];      // frame read into each buffer
+    bool                    _pending[NUM_BUFFERS];      // read back issued, not collected yet
+
+    // shared with the encoders
+    mutable std::mutex                      _mutex;
+    std::condition_variable                 _queued;    // a frame to write, or quitting
+    std::condition_variable                 _freed;     // a frame buffer back in the pool
+    std::deque<Frame>                       _queue;
+    std::vector<std::unique_ptr<uint8_t[]>> _pool;
+    size_t                                  _poolBytes; // size of every buffer in the pool
+    uint32_t                                _allocated; // frame buffers alive, pooled or queued
+    bool                                    _quit;
+    std::vector<std::thread>                _encoders;
+    Stats                                   _stats;
+};
+
+#endif // FRAMECAPTURE_H
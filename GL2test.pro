@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui
+QT       += core gui concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -22,7 +22,10 @@ DEFINES += QT_DEPRECATED_WARNINGS
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
-CONFIG += c++14
+CONFIG += c++17
+
+# count heap allocations to check that the animation frame loop makes none
+CONFIG(debug, debug|release): DEFINES += COUNT_ALLOCATIONS
 
 SOURCES += \
         main.cpp \
@@ -31,6 +34,17 @@ SOURCES += \
     ImageData.cpp \
     Controller.cpp \
     Mesh.cpp \
+    MappedFile.cpp \
+    ThreadPool.cpp \
+    LoadMonitor.cpp \
+    AssetCache.cpp \
+    SkinningEngine.cpp \
+    CpuFeatures.cpp \
+    AllocationCounter.cpp \
+    StreamBuffer.cpp \
+    FrameCapture.cpp \
+    TextureManager.cpp \
+    TextureData.cpp \
     camera.cpp
 
 HEADERS += \
@@ -38,8 +52,20 @@ HEADERS += \
     gl2widget.h \
     ImageData.h \
     AABB.h \
+    DataArray.h \
     Controller.h \
     Mesh.h \
+    MappedFile.h \
+    ThreadPool.h \
+    LoadMonitor.h \
+    AssetCache.h \
+    SkinningEngine.h \
+    CpuFeatures.h \
+    AllocationCounter.h \
+    StreamBuffer.h \
+    FrameCapture.h \
+    TextureManager.h \
+    TextureData.h \
     camera.h
 
 FORMS += \
@@ -1,7 +1,17 @@
 #include "ImageData.h"
+#include "CpuFeatures.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <vector>
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
 
 #pragma pack(push, 1)
 struct BITMAPFILEHEADER
@@ -54,456 +64,740 @@ struct TGAHEADER
 };
 #pragma pack(pop)
 
+bool ReadImage(std::string fname, ImageData & id)
+{
+    std::string ext = fname.substr(fname.find_last_of(".") + 1);
+    if(ext == "tga" || ext == "TGA")
+    {
+        return ReadTGA(fname, id);
+    }
+    else if(ext == "bmp" || ext == "BMP")
+    {
+        return ReadBMP(fname, id);
+    }
+
+    return false;
+}
+
 //==============================================================================
-//         Read BMP section
+//         Pixel conversion
 //==============================================================================
-bool ReadBMP(std::string fname, ImageData & id)
+namespace
 {
-    bool res = false;
-    bool compressed = false;
-    bool flip = false;
+    // channel order of the pixels in a file, converted to RGB(A)
+    enum class FileOrder
+    {
+        fo_bgr,
+        fo_bgra,
+        fo_abgr                              // BMP bit fields, alpha in the low byte
+    };
 
-    id.width = 0;
-    id.height = 0;
-    id.type = ImageData::PixelType::pt_none;
-    if(id.data)
-        id.data.reset(nullptr);
+    /*  Converts count pixels of a row: destination pixel j comes from source
+        pixel j, or count - 1 - j when reverse mirrors the row. */
+    typedef void (*SwizzleFunc)(const uint8_t * src, uint8_t * dst, uint32_t count, bool reverse);
 
-    std::ifstream ifs(fname, std::ios::in | std::ios::binary);
-    if(!ifs.is_open())
+    template<FileOrder O>
+    inline void SwizzlePixel(const uint8_t * s, uint8_t * d)
     {
-        std::cerr << "Error opening file: " << fname << std::endl;
-        return res;
+        if(O == FileOrder::fo_abgr)
+        {
+            d[0] = s[3];
+            d[1] = s[2];
+            d[2] = s[1];
+            d[3] = s[0];
+        }
+        else
+        {
+            d[0] = s[2];
+            d[1] = s[1];
+            d[2] = s[0];
+            if(O == FileOrder::fo_bgra)
+                d[3] = s[3];
+        }
     }
 
-    ifs.seekg(0, std::ios_base::end);
-    auto file_length = ifs.tellg();
-    ifs.seekg(0, std::ios_base::beg);
-    if(file_length == 0)
-        return res;
-
-    // allocate memory:
-    auto buffer = std::make_unique<char[]>(file_length);
-    // read file as a block:
-    ifs.read(buffer.get(), file_length);
-    ifs.close();
-
-    char * pPtr = buffer.get();
-    BITMAPFILEHEADER * pHeader = reinterpret_cast<BITMAPFILEHEADER *>(pPtr);
-    pPtr += sizeof(BITMAPFILEHEADER);
-    if(pHeader->bfSize != file_length ||
-            pHeader->bfType != 0x4D42)                   // little-endian
-        return res;
+    template<FileOrder O>
+    void SwizzleTail(const uint8_t * src, uint8_t * dst, uint32_t begin, uint32_t count, bool reverse)
+    {
+        const size_t bytes_per_pixel = O == FileOrder::fo_bgr ? 3 : 4;
+        for(uint32_t j = begin; j < count; j++)
+            SwizzlePixel<O>(src + (reverse ? count - 1 - j : j) * bytes_per_pixel, dst + j * bytes_per_pixel);
+    }
 
-    if(reinterpret_cast<uint32_t *>(pPtr)[0] == 12)
+    template<FileOrder O>
+    void SwizzleScalar(const uint8_t * src, uint8_t * dst, uint32_t count, bool reverse)
     {
-        BITMAPINFO12 * pInfo = reinterpret_cast<BITMAPINFO12 *>(pPtr);
-        pPtr += pInfo->biSize;
+        SwizzleTail<O>(src, dst, 0, count, reverse);
+    }
 
-        if(pInfo->biBitCount != 24 && pInfo->biBitCount != 32)
-            return res;
+#ifdef CPU_X86
+    // pshufb mask for four 4-byte pixels, mirrored ones in reverse order
+    template<FileOrder O>
+    inline __m128i SwizzleMask4(bool reverse)
+    {
+        if(O == FileOrder::fo_abgr)
+            return reverse ? _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+                           : _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+        return reverse ? _mm_setr_epi8(14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3)
+                       : _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    }
 
-        if(pInfo->biBitCount == 24)
-            id.type = ImageData::PixelType::pt_rgb;
+    template<FileOrder O>
+    CPU_TARGET("ssse3")
+    void SwizzleSSSE3(const uint8_t * src, uint8_t * dst, uint32_t count, bool reverse)
+    {
+        uint32_t j = 0;
+        if(O == FileOrder::fo_bgr)
+        {
+            // four pixels are 12 of the 16 bytes moved, so the loop stops while the whole vector is in the row;
+            // mirrored groups are loaded up to their last pixel and sit in the top 12 bytes
+            __m128i mask = reverse ? _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, -1, -1, -1, -1)
+                                   : _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, -1, -1, -1, -1);
+            for(; j + 6 <= count; j += 4)
+            {
+                const uint8_t * s = reverse ? src + size_t(count - j) * 3 - 16 : src + size_t(j) * 3;
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + size_t(j) * 3), _mm_shuffle_epi8(v, mask));
+            }
+        }
         else
-            id.type = ImageData::PixelType::pt_rgba;
+        {
+            __m128i mask = SwizzleMask4<O>(reverse);
+            for(; j + 4 <= count; j += 4)
+            {
+                const uint8_t * s = src + size_t(reverse ? count - 4 - j : j) * 4;
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + size_t(j) * 4), _mm_shuffle_epi8(v, mask));
+            }
+        }
+        SwizzleTail<O>(src, dst, j, count, reverse);
+    }
 
-        id.width = pInfo->biWidth;
-        id.height = pInfo->biHeight;
+    // 4-byte pixels only, 3-byte groups do not line up with the two 128-bit lanes
+    template<FileOrder O>
+    CPU_TARGET("avx2")
+    void SwizzleAVX2(const uint8_t * src, uint8_t * dst, uint32_t count, bool reverse)
+    {
+        __m256i mask = _mm256_broadcastsi128_si256(SwizzleMask4<O>(reverse));
+        uint32_t j = 0;
+        for(; j + 8 <= count; j += 8)
+        {
+            const uint8_t * s = src + size_t(reverse ? count - 8 - j : j) * 4;
+            __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(s)), mask);
+            if(reverse)
+                v = _mm256_permute4x64_epi64(v, 0x4E);                  // pshufb mirrors within the lanes
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + size_t(j) * 4), v);
+        }
+        SwizzleTail<O>(src, dst, j, count, reverse);
     }
-    else
+#endif
+
+    template<FileOrder O>
+    SwizzleFunc PickSwizzle()
     {
-        BITMAPINFO * pInfo = reinterpret_cast<BITMAPINFO *>(pPtr);
-        pPtr += pInfo->biSize;
+#ifdef CPU_X86
+        if(O != FileOrder::fo_bgr && CpuFeatures::HasAVX2())
+            return SwizzleAVX2<O>;
+        if(CpuFeatures::HasSSSE3())
+            return SwizzleSSSE3<O>;
+#endif
+        return SwizzleScalar<O>;
+    }
 
-        if(pInfo->biBitCount != 24 && pInfo->biBitCount != 32)
-            return res;
+    SwizzleFunc Swizzle(FileOrder order)
+    {
+        static const SwizzleFunc funcs[] =
+        {
+            PickSwizzle<FileOrder::fo_bgr>(),
+            PickSwizzle<FileOrder::fo_bgra>(),
+            PickSwizzle<FileOrder::fo_abgr>()
+        };
+        return funcs[static_cast<int>(order)];
+    }
+
+    // uninitialized, every reader writes each pixel once
+    void AllocateImage(ImageData & id, uint32_t width, uint32_t height, ImageData::PixelType type)
+    {
+        id.width = width;
+        id.height = height;
+        id.type = type;
+        id.order = ImageData::ChannelOrder::co_rgb;
+        id.stride = 0;
+        id.view = nullptr;
+        id.mapping.reset();
+        id.data.reset(new uint8_t[size_t(width) * height * id.BytesPerPixel()]);
+    }
 
-        if(pInfo->biCompression != 3 && pInfo->biCompression != 6 &&
-                pInfo->biCompression != 0)
+    // file rows straight into their final place: a flipped file fills the image
+    // from its last row, a mirrored one has each row converted backwards
+    void ConvertRows(FileOrder order, const uint8_t * src, size_t src_stride, bool flip_vertical,
+                     bool flip_horizontal, ImageData & id)
+    {
+        SwizzleFunc swizzle = Swizzle(order);
+        size_t row_bytes = size_t(id.width) * (id.type == ImageData::PixelType::pt_rgb ? 3 : 4);
+        for(uint32_t i = 0; i < id.height; i++)
         {
-            return res;
+            uint32_t row = flip_vertical ? id.height - 1 - i : i;
+            swizzle(src + i * src_stride, id.data.get() + row * row_bytes, id.width, flip_horizontal);
         }
-        
-        if(pInfo->biCompression == 3 || pInfo->biCompression == 6)
+    }
+}
+
+//==============================================================================
+//         Read BMP section
+//==============================================================================
+namespace
+{
+    struct BMPLayout
+    {
+        uint32_t             width;
+        uint32_t             height;
+        ImageData::PixelType type;
+        FileOrder            order;
+        bool                 flip;           // stored top-down
+        size_t               line_length;
+        const uint8_t *      pixels;         // first row in the file
+    };
+
+    bool ReadBMPHeader(const MappedFile & file, BMPLayout & bmp)
+    {
+        bool compressed = false;
+
+        if(file.Size() < sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFO12))
+            return false;
+
+        const char * pPtr = file.Data();
+        const BITMAPFILEHEADER * pHeader = reinterpret_cast<const BITMAPFILEHEADER *>(pPtr);
+        pPtr += sizeof(BITMAPFILEHEADER);
+        if(pHeader->bfSize != file.Size() ||
+                pHeader->bfType != 0x4D42)                   // little-endian
+            return false;
+
+        uint32_t info_size = 0;
+        std::memcpy(&info_size, pPtr, sizeof(info_size));   // packed after a 14 byte header, not aligned
+        bmp.flip = false;
+        if(info_size == 12)
         {
-            compressed = true;
-        }
+            const BITMAPINFO12 * pInfo = reinterpret_cast<const BITMAPINFO12 *>(pPtr);
 
-        if(pInfo->biBitCount == 24)
-            id.type = ImageData::PixelType::pt_rgb;
-        else
-            id.type = ImageData::PixelType::pt_rgba;
+            if(pInfo->biBitCount != 24 && pInfo->biBitCount != 32)
+                return false;
 
-        id.width = pInfo->biWidth;
-        
-        if(pInfo->biHeight < 0)
-            flip = true;
-        id.height = std::abs(pInfo->biHeight);
-    }
-    
-    // read data:
-    pPtr = buffer.get() + pHeader->bfOffBits;
-    uint32_t lineLength = 0;
-    uint32_t bytes_per_pixel = (id.type == ImageData::PixelType::pt_rgb ? 3 : 4);
-    auto image = std::make_unique<uint8_t[]>(id.width * id.height * bytes_per_pixel);
-    uint8_t red, green, blue, alpha;
-    uint32_t w_ind(0), h_ind(0);
-
-    if(id.type == ImageData::PixelType::pt_rgb)
-        lineLength = id.width * bytes_per_pixel + id.width % 4;
-    else
-        lineLength = id.width * bytes_per_pixel;
+            if(pInfo->biBitCount == 24)
+                bmp.type = ImageData::PixelType::pt_rgb;
+            else
+                bmp.type = ImageData::PixelType::pt_rgba;
 
-    for(uint32_t i = 0; i < id.height; ++i)
-    {
-        w_ind = 0;
-        for(uint32_t j = 0; j < lineLength; j += bytes_per_pixel)
+            bmp.width = pInfo->biWidth;
+            bmp.height = pInfo->biHeight;
+        }
+        else
         {
-            if(j > id.width * bytes_per_pixel)
-                continue;
+            if(file.Size() < sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFO))
+                return false;
+
+            const BITMAPINFO * pInfo = reinterpret_cast<const BITMAPINFO *>(pPtr);
 
-            if(compressed)
+            if(pInfo->biBitCount != 24 && pInfo->biBitCount != 32)
+                return false;
+
+            if(pInfo->biCompression != 3 && pInfo->biCompression != 6 &&
+                    pInfo->biCompression != 0)
             {
-                uint32_t count = 0;
-                if(id.type == ImageData::PixelType::pt_rgba)
-                {
-                    alpha = pPtr[i * lineLength + j + count];
-                    count++;
-                }
-                blue = pPtr[i * lineLength + j + count];
-                count++;
-                green = pPtr[i * lineLength + j + count];
-                count++;
-                red = pPtr[i * lineLength + j + count];
+                return false;
             }
-            else
+
+            if(pInfo->biCompression == 3 || pInfo->biCompression == 6)
             {
-                blue = pPtr[i * lineLength + j + 0];
-                green = pPtr[i * lineLength + j + 1];
-                red = pPtr[i * lineLength + j + 2];
-                if(id.type == ImageData::PixelType::pt_rgba)              // !!!Not supported - the high byte in each DWORD is not used
-                    alpha = pPtr[i * lineLength + j + 3];                 // https://msdn.microsoft.com/en-us/library/windows/desktop/dd183376(v=vs.85).aspx
+                compressed = true;
             }
 
+            if(pInfo->biBitCount == 24)
+                bmp.type = ImageData::PixelType::pt_rgb;
+            else
+                bmp.type = ImageData::PixelType::pt_rgba;
+
+            if(pInfo->biWidth < 0)
+                return false;
+            bmp.width = pInfo->biWidth;
 
-            image[h_ind * id.width * bytes_per_pixel + w_ind * bytes_per_pixel + 0] = red;
-            image[h_ind * id.width * bytes_per_pixel + w_ind * bytes_per_pixel + 1] = green;
-            image[h_ind * id.width * bytes_per_pixel + w_ind * bytes_per_pixel + 2] = blue;
-            if(id.type == ImageData::PixelType::pt_rgba)
-                image[h_ind * id.width * bytes_per_pixel + w_ind * bytes_per_pixel + 3] = alpha;
-            w_ind++;
+            if(pInfo->biHeight < 0)
+                bmp.flip = true;
+            bmp.height = static_cast<uint32_t>(std::abs(static_cast<int64_t>(pInfo->biHeight)));
         }
-        h_ind++;
-    }
-    
-    //flip image if necessary
-    if(flip)
-    {
-        auto temp_buf = std::make_unique<uint8_t[]>(id.width * id.height * bytes_per_pixel);
-        
-        for(uint32_t i = 0; i < id.height; i++)
+
+        // rows are padded to 4 bytes and have to be in the file
+        uint32_t bytes_per_pixel = (bmp.type == ImageData::PixelType::pt_rgb ? 3 : 4);
+        bmp.line_length = (size_t(bmp.width) * bytes_per_pixel + 3) & ~size_t(3);
+        if(pHeader->bfOffBits > file.Size() || bmp.line_length * bmp.height > file.Size() - pHeader->bfOffBits)
+            return false;
+        bmp.pixels = reinterpret_cast<const uint8_t *>(file.Data()) + pHeader->bfOffBits;
+
+        bmp.order = FileOrder::fo_bgr;
+        if(bmp.type == ImageData::PixelType::pt_rgba)
         {
-            std::memcpy(temp_buf.get() + i * id.width  * bytes_per_pixel,
-                        image.get() + (id.height - 1 - i) * id.width  * bytes_per_pixel,
-                        id.width  * bytes_per_pixel);
+            // !!!Not supported for BI_RGB - the high byte in each DWORD is not used
+            // https://msdn.microsoft.com/en-us/library/windows/desktop/dd183376(v=vs.85).aspx
+            bmp.order = compressed ? FileOrder::fo_abgr : FileOrder::fo_bgra;
         }
-        
-        image = std::move(temp_buf);
+        return true;
     }
+}
 
-    id.data = std::move(image);
-    res = true;
+bool ReadBMP(std::string fname, ImageData & id)
+{
+    id.width = 0;
+    id.height = 0;
+    id.type = ImageData::PixelType::pt_none;
+    if(id.data)
+        id.data.reset(nullptr);
+    id.view = nullptr;
+    id.mapping.reset();
+
+    // mapped rather than read, the pixels are converted from the file pages
+    MappedFile file;
+    if(!file.Open(fname.c_str()))
+    {
+        std::cerr << "Error opening file: " << fname << std::endl;
+        return false;
+    }
+
+    BMPLayout bmp;
+    if(!ReadBMPHeader(file, bmp))
+        return false;
 
-    return res;
+    // bottom-up like ImageData, unless the height was negative
+    AllocateImage(id, bmp.width, bmp.height, bmp.type);
+    ConvertRows(bmp.order, bmp.pixels, bmp.line_length, bmp.flip, false, id);
+    return true;
 }
 
 //==============================================================================
 //         TGA section
 //==============================================================================
-bool WriteTGA(std::string fname, const ImageData & id)
+namespace
+{
+    const size_t TGA_STAGING_BYTES = 1 << 20;            // converted rows gathered for each write to the file
+
+    // RLE packets of one BGR(A) row appended at out, returns the end; packets stay within the row
+    template<uint32_t BPP>
+    uint8_t * EncodeRLERow(const uint8_t * row, uint32_t width, uint8_t * out)
+    {
+        auto same = [row](uint32_t a, uint32_t b)
+        {
+            return std::memcmp(row + a * BPP, row + b * BPP, BPP) == 0;
+        };
+
+        uint32_t x = 0;
+        while(x < width)
+        {
+            uint32_t run = 1;
+            while(x + run < width && run < 128 && same(x, x + run))
+                run++;
+
+            if(run > 1)
+            {
+                *out++ = static_cast<uint8_t>(0x80 | (run - 1));
+                std::memcpy(out, row + size_t(x) * BPP, BPP);
+                out += BPP;
+                x += run;
+                continue;
+            }
+
+            // raw pixels up to the next pair of equal ones
+            uint32_t count = 1;
+            while(x + count < width && count < 128 && !(x + count + 1 < width && same(x + count, x + count + 1)))
+                count++;
+
+            *out++ = static_cast<uint8_t>(count - 1);
+            std::memcpy(out, row + size_t(x) * BPP, size_t(count) * BPP);
+            out += size_t(count) * BPP;
+            x += count;
+        }
+        return out;
+    }
+}
+
+bool WriteTGA(std::string fname, const ImageData & id, bool rle)
 {
-    bool res = false;
+    if(!id.Pixels() || id.type == ImageData::PixelType::pt_none)
+        return false;
+
     TGAHEADER tga;
     std::memset(&tga, 0, sizeof(tga));
-    uint32_t bytes_per_pixel = (id.type == ImageData::PixelType::pt_rgb ? 3 : 4);
+    uint32_t bytes_per_pixel = id.BytesPerPixel();
 
     std::ofstream ofs(fname, std::ios::out | std::ios::binary);
     if(!ofs.is_open())
     {
         std::cerr << "Error opening file: " << fname << std::endl;
-        return res;
+        return false;
     }
 
-    tga.datatypecode = 2;
+    tga.datatypecode = rle ? 10 : 2;
     tga.width = id.width;
     tga.height = id.height;
     tga.bitsperpixel = bytes_per_pixel * 8;
-    if(id.type == ImageData::PixelType::pt_rgb)
-        tga.imagedescriptor = 0x10;
-    else
-        tga.imagedescriptor = 0x18;
+    tga.imagedescriptor = bytes_per_pixel == 4 ? 8 : 0;    // alpha bits, lower-left origin like ImageData
 
     ofs.write(reinterpret_cast<char *>(&tga), sizeof(tga));
 
-    uint8_t * data_ptr = id.data.get();
-    uint8_t red, green, blue, alpha;
-    for(uint32_t i = 0; i < id.width * id.height * bytes_per_pixel; i += bytes_per_pixel)
-    {
-        red = data_ptr[i + 0];
-        green = data_ptr[i + 1];
-        blue = data_ptr[i + 2];
-        if(bytes_per_pixel == 4)
-            alpha = data_ptr[i + 3];
-
-        ofs.write(reinterpret_cast<char *>(&blue), 1);
-        ofs.write(reinterpret_cast<char *>(&green), 1);
-        ofs.write(reinterpret_cast<char *>(&red), 1);
-        if(id.type == ImageData::PixelType::pt_rgba)
-            ofs.write(reinterpret_cast<char *>(&alpha), 1);
+    // rows are swizzled in bulk into a staging buffer written in large blocks;
+    // swapping red and blue is its own inverse, the reader kernels serve here too
+    size_t               row_bytes = size_t(id.width) * bytes_per_pixel;
+    size_t               row_max = rle ? row_bytes + (id.width + 127) / 128 : row_bytes;
+    std::vector<uint8_t> staging(std::max(TGA_STAGING_BYTES, row_max));
+    std::vector<uint8_t> bgr(rle ? row_bytes : 0);
+    SwizzleFunc          swizzle = nullptr;
+    if(id.order != ImageData::ChannelOrder::co_bgr)
+        swizzle = Swizzle(bytes_per_pixel == 3 ? FileOrder::fo_bgr : FileOrder::fo_bgra);
+
+    size_t used = 0;
+    for(uint32_t y = 0; y < id.height; y++)
+    {
+        if(used + row_max > staging.size())
+        {
+            ofs.write(reinterpret_cast<const char *>(staging.data()), static_cast<std::streamsize>(used));
+            used = 0;
+        }
+
+        uint8_t * dst = rle ? bgr.data() : staging.data() + used;
+        if(swizzle)
+            swizzle(id.Row(y), dst, id.width, false);
+        else
+            std::memcpy(dst, id.Row(y), row_bytes);
+
+        if(!rle)
+            used += row_bytes;
+        else if(bytes_per_pixel == 3)
+            used = EncodeRLERow<3>(dst, id.width, staging.data() + used) - staging.data();
+        else
+            used = EncodeRLERow<4>(dst, id.width, staging.data() + used) - staging.data();
     }
+    ofs.write(reinterpret_cast<const char *>(staging.data()), static_cast<std::streamsize>(used));
 
-    ofs.close();
-    res = true;
+    return static_cast<bool>(ofs);
+}
 
-    return res;
+std::future<bool> WriteTGAAsync(std::string fname, ImageData id, bool rle)
+{
+    return std::async(std::launch::async, [fname = std::move(fname), id = std::move(id), rle]()
+    {
+        return WriteTGA(fname, id, rle);
+    });
 }
 
-bool ReadUncompressedTGA(ImageData & id, char * data);
-bool ReadCompressedTGA(ImageData & id, char * data);
+namespace
+{
+    // header checks shared by both TGA readers, the pixels follow the image id and the colour map
+    const uint8_t * ReadTGAHeader(const uint8_t * data, const uint8_t * end, uint32_t & width, uint32_t & height,
+                                  ImageData::PixelType & type)
+    {
+        const TGAHEADER * pHeader = reinterpret_cast<const TGAHEADER *>(data);
+        // Make sure all information is valid
+        if((pHeader->width <= 0) || (pHeader->height <= 0)
+            || ((pHeader->bitsperpixel != 24) && (pHeader->bitsperpixel !=32)))
+        {
+            return nullptr;
+        }
+
+        width = pHeader->width;
+        height = pHeader->height;
+        type = pHeader->bitsperpixel == 24 ? ImageData::PixelType::pt_rgb
+                                           : ImageData::PixelType::pt_rgba;
+
+        size_t skip = sizeof(TGAHEADER) + pHeader->idlength;
+        if(pHeader->colourmaptype != 0)
+            skip += size_t(pHeader->colourmaplength) * ((pHeader->colourmapdepth + 7) / 8);
+        if(skip > size_t(end - data))
+            return nullptr;
+        return data + skip;
+    }
+}
+
+bool ReadUncompressedTGA(ImageData & id, const uint8_t * data, const uint8_t * end);
+bool ReadCompressedTGA(ImageData & id, const uint8_t * data, const uint8_t * end);
 
 bool ReadTGA(std::string fname, ImageData & id)
 {
-    std::ifstream ifs(fname, std::ios::in | std::ios::binary);
-    if(!ifs.is_open())
+    // mapped rather than read, the pixels are converted from the file pages
+    MappedFile file;
+    if(!file.Open(fname.c_str()))
     {
         std::cerr << "Error opening file: " << fname << std::endl;
         return false;
     }
-    
-    ifs.seekg(0, std::ios_base::end);
-    auto file_length = ifs.tellg();
-    ifs.seekg(0, std::ios_base::beg);
-    if(file_length == 0)
+
+    if(file.Size() < sizeof(TGAHEADER))
         return false;
-        
-    // allocate memory:
-    auto buffer = std::make_unique<char[]>(file_length);
-    // read file as a block:
-    ifs.read(buffer.get(), file_length);
-    ifs.close();
-    
-    char * pPtr = buffer.get();
-    TGAHEADER * pHeader = reinterpret_cast<TGAHEADER *>(pPtr);
-    pPtr += sizeof(TGAHEADER);
-    
+
+    const uint8_t * data = reinterpret_cast<const uint8_t *>(file.Data());
+    const TGAHEADER * pHeader = reinterpret_cast<const TGAHEADER *>(data);
+
     if(pHeader->datatypecode == 2)
     {
-        return ReadUncompressedTGA(id, buffer.get());
+        return ReadUncompressedTGA(id, data, data + file.Size());
     }
     else if(pHeader->datatypecode == 10)
     {
-        return ReadCompressedTGA(id, buffer.get());
+        return ReadCompressedTGA(id, data, data + file.Size());
     }
-    
+
     return false;
 }
 
-bool ReadUncompressedTGA(ImageData & id, char * data)
+bool ReadUncompressedTGA(ImageData & id, const uint8_t * data, const uint8_t * end)
 {
-    uint8_t * pPtr = reinterpret_cast<uint8_t *>(data);
-    TGAHEADER * pHeader = reinterpret_cast<TGAHEADER *>(pPtr);
-    pPtr += sizeof(TGAHEADER);
-    
-    if((pHeader->width <= 0) || (pHeader->height <= 0) 
-        || ((pHeader->bitsperpixel != 24) && (pHeader->bitsperpixel !=32)))         // Make sure all information is valid
-    {
+    const TGAHEADER * pHeader = reinterpret_cast<const TGAHEADER *>(data);
+    uint32_t width, height;
+    ImageData::PixelType type;
+    const uint8_t * pPtr = ReadTGAHeader(data, end, width, height, type);
+    if(!pPtr)
         return false;
-    }
-    
-    id.width = pHeader->width;
-    id.height = pHeader->height;
-    id.type = pHeader->bitsperpixel == 24 ? ImageData::PixelType::pt_rgb 
-                                          : ImageData::PixelType::pt_rgba;
+
     bool flip_horizontal =  (pHeader->imagedescriptor & 0x10);
     bool flip_vertical =    (pHeader->imagedescriptor & 0x20);
-    
+
     uint32_t bytes_per_pixel = pHeader->bitsperpixel/8;
-    uint32_t image_size = id.width * id.height * bytes_per_pixel;
-    
-    auto img = std::make_unique<uint8_t[]>(image_size);
-    
-    uint8_t red, green, blue, alpha;
-    for(uint32_t i = 0; i < id.width * id.height; ++i)
-    {
-        red = pPtr[i * bytes_per_pixel + 2];
-        green = pPtr[i * bytes_per_pixel + 1];
-        blue = pPtr[i * bytes_per_pixel + 0];
-        if(id.type == ImageData::PixelType::pt_rgba)
-            alpha = pPtr[i * bytes_per_pixel + 3];
-            
-        img[i * bytes_per_pixel + 0] = red;
-        img[i * bytes_per_pixel + 1] = green;
-        img[i * bytes_per_pixel + 2] = blue;
-        if(id.type == ImageData::PixelType::pt_rgba)
-            img[i * bytes_per_pixel + 3] = alpha;
+    size_t   row_bytes = size_t(width) * bytes_per_pixel;
+    if(row_bytes * height > size_t(end - pPtr))
+        return false;
+
+    AllocateImage(id, width, height, type);
+    ConvertRows(bytes_per_pixel == 3 ? FileOrder::fo_bgr : FileOrder::fo_bgra, pPtr, row_bytes,
+                flip_vertical, flip_horizontal, id);
+    return true;
+}
+
+namespace
+{
+    const uint32_t RLE_SEGMENT_PIXELS = 1 << 16;         // output pixels per segment expanded by one task
+
+    // first packet of a segment and the pixel, in file order, it starts at
+    struct RLESegment
+    {
+        size_t   offset;
+        uint64_t pixel;
+    };
+
+    /*  First pass: walks the packet headers only, checking that every packet
+        is in the file and that they add up to exactly the image, and marks a
+        segment start at the first packet boundary past each RLE_SEGMENT_PIXELS
+        output pixels. The last entry ends the last segment. */
+    bool ScanRLE(const uint8_t * data, const uint8_t * end, uint64_t pixels, uint32_t bytes_per_pixel,
+                 std::vector<RLESegment> & segments)
+    {
+        segments.clear();
+        segments.push_back(RLESegment{0, 0});
+
+        const uint8_t * pPtr = data;
+        uint64_t        pixel = 0;
+        uint64_t        next_mark = RLE_SEGMENT_PIXELS;
+        while(pixel < pixels)
+        {
+            if(pPtr == end)
+                return false;
+
+            uint8_t  chunk = *pPtr++;
+            uint32_t count = (chunk & 127) + 1;
+            size_t   bytes = size_t((chunk & 128) ? 1 : count) * bytes_per_pixel;
+            if(size_t(end - pPtr) < bytes)
+                return false;
+
+            pPtr += bytes;
+            pixel += count;
+            if(pixel > pixels) // Make sure we havent read too many pixels
+                return false;
+
+            if(pixel >= next_mark)
+            {
+                segments.push_back(RLESegment{size_t(pPtr - data), pixel});
+                next_mark = pixel + RLE_SEGMENT_PIXELS;
+            }
+        }
+
+        if(segments.back().pixel != pixels)
+            segments.push_back(RLESegment{size_t(pPtr - data), pixels});
+        return true;
     }
-    
-    if(flip_vertical)
+
+    // count copies of the pixel at dst; short runs pixel by pixel, long ones doubling
+    // the filled part so they become a few block copies
+    template<uint32_t BPP>
+    inline void FillRun(uint8_t * dst, uint32_t count)
     {
-        auto flipped_img = std::make_unique<uint8_t[]>(image_size);
-        
-        for(uint32_t i = 0; i < id.height; i++)
+        if(count <= 16)
         {
-            std::memcpy(flipped_img.get() + i * id.width  * bytes_per_pixel,
-                        img.get() + (id.height - 1 - i) * id.width  * bytes_per_pixel,
-                        id.width  * bytes_per_pixel);
+            for(uint32_t k = 1; k < count; k++)
+                std::memcpy(dst + k * BPP, dst, BPP);
+            return;
+        }
+
+        size_t filled = BPP;
+        size_t total = size_t(count) * BPP;
+        while(filled < total)
+        {
+            size_t n = std::min(filled, total - filled);
+            std::memcpy(dst + filled, dst, n);
+            filled += n;
         }
-        
-        img = std::move(flipped_img);
     }
-    
-    if(flip_horizontal)
+
+    /*  Second pass: the packets of one segment, already checked by ScanRLE(),
+        from pixel begin to pixel end. Segments write disjoint pixels and run
+        in parallel; the pixel order is known at compile time so short packets
+        are converted inline. */
+    template<FileOrder O>
+    void ExpandRLE(const uint8_t * pPtr, uint64_t begin, uint64_t end, bool flip_vertical, bool flip_horizontal,
+                   ImageData & id)
     {
-        auto flipped_img = std::make_unique<uint8_t[]>(image_size);
-        
-        for(uint32_t i = 0; i < id.height; i++)
+        constexpr uint32_t bytes_per_pixel = O == FileOrder::fo_bgr ? 3 : 4;
+        const uint32_t     width = id.width;
+        const uint32_t     height = id.height;
+        const size_t       row_bytes = size_t(width) * bytes_per_pixel;
+        SwizzleFunc        swizzle = Swizzle(O);
+
+        uint32_t x = static_cast<uint32_t>(begin % width);
+        uint32_t y = static_cast<uint32_t>(begin / width);
+        uint64_t pixel = begin;
+        while(pixel < end)
         {
-            for(uint32_t j = 0; j < id.width; j++)
+            uint8_t  chunk = *pPtr++;
+            bool     run = chunk & 128;
+            uint32_t count = (chunk & 127) + 1;
+            pixel += count;
+
+            // packets may run over the end of a row, each part lands in its row
+            // where the flips put it
+            while(count > 0)
             {
-                flipped_img[id.width  * bytes_per_pixel * i + j * bytes_per_pixel + 0] = 
-                    img[id.width  * bytes_per_pixel * i + (id.width - j - 1) * bytes_per_pixel + 0];
-                flipped_img[id.width  * bytes_per_pixel * i + j * bytes_per_pixel + 1] = 
-                    img[id.width  * bytes_per_pixel * i + (id.width - j - 1) * bytes_per_pixel + 1];
-                flipped_img[id.width  * bytes_per_pixel * i + j * bytes_per_pixel + 2] = 
-                    img[id.width  * bytes_per_pixel * i + (id.width - j - 1) * bytes_per_pixel + 2];
-                if(id.type == ImageData::PixelType::pt_rgba)
-                    flipped_img[id.width  * bytes_per_pixel * i + j * bytes_per_pixel + 3] = 
-                        img[id.width  * bytes_per_pixel * i + (id.width - j - 1) * bytes_per_pixel + 3];
+                uint32_t  span = std::min(count, width - x);
+                uint8_t * row = id.data.get() + (flip_vertical ? height - 1 - y : y) * row_bytes;
+                uint8_t * dst = row + size_t(flip_horizontal ? width - x - span : x) * bytes_per_pixel;
+                if(run)
+                {
+                    SwizzlePixel<O>(pPtr, dst);
+                    FillRun<bytes_per_pixel>(dst, span);
+                }
+                else if(span >= 8)
+                {
+                    swizzle(pPtr, dst, span, flip_horizontal);
+                    pPtr += size_t(span) * bytes_per_pixel;
+                }
+                else
+                {
+                    for(uint32_t k = 0; k < span; k++, pPtr += bytes_per_pixel)
+                        SwizzlePixel<O>(pPtr, dst + (flip_horizontal ? span - 1 - k : k) * bytes_per_pixel);
+                }
+
+                count -= span;
+                x += span;
+                if(x == width)
+                {
+                    x = 0;
+                    y++;
+                }
             }
+
+            if(run)
+                pPtr += bytes_per_pixel;
         }
-        
-        img = std::move(flipped_img);
     }
-    
-    id.data = std::move(img);
-    return true;
+
+    template<FileOrder O>
+    void DecodeRLE(const uint8_t * data, const std::vector<RLESegment> & segments, bool flip_vertical,
+                   bool flip_horizontal, ImageData & id)
+    {
+        ThreadPool::Global().ParallelFor(static_cast<uint32_t>(segments.size() - 1), [&](uint32_t i)
+        {
+            ExpandRLE<O>(data + segments[i].offset, segments[i].pixel, segments[i + 1].pixel,
+                         flip_vertical, flip_horizontal, id);
+        });
+    }
 }
 
-bool ReadCompressedTGA(ImageData & id, char * data)
+bool ReadCompressedTGA(ImageData & id, const uint8_t * data, const uint8_t * end)
 {
-    uint8_t * pPtr = reinterpret_cast<uint8_t *>(data);
-    TGAHEADER * pHeader = reinterpret_cast<TGAHEADER *>(pPtr);
-    pPtr += sizeof(TGAHEADER);
-    
-    if((pHeader->width <= 0) || (pHeader->height <= 0) 
-        || ((pHeader->bitsperpixel != 24) && (pHeader->bitsperpixel !=32)))         // Make sure all information is valid
-    {
+    const TGAHEADER * pHeader = reinterpret_cast<const TGAHEADER *>(data);
+    uint32_t width, height;
+    ImageData::PixelType type;
+    const uint8_t * pPtr = ReadTGAHeader(data, end, width, height, type);
+    if(!pPtr)
         return false;
-    }
-    
-    id.width = pHeader->width;
-    id.height = pHeader->height;
-    id.type = pHeader->bitsperpixel == 24 ? ImageData::PixelType::pt_rgb 
-                                          : ImageData::PixelType::pt_rgba;
+
     bool flip_horizontal =  (pHeader->imagedescriptor & 0x10);
     bool flip_vertical =    (pHeader->imagedescriptor & 0x20);
-    
-    uint32_t bytes_per_pixel = pHeader->bitsperpixel/8;
-    uint32_t image_size = id.width * id.height * bytes_per_pixel;
-    
-    auto     img = std::make_unique<uint8_t[]>(image_size);
-    uint32_t pixelcount = id.height * id.width;
-    uint32_t currentpixel   = 0;
-    uint32_t currentbyte    = 0;
-    
-    do
-    {
-        uint8_t chunk = pPtr[0];
-        pPtr++;
-        
-        if(chunk & 128)
-        {
-            chunk -= 127;
-            for(short counter = 0; counter < chunk; counter++)
-            {                                                               
-                img[currentbyte + 0] = pPtr[2];
-                img[currentbyte + 1] = pPtr[1];
-                img[currentbyte + 2] = pPtr[0];
-                if(id.type == ImageData::PixelType::pt_rgba)                                    
-                    img[currentbyte + 3] = pPtr[3];
 
+    // the whole stream is checked before a pixel is written
+    std::vector<RLESegment> segments;
+    uint32_t bytes_per_pixel = type == ImageData::PixelType::pt_rgb ? 3 : 4;
+    if(!ScanRLE(pPtr, end, uint64_t(width) * height, bytes_per_pixel, segments))
+        return false;
 
-                currentbyte += bytes_per_pixel; 
-                currentpixel++; 
+    AllocateImage(id, width, height, type);
+    if(type == ImageData::PixelType::pt_rgb)
+        DecodeRLE<FileOrder::fo_bgr>(pPtr, segments, flip_vertical, flip_horizontal, id);
+    else
+        DecodeRLE<FileOrder::fo_bgra>(pPtr, segments, flip_vertical, flip_horizontal, id);
+    return true;
+}
 
-                if(currentpixel > pixelcount)                                           // Make sure we havent written too many pixels
-                {
-                    return false;
-                }
-            }
-            pPtr += bytes_per_pixel;
-        }
-        else
-        {
-            chunk++;
-            for(short counter = 0; counter < chunk; counter++)
-            {           
-                img[currentbyte + 0] = pPtr[2];
-                img[currentbyte + 1] = pPtr[1];
-                img[currentbyte + 2] = pPtr[0];
-                if(id.type == ImageData::PixelType::pt_rgba)
-                    img[currentbyte + 3] = pPtr[3];
-                    
-                currentbyte += bytes_per_pixel;
-                currentpixel++; 
-                pPtr += bytes_per_pixel;
-                
-                if(currentpixel > pixelcount)                                           // Make sure we havent read too many pixels
-                {
-                    return false;                                                       
-                }
-            }
-        }
-    }while(currentpixel < pixelcount);
-    
-    if(flip_vertical)
+//==============================================================================
+//         Mapped images
+//==============================================================================
+bool MapImage(std::string fname, ImageData & id)
+{
+    auto file = std::make_shared<MappedFile>();
+    if(!file->Open(fname.c_str()))
     {
-        auto flipped_img = std::make_unique<uint8_t[]>(image_size);
-        
-        for(uint32_t i = 0; i < id.height; i++)
-        {
-            std::memcpy(flipped_img.get() + i * id.width  * bytes_per_pixel,
-                        img.get() + (id.height - 1 - i) * id.width  * bytes_per_pixel,
-                        id.width  * bytes_per_pixel);
-        }
-        
-        img = std::move(flipped_img);
+        std::cerr << "Error opening file: " << fname << std::endl;
+        return false;
     }
-    
-    if(flip_horizontal)
+
+    uint32_t             width = 0;
+    uint32_t             height = 0;
+    ImageData::PixelType type = ImageData::PixelType::pt_none;
+    size_t               stride = 0;
+    const uint8_t *      pixels = nullptr;
+
+    std::string ext = fname.substr(fname.find_last_of(".") + 1);
+    if((ext == "tga" || ext == "TGA") && file->Size() >= sizeof(TGAHEADER))
     {
-        auto flipped_img = std::make_unique<uint8_t[]>(image_size);
-        
-        for(uint32_t i = 0; i < id.height; i++)
-        {
-            for(uint32_t j = 0; j < id.width; j++)
-            {
-                flipped_img[id.width  * bytes_per_pixel * i + j * bytes_per_pixel + 0] = 
-                    img[id.width  * bytes_per_pixel * i + (id.width - j - 1) * bytes_per_pixel + 0];
-                flipped_img[id.width  * bytes_per_pixel * i + j * bytes_per_pixel + 1] = 
-                    img[id.width  * bytes_per_pixel * i + (id.width - j - 1) * bytes_per_pixel + 1];
-                flipped_img[id.width  * bytes_per_pixel * i + j * bytes_per_pixel + 2] = 
-                    img[id.width  * bytes_per_pixel * i + (id.width - j - 1) * bytes_per_pixel + 2];
-                if(id.type == ImageData::PixelType::pt_rgba)
-                    flipped_img[id.width  * bytes_per_pixel * i + j * bytes_per_pixel + 3] = 
-                        img[id.width  * bytes_per_pixel * i + (id.width - j - 1) * bytes_per_pixel + 3];
-            }
-        }
-        
-        img = std::move(flipped_img);
+        const uint8_t * data = reinterpret_cast<const uint8_t *>(file->Data());
+        const uint8_t * end = data + file->Size();
+        const TGAHEADER * pHeader = reinterpret_cast<const TGAHEADER *>(data);
+        if(pHeader->datatypecode != 2 || (pHeader->imagedescriptor & 0x30) != 0)
+            return false;
+
+        pixels = ReadTGAHeader(data, end, width, height, type);
+        stride = size_t(width) * (type == ImageData::PixelType::pt_rgb ? 3 : 4);
+        if(!pixels || stride * height > size_t(end - pixels))
+            return false;
     }
-    
-    id.data = std::move(img);
+    else if(ext == "bmp" || ext == "BMP")
+    {
+        BMPLayout bmp;
+        if(!ReadBMPHeader(*file, bmp) || bmp.flip || bmp.order == FileOrder::fo_abgr)
+            return false;
+
+        width = bmp.width;
+        height = bmp.height;
+        type = bmp.type;
+        stride = bmp.line_length;
+        pixels = bmp.pixels;
+    }
+    else
+    {
+        return false;
+    }
+
+    id.width = width;
+    id.height = height;
+    id.type = type;
+    id.data.reset();
+    id.order = ImageData::ChannelOrder::co_bgr;
+    id.stride = static_cast<uint32_t>(stride);
+    id.view = pixels;
+    id.mapping = std::move(file);
     return true;
 }
@@ -2,9 +2,12 @@
 #define IMAGEDATA_H
 
 #include <cstdint>
+#include <future>
 #include <memory>
 #include <string>
 
+class MappedFile;
+
 struct ImageData
 {
     // origin is the lower-left corner    
@@ -14,15 +17,48 @@ struct ImageData
         pt_rgba,
         pt_none
     };
+
+    // channel order in memory, BGR(A) only for views of a file and frames read back from GL
+    enum class ChannelOrder
+    {
+        co_rgb,
+        co_bgr
+    };
     
     uint32_t                   width;
     uint32_t                   height;
     PixelType                  type;
-    std::unique_ptr<uint8_t[]> data;
+    std::unique_ptr<uint8_t[]> data;             // decoded pixels, rows packed
+
+    // Set by MapImage() instead of data: the pixels left in the mapped file
+    ChannelOrder                      order;
+    uint32_t                          stride;    // bytes from a row to the next, 0 for packed rows
+    const uint8_t *                   view;
+    std::shared_ptr<const MappedFile> mapping;   // keeps view valid, shared by every copy of the view
+
+    ImageData() : width(0), height(0), type(PixelType::pt_none), order(ChannelOrder::co_rgb), stride(0),
+                  view(nullptr) {}
+
+    uint32_t        BytesPerPixel() const { return type == PixelType::pt_rgb ? 3 : 4; }
+    uint32_t        Stride() const { return stride != 0 ? stride : width * BytesPerPixel(); }
+    const uint8_t * Pixels() const { return view ? view : data.get(); }
+    const uint8_t * Row(uint32_t y) const { return Pixels() + static_cast<size_t>(y) * Stride(); }
+    bool            IsView() const { return view != nullptr; }
 };
 
+bool ReadImage(std::string fname, ImageData & id);        // picks the reader by extension
 bool ReadBMP(std::string fname, ImageData & id);
 bool ReadTGA(std::string fname, ImageData & id);
-bool WriteTGA(std::string fname, const ImageData & id);
+bool WriteTGA(std::string fname, const ImageData & id, bool rle = false);
+//! WriteTGA() on a thread of its own, the image is moved in and freed once written
+std::future<bool> WriteTGAAsync(std::string fname, ImageData id, bool rle = false);
+
+//! View of the pixels where the file holds them as they are, no decoding and no copy
+/*!
+    Uncompressed TGA files with a lower-left origin and uncompressed BMP
+    files stored bottom-up qualify; the view is BGR(A) with the row stride
+    of the file. Returns false for any other file, ReadImage() decodes those.
+*/
+bool MapImage(std::string fname, ImageData & id);
 
 #endif // IMAGEDATA_H
@@ -0,0 +1,40 @@
+#include "LoadMonitor.h"
+#include <algorithm>
+
+LoadMonitor::LoadMonitor(ProgressCallback callback) : _callback(std::move(callback)),
+                                                      _cancelled(false),
+                                                      _total(0),
+                                                      _done(0),
+                                                      _percent(0)
+{
+}
+
+void LoadMonitor::Advance(uint64_t amount)
+{
+    uint64_t done = _done.fetch_add(amount, std::memory_order_relaxed) + amount;
+    uint64_t total = _total.load(std::memory_order_relaxed);
+    if(total == 0)
+        return;
+
+    Report(static_cast<int>(std::min<uint64_t>(100, done * 100 / total)));
+}
+
+void LoadMonitor::Finish()
+{
+    Report(100);
+}
+
+void LoadMonitor::Report(int percent)
+{
+    // only the thread that moves the percentage forward reports it
+    int prev = _percent.load(std::memory_order_relaxed);
+    while(percent > prev)
+    {
+        if(_percent.compare_exchange_weak(prev, percent, std::memory_order_relaxed))
+        {
+            if(_callback)
+                _callback(percent);
+            return;
+        }
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef LOADMONITOR_H
+#define LOADMONITOR_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+//! Progress and cancellation shared between a loader and the thread that started it
+/*!
+    Loaders report the amount of input consumed with Advance(), which
+    may be called from several worker threads at once, and poll
+    IsCancelled() to give up early. The callback runs on the reporting
+    thread every time the completed percentage grows.
+*/
+class LoadMonitor
+{
+public:
+    typedef std::function<void(int)> ProgressCallback;        // percent in [0, 100]
+
+    explicit LoadMonitor(ProgressCallback callback = ProgressCallback());
+
+    void Cancel() { _cancelled.store(true, std::memory_order_relaxed); }
+    bool IsCancelled() const { return _cancelled.load(std::memory_order_relaxed); }
+
+    void SetTotal(uint64_t total) { _total.store(total, std::memory_order_relaxed); }
+    void Advance(uint64_t amount);
+    void Finish();
+
+    int  Progress() const { return _percent.load(std::memory_order_relaxed); }
+
+private:
+    void Report(int percent);
+
+    ProgressCallback      _callback;
+    std::atomic<bool>     _cancelled;
+    std::atomic<uint64_t> _total;
+    std::atomic<uint64_t> _done;
+    std::atomic<int>      _percent;
+};
+
+#endif // LOADMONITOR_H
@@ -0,0 +1,170 @@
+#include "MappedFile.h"
+#include <iostream>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() : _data(nullptr),
+                           _size(0),
+                           _open(false)
+#ifdef _WIN32
+                           ,
+                           _file(nullptr),
+                           _mapping(nullptr)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+MappedFile::MappedFile(MappedFile&& mf) : MappedFile()
+{
+    *this = std::move(mf);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& mf)
+{
+    if(this != &mf)
+    {
+        Close();
+
+        std::swap(_data, mf._data);
+        std::swap(_size, mf._size);
+        std::swap(_open, mf._open);
+#ifdef _WIN32
+        std::swap(_file, mf._file);
+        std::swap(_mapping, mf._mapping);
+#endif
+    }
+
+    return *this;
+}
+
+#ifdef _WIN32
+bool MappedFile::Open(const char * fname)
+{
+    Close();
+
+    HANDLE file = CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        std::cerr << "Cannot open: " << fname << std::endl;
+        return false;
+    }
+
+    LARGE_INTEGER file_size;
+    if(!GetFileSizeEx(file, &file_size))
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    _file = file;
+    _size = static_cast<size_t>(file_size.QuadPart);
+    _open = true;
+    if(_size == 0)
+        return true;
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(mapping == nullptr)
+    {
+        std::cerr << "Cannot map: " << fname << std::endl;
+        Close();
+        return false;
+    }
+    _mapping = mapping;
+
+    _data = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if(_data == nullptr)
+    {
+        std::cerr << "Cannot map: " << fname << std::endl;
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if(_data)
+        UnmapViewOfFile(_data);
+    if(_mapping)
+        CloseHandle(static_cast<HANDLE>(_mapping));
+    if(_file)
+        CloseHandle(static_cast<HANDLE>(_file));
+
+    _data = nullptr;
+    _size = 0;
+    _open = false;
+    _file = nullptr;
+    _mapping = nullptr;
+}
+#else
+bool MappedFile::Open(const char * fname)
+{
+    Close();
+
+    int fd = ::open(fname, O_RDONLY);
+    if(fd < 0)
+    {
+        std::cerr << "Cannot open: " << fname << std::endl;
+        return false;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    _size = static_cast<size_t>(st.st_size);
+    _open = true;
+    if(_size == 0)
+    {
+        ::close(fd);
+        return true;
+    }
+
+    void * ptr = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);                                    // the mapping keeps its own reference
+    if(ptr == MAP_FAILED)
+    {
+        std::cerr << "Cannot map: " << fname << std::endl;
+        _size = 0;
+        _open = false;
+        return false;
+    }
+
+    // loaders walk the file front to back
+    madvise(ptr, _size, MADV_SEQUENTIAL);
+    _data = static_cast<const char *>(ptr);
+
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if(_data)
+        munmap(const_cast<char *>(_data), _size);
+
+    _data = nullptr;
+    _size = 0;
+    _open = false;
+}
+#endif
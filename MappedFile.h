@@ -0,0 +1,46 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+
+//! Read-only file mapped into the address space
+/*!
+    Wraps mmap (CreateFileMapping on Windows) so loaders can tokenize
+    or reinterpret file contents in place instead of reading them
+    into an intermediate buffer. The mapping is released on Close()
+    or destruction.
+*/
+class MappedFile
+{
+    const char * _data;
+    size_t       _size;
+    bool         _open;
+#ifdef _WIN32
+    void *       _file;
+    void *       _mapping;
+#endif
+
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& mf);
+    MappedFile& operator=(MappedFile&& mf);
+
+    /*! Map the whole file.
+        \param[in] fname path to the file
+        \return True if the file was opened. An empty file is opened with a null data pointer.
+    */
+    bool Open(const char * fname);
+    void Close();
+
+    bool         IsOpen() const { return _open; }
+    const char * Data() const { return _data; }
+    const char * End() const { return _data + _size; }
+    size_t       Size() const { return _size; }
+};
+
+#endif // MAPPEDFILE_H
@@ -1,5 +1,8 @@
 #include "Mesh.h"
 #include "ImageData.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include <charconv>
 #include <cmath>
 #include <cstdint>
 #include <fstream>
@@ -7,11 +10,190 @@
 #include <sstream>
 #include <iterator>
 #include <algorithm>
+#include <functional>
 #include <cassert>
+#include <cfloat>
+#include <cstring>
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/euler_angles.hpp>
 
+namespace
+{
+    inline bool IsBlank(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+    }
+
+    // same result as line.substr(0, N - 1) == kw, without the temporary
+    template<size_t N>
+    inline bool StartsWith(const char * p, const char * end, const char (&kw)[N])
+    {
+        return static_cast<size_t>(end - p) >= N - 1 && std::memcmp(p, kw, N - 1) == 0;
+    }
+
+    // Reads the next number and advances p past it; mirrors operator>> by
+    // skipping leading blanks and leaving 0 in place of a malformed value
+    template<typename T>
+    inline T ParseNumber(const char *& p, const char * end)
+    {
+        while(p < end && IsBlank(*p))
+            p++;
+        if(p < end && *p == '+')
+            p++;
+
+        T val = 0;
+        auto res = std::from_chars(p, end, val);
+        if(res.ec == std::errc())
+            p = res.ptr;
+        else
+            val = 0;
+
+        return val;
+    }
+
+    inline glm::vec3 ParseVec3(const char *& p, const char * end)
+    {
+        glm::vec3 v;
+        v.x = ParseNumber<float>(p, end);
+        v.y = ParseNumber<float>(p, end);
+        v.z = ParseNumber<float>(p, end);
+        return v;
+    }
+
+    #pragma pack(push, 1)
+    struct MSHBHEADER
+    {
+        char     magic[4];                  // "MSHB"
+        uint32_t version;
+        uint32_t num_meshes;
+        uint32_t reserved;
+        float    bbox[6];                   // min xyz, max xyz
+        uint32_t padding[2];
+    };
+
+    struct MSHBSUBMESH
+    {
+        uint32_t tex_name_length;           // followed by the name, padded to alignment
+        uint32_t num_uv_channels;
+        float    bbox[6];
+    };
+
+    struct ANMBHEADER                       // blobs follow in the same layout as in .mshb
+    {
+        char     magic[4];                  // "ANMB"
+        uint32_t version;
+        uint32_t num_frames;
+        uint32_t num_bones;
+        float    frame_rate;
+        uint32_t reserved[3];
+    };
+
+    struct MSHBBLOB                         // followed by count * elem_size bytes, padded to alignment
+    {
+        uint64_t count;
+        uint32_t elem_size;
+        uint32_t reserved;
+    };
+    #pragma pack(pop)
+
+    const char     MSHB_MAGIC[4] = {'M', 'S', 'H', 'B'};
+    const uint32_t MSHB_VERSION = 1;
+    const size_t   MSHB_ALIGNMENT = 16;
+
+    static_assert(sizeof(MSHBHEADER) % MSHB_ALIGNMENT == 0, "MSHB header must keep blobs aligned");
+    static_assert(sizeof(MSHBSUBMESH) % MSHB_ALIGNMENT == 0, "MSHB submesh header must keep blobs aligned");
+    static_assert(sizeof(MSHBBLOB) % MSHB_ALIGNMENT == 0, "MSHB blob header must keep blobs aligned");
+    static_assert(sizeof(glm::vec3) == 12 && sizeof(glm::vec2) == 8, "MSHB stores tightly packed vectors");
+    static_assert(sizeof(std::pair<uint32_t, uint32_t>) == 8, "MSHB stores weight ranges as two uint32");
+
+    inline size_t AlignUp(size_t v)
+    {
+        return (v + MSHB_ALIGNMENT - 1) & ~(MSHB_ALIGNMENT - 1);
+    }
+
+    void WritePadding(std::ofstream & ofs, size_t written)
+    {
+        const char zeros[MSHB_ALIGNMENT] = {};
+        ofs.write(zeros, AlignUp(written) - written);
+    }
+
+    template<typename T>
+    void WriteBlob(std::ofstream & ofs, const DataArray<T> & arr)
+    {
+        MSHBBLOB blob;
+        blob.count = arr.size();
+        blob.elem_size = sizeof(T);
+        blob.reserved = 0;
+        ofs.write(reinterpret_cast<const char *>(&blob), sizeof(blob));
+        ofs.write(reinterpret_cast<const char *>(arr.data()), arr.size() * sizeof(T));
+        WritePadding(ofs, arr.size() * sizeof(T));
+    }
+
+    // Points arr at the next blob inside the mapping without copying it
+    template<typename T>
+    bool ReadBlob(const std::shared_ptr<const MappedFile> & file, size_t & offset, DataArray<T> & arr)
+    {
+        if(file->Size() < sizeof(MSHBBLOB) || offset > file->Size() - sizeof(MSHBBLOB))
+            return false;
+
+        MSHBBLOB blob;
+        std::memcpy(&blob, file->Data() + offset, sizeof(blob));
+        offset += sizeof(MSHBBLOB);
+
+        if(blob.elem_size != sizeof(T) || blob.count > (file->Size() - offset) / sizeof(T))
+            return false;
+
+        arr = DataArray<T>(reinterpret_cast<const T *>(file->Data() + offset), blob.count, file);
+        offset += AlignUp(blob.count * sizeof(T));
+        return true;
+    }
+
+    const char     ANMB_MAGIC[4] = {'A', 'N', 'M', 'B'};
+    const uint32_t ANMB_VERSION = 1;
+
+    // maps a smallest-three component from [-1/sqrt(2), 1/sqrt(2)] to [-0.5, 0.5]
+    const float    QUAT_RANGE_SCALE = 0.70710678f;
+
+    static_assert(sizeof(ANMBHEADER) % MSHB_ALIGNMENT == 0, "ANMB header must keep blobs aligned");
+    static_assert(sizeof(glm::quat) == 16, "ANMB stores rotations as four floats");
+
+    // how often loaders report progress and check for cancellation
+    const uint32_t MONITOR_LINES = 16384;
+    const size_t   MONITOR_BYTES = 1 << 20;
+
+    uint64_t FileLength(std::ifstream & in)
+    {
+        in.seekg(0, std::ios_base::end);
+        auto length = in.tellg();
+        in.seekg(0, std::ios_base::beg);
+        return length > 0 ? static_cast<uint64_t>(length) : 0;
+    }
+
+    // new[i] = old[order[i]]; arrays of another length (e.g. absent ones) stay as they are
+    template<typename T>
+    void Permute(DataArray<T> & arr, const std::vector<uint32_t> & order)
+    {
+        if(arr.size() != order.size())
+            return;
+
+        std::vector<T> permuted(order.size());
+        for(size_t i = 0; i < order.size(); i++)
+            permuted[i] = arr[order[i]];
+        arr = std::move(permuted);
+    }
+
+    inline void ParseToken(const char * p, const char * end, std::string & tok)
+    {
+        while(p < end && IsBlank(*p))
+            p++;
+        const char * tok_end = p;
+        while(tok_end < end && !IsBlank(*tok_end))
+            tok_end++;
+        tok.assign(p, tok_end);
+    }
+}
+
 Mesh::Mesh() : _modelMatrix(1.0f),
                _draw_bbox(false)
 {
@@ -21,7 +203,102 @@ Mesh::~Mesh()
 {
 }
 
-bool Mesh::LoadFromMsh(const char* fname)
+bool Mesh::LoadFromMsh(const char* fname, MshReader reader, LoadMonitor * monitor)
+{
+    bool res = false;
+    if(reader == MshReader::mr_binary)
+        res = LoadFromMshb(fname, monitor);
+    else if(reader == MshReader::mr_mapped)
+        res = LoadFromMshMapped(fname, monitor);
+    else if(reader == MshReader::mr_parallel)
+        res = LoadFromMshParallel(fname, monitor);
+    else
+        res = LoadFromMshStream(fname, monitor);
+
+    if(res)
+    {
+        UpdateBBox();
+        if(monitor)
+            monitor->Finish();
+    }
+
+    return res;
+}
+
+bool Mesh::SortVerticesByInfluence()
+{
+    bool sorted = false;
+    for(auto & msh : _meshes)
+    {
+        size_t num_vertices = msh._positions.size();
+        if(msh._wght_inds.size() != num_vertices)
+            continue;
+
+        auto count = [&msh](size_t n) { return msh._wght_inds[n].second - msh._wght_inds[n].first; };
+        bool grouped = true;
+        for(size_t n = 1; grouped && n < num_vertices; n++)
+            grouped = count(n - 1) <= count(n);
+        if(grouped)
+            continue;
+
+        std::vector<uint32_t> order(num_vertices);
+        for(uint32_t n = 0; n < num_vertices; n++)
+            order[n] = n;
+        std::stable_sort(order.begin(), order.end(), [&count](uint32_t a, uint32_t b)
+        {
+            return count(a) < count(b);
+        });
+
+        Permute(msh._positions, order);
+        Permute(msh._normals, order);
+        Permute(msh._tangents, order);
+        Permute(msh._bitangents, order);
+        for(auto & uvs : msh._uvs)
+            Permute(uvs, order);
+        Permute(msh._wght_inds, order);
+
+        std::vector<uint32_t> remap(num_vertices);
+        for(uint32_t n = 0; n < num_vertices; n++)
+            remap[order[n]] = n;
+
+        unsigned int * indices = msh._indices.MutableData();
+        for(size_t i = 0; i < msh._indices.size(); i++)
+        {
+            if(indices[i] < num_vertices)
+                indices[i] = remap[indices[i]];
+        }
+
+        sorted = true;
+    }
+
+    return sorted;
+}
+
+bool Mesh::IsMapped() const
+{
+    for(const auto & msh : _meshes)
+    {
+        bool mapped = msh._positions.isView() && msh._normals.isView() && msh._indices.isView()
+                      && (msh._wght_inds.empty() || msh._wght_inds.isView());
+        for(const auto & uvs : msh._uvs)
+            mapped = mapped && uvs.isView();
+        if(!mapped)
+            return false;
+    }
+    return !_meshes.empty();
+}
+
+void Mesh::UpdateBBox()
+{
+    AABB bbox;
+    for(auto & msh : _meshes)
+    {
+        bbox.expandBy(msh._base_bbox);
+    }
+    _base_bbox = bbox;
+}
+
+bool Mesh::LoadFromMshStream(const char* fname, LoadMonitor * monitor)
 {
     std::ifstream in(fname, std::ios::in);
     if(!in)
@@ -30,11 +307,25 @@ bool Mesh::LoadFromMsh(const char* fname)
         return false;
     }
     
+    if(monitor)
+        monitor->SetTotal(FileLength(in));
+
     std::string line;
     SubMesh* cur_mesh = nullptr;
     uint32_t num_wgts = 0;
+    uint32_t num_lines = 0;
+    uint64_t read_bytes = 0;
     while(std::getline(in, line))
     {
+        read_bytes += line.size() + 1;
+        if(monitor && ++num_lines % MONITOR_LINES == 0)
+        {
+            if(monitor->IsCancelled())
+                return false;
+            monitor->Advance(read_bytes);
+            read_bytes = 0;
+        }
+
         if(line.substr(0, 6) == "meshes")
         {
             uint32_t num_meshes;
@@ -162,17 +453,426 @@ bool Mesh::LoadFromMsh(const char* fname)
     }   
     in.close();
     
-    AABB bbox;
+    return true;
+}
+
+bool Mesh::LoadFromMshMapped(const char* fname, LoadMonitor * monitor)
+{
+    MappedFile file;
+    if(!file.Open(fname))
+        return false;
+
+    if(monitor)
+        monitor->SetTotal(file.Size());
+
+    SubMesh* cur_mesh = nullptr;
+    if(!ParseMshRange(_meshes, cur_mesh, file.Data(), file.End(), monitor))
+    {
+        if(monitor && monitor->IsCancelled())
+            return false;
+        std::cerr << "Malformed mesh file: " << fname << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool Mesh::LoadFromMshParallel(const char* fname, LoadMonitor * monitor)
+{
+    MappedFile file;
+    if(!file.Open(fname))
+        return false;
+
+    if(monitor)
+        monitor->SetTotal(file.Size());
+
+    // pre-scan for "mesh <i>" lines, each one starts an independent section
+    struct Section
+    {
+        const char * begin;
+        const char * end;
+        uint32_t     index;
+    };
+
+    std::vector<Section> sections;
+    bool simple_layout = true;
+    const char   marker[] = "\nmesh";
+    const char * begin = file.Data();
+    const char * end = file.End();
+    std::boyer_moore_horspool_searcher<const char *> searcher(marker, marker + sizeof(marker) - 1);
+    auto next_marker = [&](const char * from)
+    {
+        const char * found = std::search(from, end, searcher);
+        return found == end ? end : found + 1;
+    };
+
+    const char * cur = StartsWith(begin, end, "mesh") ? begin : next_marker(begin);
+    while(cur < end)
+    {
+        const char * line_end = static_cast<const char *>(std::memchr(cur, '\n', end - cur));
+        if(line_end == nullptr)
+            line_end = end;
+
+        if(StartsWith(cur, line_end, "meshes"))
+        {
+            // the submesh count may only be declared ahead of the sections
+            simple_layout = simple_layout && sections.empty();
+        }
+        else
+        {
+            const char * p = cur + 4;
+            if(!sections.empty())
+                sections.back().end = cur;
+            sections.push_back({cur, end, ParseNumber<uint32_t>(p, line_end)});
+        }
+
+        cur = next_marker(line_end);
+    }
+
+    const char * header_end = sections.empty() ? end : sections.front().begin;
+    SubMesh* cur_mesh = nullptr;
+    if(!ParseMshRange(_meshes, cur_mesh, begin, header_end, monitor))
+    {
+        std::cerr << "Malformed mesh file: " << fname << std::endl;
+        return false;
+    }
+
+    // every submesh may be written by one section only
+    std::vector<char> claimed(_meshes.size(), 0);
+    for(auto & sec : sections)
+    {
+        simple_layout = simple_layout && sec.index < claimed.size() && !claimed[sec.index];
+        if(sec.index < claimed.size())
+            claimed[sec.index] = 1;
+    }
+
+    if(!simple_layout)
+    {
+        if(!ParseMshRange(_meshes, cur_mesh, header_end, end, monitor))
+        {
+            std::cerr << "Malformed mesh file: " << fname << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    std::vector<char> parsed(sections.size(), 0);
+    ThreadPool::Global().ParallelFor(sections.size(), [&](uint32_t i)
+    {
+        SubMesh* sec_mesh = nullptr;
+        parsed[i] = ParseMshRange(_meshes, sec_mesh, sections[i].begin, sections[i].end, monitor);
+    });
+
+    if(std::find(parsed.begin(), parsed.end(), 0) != parsed.end())
+    {
+        if(monitor && monitor->IsCancelled())
+            return false;
+
+        std::cerr << "Malformed mesh file: " << fname << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool Mesh::ParseMshRange(std::vector<SubMesh> & meshes, SubMesh *& cur_mesh,
+                         const char * begin, const char * end, LoadMonitor * monitor)
+{
+    const char * cur = begin;
+    const char * reported = begin;
+    while(cur < end)
+    {
+        if(monitor && static_cast<size_t>(cur - reported) >= MONITOR_BYTES)
+        {
+            if(monitor->IsCancelled())
+                return false;
+            monitor->Advance(cur - reported);
+            reported = cur;
+        }
+
+        const char * line_end = static_cast<const char *>(std::memchr(cur, '\n', end - cur));
+        if(line_end == nullptr)
+            line_end = end;
+
+        const char * p = cur;
+        cur = line_end + 1;
+
+        if(!ParseMshLine(meshes, cur_mesh, p, line_end))
+            return false;
+    }
+
+    if(monitor)
+        monitor->Advance(end - reported);
+
+    return true;
+}
+
+bool Mesh::LoadFromMshb(const char* fname, LoadMonitor * monitor)
+{
+    auto file = std::make_shared<MappedFile>();
+    if(!file->Open(fname))
+        return false;
+
+    if(monitor)
+        monitor->SetTotal(file->Size());
+
+    MSHBHEADER header;
+    if(file->Size() < sizeof(header))
+    {
+        std::cerr << "Malformed mesh file: " << fname << std::endl;
+        return false;
+    }
+    std::memcpy(&header, file->Data(), sizeof(header));
+    if(std::memcmp(header.magic, MSHB_MAGIC, sizeof(MSHB_MAGIC)) != 0 || header.version != MSHB_VERSION)
+    {
+        std::cerr << "Unsupported mesh file: " << fname << std::endl;
+        return false;
+    }
+
+    std::shared_ptr<const MappedFile> backing = file;
+    size_t offset = sizeof(MSHBHEADER);
+    size_t reported = 0;
+    std::vector<SubMesh> meshes(header.num_meshes);
+    for(auto & msh : meshes)
+    {
+        // streams are views of the mapping, a submesh is the unit of work worth reporting
+        if(monitor)
+        {
+            if(monitor->IsCancelled())
+                return false;
+            monitor->Advance(offset - reported);
+            reported = offset;
+        }
+
+        MSHBSUBMESH sub_header;
+        if(offset > file->Size() || file->Size() - offset < sizeof(sub_header))
+        {
+            std::cerr << "Malformed mesh file: " << fname << std::endl;
+            return false;
+        }
+        std::memcpy(&sub_header, file->Data() + offset, sizeof(sub_header));
+        offset += sizeof(sub_header);
+
+        if(sub_header.tex_name_length > file->Size() - offset)
+        {
+            std::cerr << "Malformed mesh file: " << fname << std::endl;
+            return false;
+        }
+        msh._tex_name.assign(file->Data() + offset, sub_header.tex_name_length);
+        offset += AlignUp(sub_header.tex_name_length);
+
+        msh._base_bbox = AABB(sub_header.bbox[0], sub_header.bbox[1], sub_header.bbox[2],
+                              sub_header.bbox[3], sub_header.bbox[4], sub_header.bbox[5]);
+
+        msh._uvs.resize(sub_header.num_uv_channels);
+        bool ok = ReadBlob(backing, offset, msh._positions)
+               && ReadBlob(backing, offset, msh._normals)
+               && ReadBlob(backing, offset, msh._tangents)
+               && ReadBlob(backing, offset, msh._bitangents);
+        for(auto & uv : msh._uvs)
+            ok = ok && ReadBlob(backing, offset, uv);
+        ok = ok && ReadBlob(backing, offset, msh._wght_inds)
+                && ReadBlob(backing, offset, msh._weights)
+                && ReadBlob(backing, offset, msh._indices);
+
+        // per-vertex streams must agree, the renderer indexes them in lockstep
+        size_t num_vtx = msh._positions.size();
+        ok = ok && msh._normals.size() == num_vtx
+                && (msh._wght_inds.empty() || msh._wght_inds.size() == num_vtx);
+        for(auto & uv : msh._uvs)
+            ok = ok && uv.size() == num_vtx;
+
+        // skinning and the draw calls index through these unchecked
+        for(size_t i = 0; ok && i < msh._wght_inds.size(); i++)
+            ok = msh._wght_inds[i].first <= msh._wght_inds[i].second && msh._wght_inds[i].second <= msh._weights.size();
+        for(size_t i = 0; ok && i < msh._indices.size(); i++)
+            ok = msh._indices[i] < num_vtx;
+
+        if(!ok)
+        {
+            std::cerr << "Malformed mesh file: " << fname << std::endl;
+            return false;
+        }
+    }
+
+    _meshes = std::move(meshes);
+    return true;
+}
+
+bool Mesh::SaveToMshb(const char* fname) const
+{
+    std::ofstream ofs(fname, std::ios::out | std::ios::binary);
+    if(!ofs.is_open())
+    {
+        std::cerr << "Error opening file: " << fname << std::endl;
+        return false;
+    }
+
+    MSHBHEADER header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MSHB_MAGIC, sizeof(MSHB_MAGIC));
+    header.version = MSHB_VERSION;
+    header.num_meshes = _meshes.size();
+    glm::vec3 bb_min = _base_bbox.min();
+    glm::vec3 bb_max = _base_bbox.max();
+    float bbox[6] = {bb_min.x, bb_min.y, bb_min.z, bb_max.x, bb_max.y, bb_max.z};
+    std::memcpy(header.bbox, bbox, sizeof(bbox));
+    ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
     for(auto & msh : _meshes)
     {
-        bbox.expandBy(msh._base_bbox);
+        MSHBSUBMESH sub_header;
+        sub_header.tex_name_length = msh._tex_name.size();
+        sub_header.num_uv_channels = msh._uvs.size();
+        glm::vec3 mn = msh._base_bbox.min();
+        glm::vec3 mx = msh._base_bbox.max();
+        float bbox[6] = {mn.x, mn.y, mn.z, mx.x, mx.y, mx.z};
+        std::memcpy(sub_header.bbox, bbox, sizeof(bbox));
+        ofs.write(reinterpret_cast<const char *>(&sub_header), sizeof(sub_header));
+
+        ofs.write(msh._tex_name.data(), msh._tex_name.size());
+        WritePadding(ofs, msh._tex_name.size());
+
+        WriteBlob(ofs, msh._positions);
+        WriteBlob(ofs, msh._normals);
+        WriteBlob(ofs, msh._tangents);
+        WriteBlob(ofs, msh._bitangents);
+        for(auto & uv : msh._uvs)
+            WriteBlob(ofs, uv);
+        WriteBlob(ofs, msh._wght_inds);
+        WriteBlob(ofs, msh._weights);
+        WriteBlob(ofs, msh._indices);
     }
-    _base_bbox = bbox;
-    
+
+    if(!ofs)
+    {
+        std::cerr << "Error writing file: " << fname << std::endl;
+        return false;
+    }
+
     return true;
 }
 
-bool Mesh::LoadFromAnm(const char * fname)
+bool Mesh::ParseMshLine(std::vector<SubMesh> & meshes, SubMesh *& cur_mesh,
+                        const char * p, const char * end)
+{
+    if(p == end)
+        return true;
+
+    // keywords that share a first letter are tested in the same order as in LoadFromMshStream
+    switch(*p)
+    {
+        case 'm':
+            if(StartsWith(p, end, "meshes"))
+            {
+                meshes.resize(ParseNumber<uint32_t>(p += 6, end));
+            }
+            else if(StartsWith(p, end, "mesh"))
+            {
+                uint32_t num_mesh = ParseNumber<uint32_t>(p += 4, end);
+                if(num_mesh >= meshes.size())
+                    return false;
+
+                cur_mesh = &meshes[num_mesh];
+            }
+            else if(StartsWith(p, end, "material"))
+            {
+                if(cur_mesh == nullptr)
+                    return false;
+
+                ParseToken(p + 8, end, cur_mesh->_tex_name);
+            }
+            return true;
+        case 'w':
+            // "weights" carries only a count, vertices are sized by "wgi"
+            if(StartsWith(p, end, "weights"))
+                return true;
+
+            if(cur_mesh == nullptr)
+                return false;
+
+            if(StartsWith(p, end, "wgi"))
+            {
+                std::pair<uint32_t, uint32_t> wgh_ind;
+                wgh_ind.second = ParseNumber<uint32_t>(p += 3, end);
+                if(!cur_mesh->_wght_inds.empty())
+                    wgh_ind.first = cur_mesh->_wght_inds.back().second;
+                else
+                    wgh_ind.first = 0;
+
+                cur_mesh->_wght_inds.push_back(wgh_ind);
+            }
+            else if(StartsWith(p, end, "wgh"))
+            {
+                SubMesh::Weight w;
+                p += 3;
+                w.jnt_index = ParseNumber<uint32_t>(p, end);
+                w.w = ParseNumber<float>(p, end);
+                cur_mesh->_weights.push_back(w);
+            }
+            return true;
+        case 'b':
+            if(StartsWith(p, end, "bbox"))
+            {
+                if(cur_mesh == nullptr)
+                    return false;
+
+                glm::vec3 mn = ParseVec3(p += 4, end);
+                glm::vec3 mx = ParseVec3(p, end);
+                cur_mesh->_base_bbox = AABB(mn, mx);
+            }
+            return true;
+        case 'v':
+            if(cur_mesh == nullptr)
+                return false;
+
+            if(StartsWith(p, end, "vtx"))
+                cur_mesh->_positions.push_back(ParseVec3(p += 3, end));
+            else if(StartsWith(p, end, "vnr"))
+                cur_mesh->_normals.push_back(glm::normalize(ParseVec3(p += 3, end)));
+            else if(StartsWith(p, end, "vtg"))
+                cur_mesh->_tangents.push_back(glm::normalize(ParseVec3(p += 3, end)));
+            else if(StartsWith(p, end, "vbt"))
+                cur_mesh->_bitangents.push_back(glm::normalize(ParseVec3(p += 3, end)));
+            return true;
+        case 't':
+            if(cur_mesh == nullptr)
+                return false;
+
+            if(StartsWith(p, end, "tex_channels"))
+            {
+                cur_mesh->_uvs.resize(ParseNumber<uint32_t>(p += 12, end));
+            }
+            else if(StartsWith(p, end, "tx"))
+            {
+                p += 2;
+                uint32_t chn = ParseNumber<uint32_t>(p, end);
+                if(chn >= cur_mesh->_uvs.size())
+                    return false;
+
+                glm::vec2 v;
+                v.x = ParseNumber<float>(p, end);
+                v.y = ParseNumber<float>(p, end);
+                cur_mesh->_uvs[chn].push_back(v);
+            }
+            return true;
+        case 'f':
+            if(StartsWith(p, end, "fcx"))
+            {
+                if(cur_mesh == nullptr)
+                    return false;
+
+                p += 3;
+                for(int i = 0; i < 3; i++)
+                    cur_mesh->_indices.push_back(ParseNumber<uint32_t>(p, end));
+            }
+            return true;
+        default:
+            return true;
+    }
+}
+
+bool Mesh::LoadFromAnm(const char * fname, LoadMonitor * monitor)
 {
     std::ifstream in(fname, std::ios::in);
     if(!in)
@@ -181,29 +881,48 @@ bool Mesh::LoadFromAnm(const char * fname)
         return false;
     }
     
+    if(monitor)
+        monitor->SetTotal(FileLength(in));
+
+    uint32_t num_lines = 0;
+    uint64_t read_bytes = 0;
     std::string line;
-    AnimSequence::JointNode * cur_frame = nullptr;
     AnimSequence seq;
+    std::vector<glm::quat> rot;
+    std::vector<glm::vec3> trans;
+    std::vector<glm::vec3> bboxes;
+    uint32_t     cur_frame = 0;
     uint32_t     jnt_ind = 0;
-    uint32_t     num_bones = 0;
     while(std::getline(in, line))
     {
+        read_bytes += line.size() + 1;
+        if(monitor && ++num_lines % MONITOR_LINES == 0)
+        {
+            if(monitor->IsCancelled())
+                return false;
+            monitor->Advance(read_bytes);
+            read_bytes = 0;
+        }
+
         if(line.substr(0, 5) == "bones")
         {
             std::istringstream s(line.substr(5));
-            s >> num_bones;
+            s >> seq.numBones;
         }
         else if(line.substr(0, 6) == "frames")
         {
-            uint32_t num_frames;
             std::istringstream s(line.substr(6));
-            s >> num_frames;
+            s >> seq.numFrames;
             
-            seq.frames.resize(num_frames);
-            for(auto & jnt : seq.frames)
+            rot.resize(seq.numFrames * seq.numBones);
+            trans.resize(seq.numFrames * seq.numBones);
+
+            AABB empty_box;
+            bboxes.resize(seq.numFrames * 2);
+            for(uint32_t i = 0; i < seq.numFrames; i++)
             {
-                jnt.rot.resize(num_bones);
-                jnt.trans.resize(num_bones);
+                bboxes[i * 2 + 0] = empty_box.min();
+                bboxes[i * 2 + 1] = empty_box.max();
             }
         }
         else if(line.substr(0, 9) == "framerate")
@@ -216,12 +935,15 @@ bool Mesh::LoadFromAnm(const char * fname)
         }
         else if(line.substr(0, 5) == "frame")
         {
-            uint32_t frame;
             std::istringstream s(line.substr(5));
-            s >> frame;
-            
-            cur_frame = &seq.frames[frame];
+            s >> cur_frame;
             jnt_ind = 0;
+
+            if(cur_frame >= seq.numFrames)
+            {
+                std::cerr << "Malformed animation file: " << fname << std::endl;
+                return false;
+            }
         }
         else if(line.substr(0, 4) == "bbox")
         {
@@ -230,7 +952,11 @@ bool Mesh::LoadFromAnm(const char * fname)
             s >> mnx >> mny >> mnz;
             s >> mxx >> mxy >> mxz;
             
-            cur_frame->bbox = AABB(mnx, mny, mnz, mxx, mxy, mxz);
+            if(cur_frame < seq.numFrames)
+            {
+                bboxes[cur_frame * 2 + 0] = glm::vec3(mnx, mny, mnz);
+                bboxes[cur_frame * 2 + 1] = glm::vec3(mxx, mxy, mxz);
+            }
         }
         else if(line.substr(0, 3) == "jtr")
         {
@@ -240,36 +966,276 @@ bool Mesh::LoadFromAnm(const char * fname)
             s >> qtx >> qty >> qtz >> qtw;
             s >> tr_x >> tr_y >> tr_z;
             
-            cur_frame->rot[jnt_ind] = glm::quat(qtw, qtx, qty, qtz);
-            cur_frame->trans[jnt_ind] = glm::vec3(tr_x, tr_y, tr_z);
+            if(cur_frame >= seq.numFrames || jnt_ind >= seq.numBones)
+            {
+                std::cerr << "Malformed animation file: " << fname << std::endl;
+                return false;
+            }
+
+            rot[cur_frame * seq.numBones + jnt_ind] = glm::quat(qtw, qtx, qty, qtz);
+            trans[cur_frame * seq.numBones + jnt_ind] = glm::vec3(tr_x, tr_y, tr_z);
             jnt_ind++;
         }
     }
     
     in.close();
+    seq.rot = std::move(rot);
+    seq.trans = std::move(trans);
+    seq.bboxes = std::move(bboxes);
+
     _controller = Controller(Controller::RepeatType::RT_WRAP, 0.0,
-                             seq.frames.size()/seq.frameRate);
+                             seq.numFrames/seq.frameRate);
     _anims.push_back(std::move(seq));
+    if(monitor)
+        monitor->Finish();
     return true;
 }
 
-bool Mesh::LoadTexture(const char* fname)
+bool Mesh::LoadFromAnmb(const char * fname, LoadMonitor * monitor)
+{
+    auto file = std::make_shared<MappedFile>();
+    if(!file->Open(fname))
+        return false;
+
+    ANMBHEADER header;
+    if(file->Size() < sizeof(header))
+    {
+        std::cerr << "Malformed animation file: " << fname << std::endl;
+        return false;
+    }
+    std::memcpy(&header, file->Data(), sizeof(header));
+    if(std::memcmp(header.magic, ANMB_MAGIC, sizeof(ANMB_MAGIC)) != 0 || header.version != ANMB_VERSION)
+    {
+        std::cerr << "Unsupported animation file: " << fname << std::endl;
+        return false;
+    }
+
+    std::shared_ptr<const MappedFile> backing = file;
+    size_t offset = sizeof(ANMBHEADER);
+    AnimSequence seq;
+    seq.numFrames = header.num_frames;
+    seq.numBones = header.num_bones;
+    seq.frameRate = header.frame_rate;
+
+    bool ok = ReadBlob(backing, offset, seq.bboxes)
+           && ReadBlob(backing, offset, seq.rot)
+           && ReadBlob(backing, offset, seq.packedRot)
+           && ReadBlob(backing, offset, seq.trans)
+           && ReadBlob(backing, offset, seq.packedTrans)
+           && ReadBlob(backing, offset, seq.transRange);
+
+    // exactly one representation per channel, sized to the whole clip
+    size_t num_keys = static_cast<size_t>(seq.numFrames) * seq.numBones;
+    ok = ok && seq.frameRate > 0.0f
+            && seq.bboxes.size() == static_cast<size_t>(seq.numFrames) * 2
+            && (seq.rot.empty() != seq.packedRot.empty())
+            && (seq.rot.size() == num_keys || seq.packedRot.size() == num_keys)
+            && (seq.trans.empty() != seq.packedTrans.empty())
+            && (seq.trans.size() == num_keys || seq.packedTrans.size() == num_keys)
+            && (seq.packedTrans.empty() || seq.transRange.size() == static_cast<size_t>(seq.numBones) * 2);
+    if(!ok)
+    {
+        std::cerr << "Malformed animation file: " << fname << std::endl;
+        return false;
+    }
+
+    _controller = Controller(Controller::RepeatType::RT_WRAP, 0.0,
+                             seq.numFrames/seq.frameRate);
+    _anims.push_back(std::move(seq));
+    if(monitor)
+        monitor->Finish();
+    return true;
+}
+
+bool Mesh::SaveToAnmb(const char * fname, bool quantize) const
 {
-    std::string fn(fname);
-    if(fn.substr(fn.find_last_of(".") + 1) == "tga"
-       || fn.substr(fn.find_last_of(".") + 1) == "TGA")
+    if(_anims.empty())
+        return false;
+
+    const AnimSequence & seq = _anims[0];
+    std::ofstream ofs(fname, std::ios::out | std::ios::binary);
+    if(!ofs.is_open())
     {
-        return ReadTGA(fn, _texData);
+        std::cerr << "Error opening file: " << fname << std::endl;
+        return false;
     }
-    else if(fn.substr(fn.find_last_of(".") + 1) == "bmp"
-            || fn.substr(fn.find_last_of(".") + 1) == "BMP")
+
+    ANMBHEADER header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, ANMB_MAGIC, sizeof(ANMB_MAGIC));
+    header.version = ANMB_VERSION;
+    header.num_frames = seq.numFrames;
+    header.num_bones = seq.numBones;
+    header.frame_rate = seq.frameRate;
+    ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    std::vector<glm::quat>              rot;
+    std::vector<glm::vec3>              trans;
+    std::vector<AnimSequence::PackedQuat> packed_rot;
+    std::vector<AnimSequence::PackedVec3> packed_trans;
+    std::vector<glm::vec3>              trans_range;
+
+    size_t num_keys = static_cast<size_t>(seq.numFrames) * seq.numBones;
+    if(quantize)
     {
-        return ReadBMP(fn, _texData);
+        packed_rot.resize(num_keys);
+        packed_trans.resize(num_keys);
+        trans_range.resize(seq.numBones * 2);
+
+        for(uint32_t b = 0; b < seq.numBones; b++)
+        {
+            glm::vec3 mn(FLT_MAX), mx(-FLT_MAX);
+            for(uint32_t f = 0; f < seq.numFrames; f++)
+            {
+                glm::vec3 t = seq.GetTranslation(f, b);
+                mn = glm::min(mn, t);
+                mx = glm::max(mx, t);
+            }
+            if(seq.numFrames == 0)
+                mn = mx = glm::vec3(0.0f);
+
+            glm::vec3 step = (mx - mn) / 65535.0f;
+            trans_range[b * 2 + 0] = mn;
+            trans_range[b * 2 + 1] = step;
+
+            for(uint32_t f = 0; f < seq.numFrames; f++)
+            {
+                size_t ind = static_cast<size_t>(f) * seq.numBones + b;
+                glm::vec3 t = seq.GetTranslation(f, b);
+                for(int c = 0; c < 3; c++)
+                {
+                    float v = step[c] > 0.0f ? (t[c] - mn[c]) / step[c] : 0.0f;
+                    packed_trans[ind].c[c] = static_cast<uint16_t>(std::min(std::max(std::lround(v), 0l), 65535l));
+                }
+                packed_rot[ind] = AnimSequence::PackQuat(seq.GetRotation(f, b));
+            }
+        }
     }
     else
     {
+        rot.resize(num_keys);
+        trans.resize(num_keys);
+        for(uint32_t f = 0; f < seq.numFrames; f++)
+        {
+            for(uint32_t b = 0; b < seq.numBones; b++)
+            {
+                rot[static_cast<size_t>(f) * seq.numBones + b] = seq.GetRotation(f, b);
+                trans[static_cast<size_t>(f) * seq.numBones + b] = seq.GetTranslation(f, b);
+            }
+        }
+    }
+
+    WriteBlob(ofs, seq.bboxes);
+    WriteBlob(ofs, DataArray<glm::quat>(std::move(rot)));
+    WriteBlob(ofs, DataArray<AnimSequence::PackedQuat>(std::move(packed_rot)));
+    WriteBlob(ofs, DataArray<glm::vec3>(std::move(trans)));
+    WriteBlob(ofs, DataArray<AnimSequence::PackedVec3>(std::move(packed_trans)));
+    WriteBlob(ofs, DataArray<glm::vec3>(std::move(trans_range)));
+
+    if(!ofs)
+    {
+        std::cerr << "Error writing file: " << fname << std::endl;
         return false;
     }
+
+    return true;
+}
+
+glm::quat Mesh::AnimSequence::GetRotation(uint32_t frame, uint32_t bone) const
+{
+    size_t ind = static_cast<size_t>(frame) * numBones + bone;
+    return rot.empty() ? UnpackQuat(packedRot[ind]) : rot[ind];
+}
+
+glm::vec3 Mesh::AnimSequence::GetTranslation(uint32_t frame, uint32_t bone) const
+{
+    size_t ind = static_cast<size_t>(frame) * numBones + bone;
+    if(!trans.empty())
+        return trans[ind];
+
+    const PackedVec3 & pt = packedTrans[ind];
+    return transRange[bone * 2 + 0]
+           + transRange[bone * 2 + 1] * glm::vec3(pt.c[0], pt.c[1], pt.c[2]);
+}
+
+AABB Mesh::AnimSequence::GetBBox(uint32_t frame) const
+{
+    return AABB(bboxes[frame * 2 + 0], bboxes[frame * 2 + 1]);
+}
+
+void Mesh::AnimSequence::Sample(uint32_t prevFrame, uint32_t nextFrame, float delta, JointNode & pose) const
+{
+    pose.rot.resize(numBones);
+    pose.trans.resize(numBones);
+    for(uint32_t i = 0; i < numBones; i++)
+    {
+        pose.rot[i] = glm::normalize(glm::slerp(GetRotation(prevFrame, i),
+                                                GetRotation(nextFrame, i),
+                                                delta));
+        pose.trans[i] = glm::mix(GetTranslation(prevFrame, i),
+                                 GetTranslation(nextFrame, i),
+                                 delta);
+    }
+
+    pose.bbox = AABB(glm::mix(bboxes[prevFrame * 2 + 0], bboxes[nextFrame * 2 + 0], delta),
+                     glm::mix(bboxes[prevFrame * 2 + 1], bboxes[nextFrame * 2 + 1], delta));
+}
+
+Mesh::AnimSequence::PackedQuat Mesh::AnimSequence::PackQuat(glm::quat q)
+{
+    q = glm::normalize(q);
+
+    // q and -q are the same rotation, keep the dropped component positive
+    int largest = 0;
+    for(int i = 1; i < 4; i++)
+    {
+        if(std::abs(q[i]) > std::abs(q[largest]))
+            largest = i;
+    }
+    if(q[largest] < 0.0f)
+        q = -q;
+
+    // the three remaining components lie in [-1/sqrt(2), 1/sqrt(2)]
+    PackedQuat pq;
+    int n = 0;
+    for(int i = 0; i < 4; i++)
+    {
+        if(i == largest)
+            continue;
+
+        float v = glm::clamp(q[i] * QUAT_RANGE_SCALE + 0.5f, 0.0f, 1.0f);
+        pq.c[n++] = static_cast<uint16_t>(std::lround(v * 32767.0f));
+    }
+    pq.c[0] |= (largest >> 1) << 15;
+    pq.c[1] |= (largest & 1) << 15;
+
+    return pq;
+}
+
+glm::quat Mesh::AnimSequence::UnpackQuat(const PackedQuat & pq)
+{
+    int largest = ((pq.c[0] >> 15) << 1) | (pq.c[1] >> 15);
+
+    glm::quat q;
+    float sum = 0.0f;
+    int n = 0;
+    for(int i = 0; i < 4; i++)
+    {
+        if(i == largest)
+            continue;
+
+        float v = ((pq.c[n++] & 0x7FFF) / 32767.0f - 0.5f) / QUAT_RANGE_SCALE;
+        q[i] = v;
+        sum += v * v;
+    }
+    q[largest] = std::sqrt(std::max(0.0f, 1.0f - sum));
+
+    return q;
+}
+
+bool Mesh::LoadTexture(const char* fname)
+{
+    return ReadImage(fname, _texData);
 }
 
 void Mesh::RotateMesh(glm::vec3 euler_angles)
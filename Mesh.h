@@ -9,12 +9,17 @@
 #include <vector>
 #include <string>
 #include "AABB.h"
+#include "DataArray.h"
 #include "Controller.h"
 #include "ImageData.h"
+#include "LoadMonitor.h"
 
 class Mesh
 {
     friend class GL2Widget;
+    friend class AssetCache;
+    friend class SkinningEngine;
+    friend class SoftRasterizer;
 private:
     struct SubMesh
     {
@@ -24,16 +29,17 @@ private:
             float    w;
         };
         
+        // arrays are views into the mapped file when loaded from .mshb
         std::string                                _tex_name;
-        std::vector<glm::vec3>                     _positions;
-        std::vector<glm::vec3>                     _normals;
-        std::vector<glm::vec3>                     _tangents;
-        std::vector<glm::vec3>                     _bitangents;
-        std::vector<std::vector<glm::vec2>>        _uvs;
-        std::vector<std::pair<uint32_t, uint32_t>> _wght_inds;     // start and end indicies for vertex
-        std::vector<Weight>                        _weights;
+        DataArray<glm::vec3>                       _positions;
+        DataArray<glm::vec3>                       _normals;
+        DataArray<glm::vec3>                       _tangents;
+        DataArray<glm::vec3>                       _bitangents;
+        std::vector<DataArray<glm::vec2>>          _uvs;
+        DataArray<std::pair<uint32_t, uint32_t>>   _wght_inds;     // start and end indicies for vertex
+        DataArray<Weight>                          _weights;
         
-        std::vector<unsigned int> _indices;
+        DataArray<unsigned int> _indices;
         
         AABB          _base_bbox;
         
@@ -42,6 +48,7 @@ private:
 
     struct AnimSequence
     {
+        // sampled pose of the skeleton
         struct JointNode
         {
             AABB     bbox;
@@ -49,11 +56,45 @@ private:
             std::vector<glm::quat> rot;                 // absolute transform matrix for animation
             std::vector<glm::vec3> trans;
         };
-        
-        std::vector<JointNode> frames;
+
+        // smallest three: the largest component is dropped and rebuilt from
+        // the unit length, its index is kept in the top bits of c[0] and c[1]
+        struct PackedQuat
+        {
+            uint16_t c[3];
+        };
+
+        // position quantized to 16 bits per axis within the bone's range
+        struct PackedVec3
+        {
+            uint16_t c[3];
+        };
+
+        // Tracks are stored frame-major, element [frame * numBones + bone].
+        // Either the full precision or the packed pair is filled per channel,
+        // all of them are views into the mapped file when loaded from .anmb
+        DataArray<glm::quat>  rot;
+        DataArray<glm::vec3>  trans;
+        DataArray<PackedQuat> packedRot;
+        DataArray<PackedVec3> packedTrans;
+        DataArray<glm::vec3>  transRange;              // per bone: minimum and step of packedTrans
+        DataArray<glm::vec3>  bboxes;                  // per frame: min and max corner
+
+        uint32_t               numFrames;
+        uint32_t               numBones;
         float                  frameRate;
         
-        AnimSequence() : frameRate(0.0f) {}
+        AnimSequence() : numFrames(0), numBones(0), frameRate(0.0f) {}
+
+        glm::quat GetRotation(uint32_t frame, uint32_t bone) const;
+        glm::vec3 GetTranslation(uint32_t frame, uint32_t bone) const;
+        AABB      GetBBox(uint32_t frame) const;
+
+        //! Interpolate the pose between two frames into pose, reusing its storage
+        void Sample(uint32_t prevFrame, uint32_t nextFrame, float delta, JointNode & pose) const;
+
+        static PackedQuat PackQuat(glm::quat q);
+        static glm::quat  UnpackQuat(const PackedQuat & pq);
     };
 
     glm::mat4                 _modelMatrix;
@@ -66,7 +107,26 @@ private:
 
     Controller    _controller;
 
+    bool LoadFromMshStream(const char * fname, LoadMonitor * monitor);
+    bool LoadFromMshMapped(const char * fname, LoadMonitor * monitor);
+    bool LoadFromMshParallel(const char * fname, LoadMonitor * monitor);
+    bool LoadFromMshb(const char * fname, LoadMonitor * monitor);
+    static bool ParseMshRange(std::vector<SubMesh> & meshes, SubMesh *& cur_mesh,
+                              const char * begin, const char * end, LoadMonitor * monitor);
+    static bool ParseMshLine(std::vector<SubMesh> & meshes, SubMesh *& cur_mesh,
+                             const char * p, const char * end);
+    void UpdateBBox();
+
 public:
+    // Parser used for the text .msh format
+    enum class MshReader
+    {
+        mr_stream,              // std::getline + std::istringstream per line
+        mr_mapped,              // file mapped into memory and tokenized in place
+        mr_parallel,            // mapped, "mesh <i>" sections parsed on worker threads
+        mr_binary               // .mshb, arrays used straight from the mapped file
+    };
+
     Mesh();
     virtual ~Mesh();
     
@@ -76,9 +136,26 @@ public:
     Mesh(Mesh&& ms) = default;
     Mesh& operator=(Mesh&& ms) = default;
     
-    bool LoadFromMsh(const char * fname);
-    bool LoadFromAnm(const char * fname);
+    // monitor, when given, receives progress and can cancel the load from another thread
+    bool LoadFromMsh(const char * fname, MshReader reader = MshReader::mr_stream,
+                     LoadMonitor * monitor = nullptr);
+    bool SaveToMshb(const char * fname) const;
+    bool LoadFromAnm(const char * fname, LoadMonitor * monitor = nullptr);
+    bool LoadFromAnmb(const char * fname, LoadMonitor * monitor = nullptr);
+    bool SaveToAnmb(const char * fname, bool quantize) const;   // writes the current animation
     bool LoadTexture(const char * fname);
+
+    //! Group the vertices of every submesh by influence count, remapping the indices
+    /*!
+        Skinning handles each run of equal counts with a kernel specialized
+        for it. Stable, so vertices keep their relative order within a
+        count; returns false and leaves the arrays untouched when they are
+        already grouped, which keeps views into a mapped .mshb intact.
+    */
+    bool SortVerticesByInfluence();
+
+    //! True when every vertex and index array is a view of a mapped .mshb, none copied out of it
+    bool IsMapped() const;
     
     const glm::mat4& GetModelMatrix() const { return _modelMatrix; }
     void TranslateMesh(glm::vec3 translate);
@@ -0,0 +1,674 @@
+#include "SkinningEngine.h"
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <cmath>
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    const uint32_t ROW_FLOATS = 12;               // 3x4 joint matrix, row-major
+    const uint32_t MAX_PACKED_JOINTS = 256;       // joint indices are stored in 8 bits
+    const float    WEIGHT_ONE = 65535.0f;         // packed weights of a vertex sum to this
+    const float    WEIGHT_SCALE = 1.0f / WEIGHT_ONE;
+    const uint32_t STREAM_PADDING = 8;            // widest kernel
+    const uint32_t JOB_VERTICES = 4096;           // vertex range per job, multiple of STREAM_PADDING
+    const uint32_t MIN_PARALLEL_VERTICES = 16384;
+    const uint32_t MIN_BUCKET_VERTICES = 256;     // shorter influence runs go to the generic kernel
+
+    struct KernelArgs
+    {
+        const float *    rows;
+        const float *    px;
+        const float *    py;
+        const float *    pz;
+        const float *    nx;
+        const float *    ny;
+        const float *    nz;
+        const uint8_t *  joints;
+        const uint16_t * weights;
+        uint32_t         slots;
+        uint32_t         stride;
+        glm::vec3 *      positions;
+        glm::vec3 *      normals;                 // null when the submesh has none
+    };
+
+    // lanes are computed as SoA, output stays AoS for the GL buffers
+    inline void StoreLanes(const float * x, const float * y, const float * z, uint32_t count, glm::vec3 * out)
+    {
+        for(uint32_t l = 0; l < count; l++)
+            out[l] = glm::vec3(x[l], y[l], z[l]);
+    }
+
+    // Kernels are instantiated per influence count N so the slot loop is
+    // unrolled; N == 0 is the generic one reading the count from the
+    // arguments. A single influence always weighs exactly one, so rigid
+    // vertices copy their joint's rows instead of blending.
+    typedef void (*Kernel)(const KernelArgs & a, uint32_t begin, uint32_t end);
+
+    template<uint32_t N>
+    void SkinScalar(const KernelArgs & a, uint32_t begin, uint32_t end)
+    {
+        const uint32_t slots = N > 0 ? N : a.slots;
+        for(uint32_t v = begin; v < end; v++)
+        {
+            float m[ROW_FLOATS];
+            if(N == 1)
+            {
+                std::copy(a.rows + a.joints[v] * ROW_FLOATS, a.rows + (a.joints[v] + 1) * ROW_FLOATS, m);
+            }
+            else
+            {
+                std::fill(m, m + ROW_FLOATS, 0.0f);
+                for(uint32_t s = 0; s < slots; s++)
+                {
+                    float         w = a.weights[s * a.stride + v] * WEIGHT_SCALE;
+                    const float * row = a.rows + a.joints[s * a.stride + v] * ROW_FLOATS;
+                    for(uint32_t e = 0; e < ROW_FLOATS; e++)
+                        m[e] += w * row[e];
+                }
+            }
+
+            a.positions[v] = glm::vec3(m[0] * a.px[v] + m[1] * a.py[v] + m[2] * a.pz[v] + m[3],
+                                       m[4] * a.px[v] + m[5] * a.py[v] + m[6] * a.pz[v] + m[7],
+                                       m[8] * a.px[v] + m[9] * a.py[v] + m[10] * a.pz[v] + m[11]);
+            if(a.normals)
+                a.normals[v] = glm::vec3(m[0] * a.nx[v] + m[1] * a.ny[v] + m[2] * a.nz[v],
+                                         m[4] * a.nx[v] + m[5] * a.ny[v] + m[6] * a.nz[v],
+                                         m[8] * a.nx[v] + m[9] * a.ny[v] + m[10] * a.nz[v]);
+        }
+    }
+
+#ifdef CPU_X86
+    template<uint32_t N>
+    CPU_TARGET("sse4.1")
+    void SkinSSE41(const KernelArgs & a, uint32_t begin, uint32_t end)
+    {
+        const uint32_t slots = N > 0 ? N : a.slots;
+        alignas(16) float x[4], y[4], z[4];
+        for(uint32_t v = begin; v < end; v += 4)
+        {
+            __m128 m[ROW_FLOATS];
+            for(uint32_t e = 0; e < ROW_FLOATS; e++)
+                m[e] = _mm_setzero_ps();
+
+            for(uint32_t s = 0; s < slots; s++)
+            {
+                const uint8_t * jnt = a.joints + s * a.stride + v;
+                __m128i packed = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(a.weights + s * a.stride + v));
+                __m128 w = _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu16_epi32(packed)), _mm_set1_ps(WEIGHT_SCALE));
+                for(uint32_t r = 0; r < 3; r++)
+                {
+                    // one matrix row per lane, transposed into one element per register
+                    __m128 e0 = _mm_loadu_ps(a.rows + jnt[0] * ROW_FLOATS + r * 4);
+                    __m128 e1 = _mm_loadu_ps(a.rows + jnt[1] * ROW_FLOATS + r * 4);
+                    __m128 e2 = _mm_loadu_ps(a.rows + jnt[2] * ROW_FLOATS + r * 4);
+                    __m128 e3 = _mm_loadu_ps(a.rows + jnt[3] * ROW_FLOATS + r * 4);
+                    _MM_TRANSPOSE4_PS(e0, e1, e2, e3);
+                    if(N == 1)
+                    {
+                        m[r * 4 + 0] = e0;
+                        m[r * 4 + 1] = e1;
+                        m[r * 4 + 2] = e2;
+                        m[r * 4 + 3] = e3;
+                    }
+                    else
+                    {
+                        m[r * 4 + 0] = _mm_add_ps(m[r * 4 + 0], _mm_mul_ps(w, e0));
+                        m[r * 4 + 1] = _mm_add_ps(m[r * 4 + 1], _mm_mul_ps(w, e1));
+                        m[r * 4 + 2] = _mm_add_ps(m[r * 4 + 2], _mm_mul_ps(w, e2));
+                        m[r * 4 + 3] = _mm_add_ps(m[r * 4 + 3], _mm_mul_ps(w, e3));
+                    }
+                }
+            }
+
+            uint32_t count = std::min(4u, end - v);
+            __m128 px = _mm_loadu_ps(a.px + v);
+            __m128 py = _mm_loadu_ps(a.py + v);
+            __m128 pz = _mm_loadu_ps(a.pz + v);
+            for(uint32_t r = 0; r < 3; r++)
+            {
+                __m128 res = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[r * 4 + 0], px), _mm_mul_ps(m[r * 4 + 1], py)),
+                                        _mm_add_ps(_mm_mul_ps(m[r * 4 + 2], pz), m[r * 4 + 3]));
+                _mm_store_ps(r == 0 ? x : r == 1 ? y : z, res);
+            }
+            StoreLanes(x, y, z, count, a.positions + v);
+
+            if(!a.normals)
+                continue;
+
+            __m128 nx = _mm_loadu_ps(a.nx + v);
+            __m128 ny = _mm_loadu_ps(a.ny + v);
+            __m128 nz = _mm_loadu_ps(a.nz + v);
+            for(uint32_t r = 0; r < 3; r++)
+            {
+                __m128 res = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[r * 4 + 0], nx), _mm_mul_ps(m[r * 4 + 1], ny)),
+                                        _mm_mul_ps(m[r * 4 + 2], nz));
+                _mm_store_ps(r == 0 ? x : r == 1 ? y : z, res);
+            }
+            StoreLanes(x, y, z, count, a.normals + v);
+        }
+    }
+
+    CPU_TARGET("avx2,fma")
+    inline __m256 LoadRowPair(const float * rows, uint32_t lo, uint32_t hi)
+    {
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(rows + lo * ROW_FLOATS)),
+                                    _mm_loadu_ps(rows + hi * ROW_FLOATS), 1);
+    }
+
+    template<uint32_t N>
+    CPU_TARGET("avx2,fma")
+    void SkinAVX2(const KernelArgs & a, uint32_t begin, uint32_t end)
+    {
+        const uint32_t slots = N > 0 ? N : a.slots;
+        alignas(32) float x[8], y[8], z[8];
+        for(uint32_t v = begin; v < end; v += 8)
+        {
+            __m256 m[ROW_FLOATS];
+            for(uint32_t e = 0; e < ROW_FLOATS; e++)
+                m[e] = _mm256_setzero_ps();
+
+            for(uint32_t s = 0; s < slots; s++)
+            {
+                const uint8_t * off = a.joints + s * a.stride + v;
+                __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a.weights + s * a.stride + v));
+                __m256 w = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(packed)),
+                                         _mm256_set1_ps(WEIGHT_SCALE));
+                for(uint32_t r = 0; r < 3; r++)
+                {
+                    // rows of lanes l and l + 4 share a register and are transposed
+                    // per 128-bit half, cheaper than twelve gathers on most cores
+                    __m256 v0 = LoadRowPair(a.rows + r * 4, off[0], off[4]);
+                    __m256 v1 = LoadRowPair(a.rows + r * 4, off[1], off[5]);
+                    __m256 v2 = LoadRowPair(a.rows + r * 4, off[2], off[6]);
+                    __m256 v3 = LoadRowPair(a.rows + r * 4, off[3], off[7]);
+                    __m256 t0 = _mm256_unpacklo_ps(v0, v1);
+                    __m256 t1 = _mm256_unpackhi_ps(v0, v1);
+                    __m256 t2 = _mm256_unpacklo_ps(v2, v3);
+                    __m256 t3 = _mm256_unpackhi_ps(v2, v3);
+                    __m256 e0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+                    __m256 e1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+                    __m256 e2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+                    __m256 e3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+                    if(N == 1)
+                    {
+                        m[r * 4 + 0] = e0;
+                        m[r * 4 + 1] = e1;
+                        m[r * 4 + 2] = e2;
+                        m[r * 4 + 3] = e3;
+                    }
+                    else
+                    {
+                        m[r * 4 + 0] = _mm256_fmadd_ps(w, e0, m[r * 4 + 0]);
+                        m[r * 4 + 1] = _mm256_fmadd_ps(w, e1, m[r * 4 + 1]);
+                        m[r * 4 + 2] = _mm256_fmadd_ps(w, e2, m[r * 4 + 2]);
+                        m[r * 4 + 3] = _mm256_fmadd_ps(w, e3, m[r * 4 + 3]);
+                    }
+                }
+            }
+
+            uint32_t count = std::min(8u, end - v);
+            __m256 px = _mm256_loadu_ps(a.px + v);
+            __m256 py = _mm256_loadu_ps(a.py + v);
+            __m256 pz = _mm256_loadu_ps(a.pz + v);
+            for(uint32_t r = 0; r < 3; r++)
+            {
+                __m256 res = _mm256_fmadd_ps(m[r * 4 + 0], px,
+                             _mm256_fmadd_ps(m[r * 4 + 1], py,
+                             _mm256_fmadd_ps(m[r * 4 + 2], pz, m[r * 4 + 3])));
+                _mm256_store_ps(r == 0 ? x : r == 1 ? y : z, res);
+            }
+            StoreLanes(x, y, z, count, a.positions + v);
+
+            if(!a.normals)
+                continue;
+
+            __m256 nx = _mm256_loadu_ps(a.nx + v);
+            __m256 ny = _mm256_loadu_ps(a.ny + v);
+            __m256 nz = _mm256_loadu_ps(a.nz + v);
+            for(uint32_t r = 0; r < 3; r++)
+            {
+                __m256 res = _mm256_fmadd_ps(m[r * 4 + 0], nx,
+                             _mm256_fmadd_ps(m[r * 4 + 1], ny,
+                             _mm256_mul_ps(m[r * 4 + 2], nz)));
+                _mm256_store_ps(r == 0 ? x : r == 1 ? y : z, res);
+            }
+            StoreLanes(x, y, z, count, a.normals + v);
+        }
+    }
+#endif
+
+    // indexed by influence count, 0 for the generic kernel
+    const Kernel SCALAR_KERNELS[] = {SkinScalar<0>, SkinScalar<1>, SkinScalar<2>, SkinScalar<3>, SkinScalar<4>};
+#ifdef CPU_X86
+    const Kernel SSE41_KERNELS[] = {SkinSSE41<0>, SkinSSE41<1>, SkinSSE41<2>, SkinSSE41<3>, SkinSSE41<4>};
+    const Kernel AVX2_KERNELS[] = {SkinAVX2<0>, SkinAVX2<1>, SkinAVX2<2>, SkinAVX2<3>, SkinAVX2<4>};
+#endif
+}
+
+SkinningEngine::SkinningEngine() : _mesh(nullptr),
+                                   _isa(BestIsa()),
+                                   _pool(new ThreadPool()),
+                                   _minParallelVertices(MIN_PARALLEL_VERTICES),
+                                   _maxInfluences(MAX_INFLUENCES),
+                                   _numVertices(0)
+{
+}
+
+void SkinningEngine::SetNumThreads(unsigned int num_threads)
+{
+    _pool.reset(new ThreadPool(num_threads));
+}
+
+void SkinningEngine::SetMaxInfluences(uint32_t max_influences)
+{
+    _maxInfluences = std::max(1u, std::min(max_influences, MAX_INFLUENCES));
+}
+
+void SkinningEngine::Bind(const Mesh & msh)
+{
+    _mesh = &msh;
+    _outputs.resize(msh._meshes.size());
+    _jobs.clear();
+    _numVertices = 0;
+    _packStats = PackStats();
+
+    for(size_t i = 0; i < msh._meshes.size(); i++)
+    {
+        const auto & sub_msh = msh._meshes[i];
+        Output & out = _outputs[i];
+        out.positions.assign(sub_msh._positions.begin(), sub_msh._positions.end());
+        out.normals.assign(sub_msh._normals.begin(), sub_msh._normals.end());
+        SetTarget(static_cast<uint32_t>(i), nullptr, nullptr);
+
+        // validate once here so the per-frame loop can index without checks
+        bool valid = sub_msh._wght_inds.size() == sub_msh._positions.size()
+                     && (sub_msh._normals.empty() || sub_msh._normals.size() == sub_msh._positions.size());
+        uint32_t num_joints = 0;
+        for(size_t n = 0; valid && n < sub_msh._wght_inds.size(); n++)
+        {
+            auto range = sub_msh._wght_inds[n];
+            valid = range.first <= range.second && range.second <= sub_msh._weights.size();
+        }
+        for(size_t j = 0; valid && j < sub_msh._weights.size(); j++)
+        {
+            valid = sub_msh._weights[j].jnt_index > 0;
+            num_joints = std::max(num_joints, sub_msh._weights[j].jnt_index);
+        }
+
+        out.numJoints = valid ? num_joints : 0;
+        out.packed = out.numJoints > 0 && out.numJoints <= MAX_PACKED_JOINTS;
+
+        Streams & st = out.streams;
+        uint32_t  num_vertices = static_cast<uint32_t>(sub_msh._positions.size());
+        uint32_t  num_influences = 0;
+        for(size_t n = 0; out.numJoints > 0 && n < num_vertices; n++)
+            num_influences = std::max(num_influences, sub_msh._wght_inds[n].second - sub_msh._wght_inds[n].first);
+        st.slots = out.packed ? std::min(num_influences, _maxInfluences) : 0;
+        st.stride = num_vertices + STREAM_PADDING;
+
+        for(auto * stream : {&st.px, &st.py, &st.pz, &st.nx, &st.ny, &st.nz})
+            stream->assign(out.packed ? st.stride : 0, 0.0f);
+        st.joints.assign(static_cast<size_t>(st.slots) * st.stride, 0);
+        st.weights.assign(static_cast<size_t>(st.slots) * st.stride, 0);
+        if(out.numJoints == 0)
+            continue;
+
+        _numVertices += num_vertices;
+
+        uint64_t source_bytes = sub_msh._wght_inds.size() * sizeof(sub_msh._wght_inds[0])
+                                + sub_msh._weights.size() * sizeof(sub_msh._weights[0]);
+        _packStats.sourceBytes += source_bytes;
+        if(!out.packed)
+        {
+            // too many joints for 8-bit indices, skinned from the source layout
+            _packStats.packedBytes += source_bytes;
+            AddJobs(static_cast<uint32_t>(i), 0, num_vertices, 0);
+            continue;
+        }
+        _packStats.packedBytes += static_cast<uint64_t>(num_vertices) * st.slots * (sizeof(uint8_t) + sizeof(uint16_t));
+
+        for(uint32_t n = 0; n < num_vertices; n++)
+        {
+            st.px[n] = sub_msh._positions[n].x;
+            st.py[n] = sub_msh._positions[n].y;
+            st.pz[n] = sub_msh._positions[n].z;
+            if(!sub_msh._normals.empty())
+            {
+                st.nx[n] = sub_msh._normals[n].x;
+                st.ny[n] = sub_msh._normals[n].y;
+                st.nz[n] = sub_msh._normals[n].z;
+            }
+
+            auto range = sub_msh._wght_inds[n];
+            if(range.second - range.first > st.slots)
+                _packStats.prunedVertices++;
+            _packStats.maxWeightError = std::max(_packStats.maxWeightError, PackVertex(sub_msh, n, st));
+        }
+
+        // Runs of vertices with the same influence count get the kernel for
+        // that count; runs too short to pay off are merged and blended by the
+        // generic one. Meshes sorted by Mesh::SortVerticesByInfluence() have
+        // a single run per count.
+        auto kept = [&](uint32_t n)
+        {
+            return std::min(sub_msh._wght_inds[n].second - sub_msh._wght_inds[n].first, st.slots);
+        };
+
+        std::vector<Job> buckets;
+        for(uint32_t begin = 0, end = 0; begin < num_vertices; begin = end)
+        {
+            uint32_t influences = kept(begin);
+            for(end = begin + 1; end < num_vertices && kept(end) == influences; end++)
+                ;
+            if(end - begin < MIN_BUCKET_VERTICES)
+                influences = 0;
+
+            if(influences == 0 && !buckets.empty() && buckets.back().influences == 0)
+                buckets.back().end = end;
+            else
+                buckets.push_back({static_cast<uint32_t>(i), begin, end, influences});
+        }
+
+        for(const Job & bucket : buckets)
+        {
+            _packStats.bucketVertices[bucket.influences] += bucket.end - bucket.begin;
+            AddJobs(bucket.sub, bucket.begin, bucket.end, bucket.influences);
+        }
+    }
+}
+
+void SkinningEngine::AddJobs(uint32_t sub, uint32_t begin, uint32_t end, uint32_t influences)
+{
+    for(uint32_t b = begin; b < end; b += JOB_VERTICES)
+        _jobs.push_back({sub, b, std::min(b + JOB_VERTICES, end), influences});
+}
+
+float SkinningEngine::PackVertex(const Mesh::SubMesh & sub_msh, uint32_t vertex, Streams & st)
+{
+    // insertion sort into the slots, strongest first; weaker influences are pruned
+    uint32_t joints[MAX_INFLUENCES] = {};
+    float    weights[MAX_INFLUENCES] = {};
+    uint32_t kept = 0;
+    float    error = 0.0f;
+
+    auto range = sub_msh._wght_inds[vertex];
+    for(uint32_t j = range.first; j < range.second; j++)
+    {
+        const auto & wg = sub_msh._weights[j];
+        float w = std::max(0.0f, wg.w);
+        error += w - wg.w;
+
+        uint32_t slot = kept;
+        while(slot > 0 && weights[slot - 1] < w)
+            slot--;
+        if(slot == st.slots)
+        {
+            error += w;
+            continue;
+        }
+
+        if(kept == st.slots)
+            error += weights[kept - 1];
+        else
+            kept++;
+        for(uint32_t k = kept - 1; k > slot; k--)
+        {
+            joints[k] = joints[k - 1];
+            weights[k] = weights[k - 1];
+        }
+        joints[slot] = wg.jnt_index - 1;
+        weights[slot] = w;
+    }
+
+    // renormalize to a fixed sum; the rounding residue goes to the strongest influence
+    float sum = 0.0f;
+    for(uint32_t k = 0; k < kept; k++)
+        sum += weights[k];
+
+    uint16_t quantized[MAX_INFLUENCES] = {};
+    if(sum > 0.0f)
+    {
+        int total = 0;
+        for(uint32_t k = 0; k < kept; k++)
+        {
+            quantized[k] = static_cast<uint16_t>(std::lround(weights[k] / sum * WEIGHT_ONE));
+            total += quantized[k];
+        }
+        quantized[0] = static_cast<uint16_t>(quantized[0] + static_cast<int>(WEIGHT_ONE) - total);
+    }
+
+    for(uint32_t k = 0; k < kept; k++)
+    {
+        error += std::abs(quantized[k] * WEIGHT_SCALE - weights[k]);
+        st.joints[k * st.stride + vertex] = static_cast<uint8_t>(joints[k]);
+        st.weights[k * st.stride + vertex] = quantized[k];
+    }
+
+    return error;
+}
+
+void SkinningEngine::SetTarget(uint32_t submesh, glm::vec3 * positions, glm::vec3 * normals)
+{
+    Output & out = _outputs[submesh];
+    out.dstPositions = positions ? positions : out.positions.data();
+    out.dstNormals = out.normals.empty() ? nullptr : normals ? normals : out.normals.data();
+}
+
+void SkinningEngine::Unbind()
+{
+    _mesh = nullptr;
+    _outputs.clear();
+    _jobs.clear();
+    _numVertices = 0;
+}
+
+bool SkinningEngine::Update(uint32_t prev_frame, uint32_t next_frame, float delta)
+{
+    if(!UpdatePalette(prev_frame, next_frame, delta))
+        return false;
+
+    Skin();
+    return true;
+}
+
+bool SkinningEngine::UpdatePalette(uint32_t prev_frame, uint32_t next_frame, float delta)
+{
+    if(!_mesh || _mesh->_anims.empty())
+        return false;
+
+    _mesh->_anims[0].Sample(prev_frame, next_frame, delta, _pose);
+    BuildPalette();
+
+    return true;
+}
+
+bool SkinningEngine::Influences(uint32_t submesh, std::vector<glm::vec4> & joints,
+                                std::vector<glm::vec4> & weights) const
+{
+    if(!_mesh || submesh >= _outputs.size() || !_outputs[submesh].packed)
+        return false;
+
+    const Streams & st = _outputs[submesh].streams;
+    size_t num_vertices = _mesh->_meshes[submesh]._positions.size();
+    joints.assign(num_vertices, glm::vec4(0.0f));
+    weights.assign(num_vertices, glm::vec4(0.0f));
+
+    for(size_t n = 0; n < num_vertices; n++)
+    {
+        for(uint32_t s = 0; s < st.slots; s++)
+        {
+            joints[n][s] = st.joints[s * st.stride + n];
+            weights[n][s] = st.weights[s * st.stride + n] * WEIGHT_SCALE;
+        }
+    }
+
+    return true;
+}
+
+void SkinningEngine::BuildPalette()
+{
+    _palette.resize(_pose.rot.size());
+    BuildPalette(_pose.rot.data(), _pose.trans.data(), static_cast<uint32_t>(_pose.rot.size()),
+                 _palette.data());
+
+    // the last row is always (0, 0, 0, 1) and left out for the vector kernels
+    _rows.resize(_palette.size() * ROW_FLOATS);
+    for(size_t j = 0; j < _palette.size(); j++)
+    {
+        for(uint32_t r = 0; r < 3; r++)
+        {
+            for(uint32_t c = 0; c < 4; c++)
+                _rows[j * ROW_FLOATS + r * 4 + c] = _palette[j][c][r];
+        }
+    }
+}
+
+void SkinningEngine::SetIsa(Isa isa)
+{
+    _isa = IsSupported(isa) ? isa : BestIsa();
+}
+
+bool SkinningEngine::IsSupported(Isa isa)
+{
+    switch(isa)
+    {
+#ifdef CPU_X86
+        case Isa::isa_sse41:
+            return CpuFeatures::HasSSE41();
+        case Isa::isa_avx2:
+            return CpuFeatures::HasAVX2();
+#endif
+        case Isa::isa_scalar:
+            return true;
+        default:
+            return false;
+    }
+}
+
+SkinningEngine::Isa SkinningEngine::BestIsa()
+{
+    if(IsSupported(Isa::isa_avx2))
+        return Isa::isa_avx2;
+    if(IsSupported(Isa::isa_sse41))
+        return Isa::isa_sse41;
+    return Isa::isa_scalar;
+}
+
+const char * SkinningEngine::IsaName(Isa isa)
+{
+    switch(isa)
+    {
+        case Isa::isa_sse41:
+            return "sse4.1";
+        case Isa::isa_avx2:
+            return "avx2";
+        default:
+            return "scalar";
+    }
+}
+
+void SkinningEngine::BuildPalette(const glm::quat * rot, const glm::vec3 * trans, uint32_t num_joints,
+                                  glm::mat4 * palette)
+{
+    for(uint32_t i = 0; i < num_joints; i++)
+    {
+        palette[i] = glm::mat4_cast(rot[i]);
+        palette[i][3] = glm::vec4(trans[i], 1.0f);
+    }
+}
+
+void SkinningEngine::Skin()
+{
+    if(!_mesh)
+        return;
+
+    bool skinnable = false;
+    for(uint32_t i = 0; i < _outputs.size(); i++)
+    {
+        Output & out = _outputs[i];
+        if(out.numJoints > 0 && out.numJoints <= _palette.size())
+        {
+            skinnable = true;
+            continue;
+        }
+
+        // weights do not fit this skeleton, show the bind pose
+        const auto & sub_msh = _mesh->_meshes[i];
+        std::copy(sub_msh._positions.begin(), sub_msh._positions.end(), out.dstPositions);
+        if(out.dstNormals)
+            std::copy(sub_msh._normals.begin(), sub_msh._normals.end(), out.dstNormals);
+    }
+
+    if(!skinnable)
+        return;
+
+    auto run_job = [this](uint32_t j)
+    {
+        const Job & job = _jobs[j];
+        uint32_t num_joints = _outputs[job.sub].numJoints;
+        if(num_joints > 0 && num_joints <= _palette.size())
+            SkinRange(job);
+    };
+
+    if(_numVertices < _minParallelVertices || _pool->NumThreads() == 1)
+    {
+        for(uint32_t j = 0; j < _jobs.size(); j++)
+            run_job(j);
+    }
+    else
+    {
+        _pool->ParallelFor(static_cast<uint32_t>(_jobs.size()), run_job);
+    }
+}
+
+void SkinningEngine::SkinRange(const Job & job)
+{
+    Output & out = _outputs[job.sub];
+    if(!out.packed)
+    {
+        SkinRangeSource(job.sub, job.begin, job.end);
+        return;
+    }
+
+    const Streams & st = out.streams;
+    KernelArgs args{_rows.data(), st.px.data(), st.py.data(), st.pz.data(),
+                    st.nx.data(), st.ny.data(), st.nz.data(), st.joints.data(), st.weights.data(),
+                    st.slots, st.stride, out.dstPositions, out.dstNormals};
+
+    const Kernel * kernels = SCALAR_KERNELS;
+#ifdef CPU_X86
+    if(_isa == Isa::isa_avx2)
+        kernels = AVX2_KERNELS;
+    else if(_isa == Isa::isa_sse41)
+        kernels = SSE41_KERNELS;
+#endif
+
+    kernels[job.influences](args, job.begin, job.end);
+}
+
+void SkinningEngine::SkinRangeSource(uint32_t sub, uint32_t begin, uint32_t end)
+{
+    const auto &      sub_msh = _mesh->_meshes[sub];
+    Output &          out = _outputs[sub];
+    const glm::mat4 * palette = _palette.data();
+    bool              has_normals = out.dstNormals != nullptr;
+
+    for(uint32_t n = begin; n < end; n++)
+    {
+        auto range = sub_msh._wght_inds[n];
+        glm::mat4 mat(0.0f);
+        for(uint32_t j = range.first; j < range.second; j++)
+        {
+            const auto & wg = sub_msh._weights[j];
+            mat += wg.w * palette[wg.jnt_index - 1];
+        }
+
+        out.dstPositions[n] = glm::vec3(mat * glm::vec4(sub_msh._positions[n], 1.0f));
+        if(has_normals)
+            out.dstNormals[n] = glm::mat3(mat) * sub_msh._normals[n];
+    }
+}
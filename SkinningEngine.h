@@ -0,0 +1,187 @@
+#ifndef SKINNINGENGINE_H
+#define SKINNINGENGINE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "AABB.h"
+#include "Mesh.h"
+#include "ThreadPool.h"
+
+//! CPU linear blend skinning of a Mesh, independent of GL
+/*!
+    Every frame the sampled pose is turned into a palette holding one
+    matrix per joint, then each vertex blends the palette entries named by
+    its weights. Output buffers are sized by Bind(), so Update() does not
+    allocate once the first frame has been skinned.
+
+    Bind() converts the variable-length weight lists into a fixed-width
+    layout: up to four influences per vertex with 8-bit joint indices and
+    16-bit weights, the weakest beyond that pruned and the rest
+    renormalized. GetPackStats() reports the size and the largest weight
+    error this caused. Skeletons too large for 8-bit indices keep the
+    source layout.
+
+    Besides the scalar loop there are SSE4.1 and AVX2 kernels skinning
+    4 and 8 vertices at once from structure of arrays copies of the
+    submeshes; the best one the CPU supports is picked at run time. Each
+    is specialized per influence count and applied to runs of vertices
+    sharing that count, so rigid vertices are transformed without
+    blending. Mesh::SortVerticesByInfluence() turns a submesh into one
+    run per count.
+
+    Submeshes are cut into vertex ranges at bind time and the ranges are
+    skinned on the engine's own thread pool, each writing straight into
+    its part of the output. Meshes below a vertex threshold are skinned
+    inline on the calling thread, where waking the workers costs more
+    than it saves.
+*/
+class SkinningEngine
+{
+public:
+    enum class Isa
+    {
+        isa_scalar,
+        isa_sse41,
+        isa_avx2
+    };
+
+    static constexpr uint32_t MAX_INFLUENCES = 4;
+
+    //! Skin data conversion done by the last Bind()
+    struct PackStats
+    {
+        uint64_t sourceBytes;            // weight lists and ranges of the mesh
+        uint64_t packedBytes;
+        uint32_t prunedVertices;         // vertices that lost influences
+        float    maxWeightError;         // largest sum of absolute weight changes of a vertex
+        uint32_t bucketVertices[MAX_INFLUENCES + 1];    // by kernel influence count, [0] generic
+
+        PackStats() : sourceBytes(0), packedBytes(0), prunedVertices(0), maxWeightError(0.0f),
+                      bucketVertices{} {}
+    };
+
+    SkinningEngine();
+
+    //! Size the output for msh, which must outlive the binding; rebind after it changes
+    void Bind(const Mesh & msh);
+    void Unbind();
+    bool IsBound() const { return _mesh != nullptr; }
+
+    //! Sample the current animation of the bound mesh and skin all submeshes
+    bool Update(uint32_t prev_frame, uint32_t next_frame, float delta);
+
+    //! Sample and build the palette only, for skinning done elsewhere (GPU)
+    bool UpdatePalette(uint32_t prev_frame, uint32_t next_frame, float delta);
+
+    // Individual steps of Update()
+    void BuildPalette();
+    void Skin();
+
+    //! Influences kept per vertex, 1 to MAX_INFLUENCES; applies from the next Bind()
+    void     SetMaxInfluences(uint32_t max_influences);
+    uint32_t MaxInfluences() const { return _maxInfluences; }
+
+    const PackStats & GetPackStats() const { return _packStats; }
+
+    //! Kernel used by Skin(), falls back to the best supported one
+    void SetIsa(Isa isa);
+    Isa  GetIsa() const { return _isa; }
+
+    //! Threads skinning one frame, the caller included; 0 picks one per core
+    void         SetNumThreads(unsigned int num_threads);
+    unsigned int NumThreads() const { return _pool->NumThreads(); }
+
+    //! Meshes with fewer vertices in total are skinned on the calling thread
+    void         SetMinParallelVertices(uint32_t num_vertices) { _minParallelVertices = num_vertices; }
+
+    static bool        IsSupported(Isa isa);
+    static Isa         BestIsa();
+    static const char* IsaName(Isa isa);
+
+    const AABB &                   BBox() const { return _pose.bbox; }
+    const std::vector<glm::mat4> & Palette() const { return _palette; }
+    const std::vector<float> &     PaletteRows() const { return _rows; }   // 3 rows of 4 floats per joint
+
+    uint32_t                       NumSubMeshes() const { return static_cast<uint32_t>(_outputs.size()); }
+    const std::vector<glm::vec3> & Positions(uint32_t submesh) const { return _outputs[submesh].positions; }
+    const std::vector<glm::vec3> & Normals(uint32_t submesh) const { return _outputs[submesh].normals; }
+
+    //! Skin a submesh into caller memory, e.g. a mapped GL buffer, instead of Positions()/Normals()
+    /*!
+        The target must hold as many vertices as the submesh and stays in
+        use until it is replaced; null restores the engine's own buffers.
+        Normals are only written when the submesh has them.
+    */
+    void SetTarget(uint32_t submesh, glm::vec3 * positions, glm::vec3 * normals);
+
+    //! Highest joint referenced by a submesh, 0 if it can not be skinned
+    uint32_t                       NumJoints(uint32_t submesh) const { return _outputs[submesh].numJoints; }
+
+    //! Packed influences as vertex attributes: 0-based joints and weights, unused slots 0
+    bool Influences(uint32_t submesh, std::vector<glm::vec4> & joints, std::vector<glm::vec4> & weights) const;
+
+    //! Joint transform: rotation with the translation in the last column
+    static void BuildPalette(const glm::quat * rot, const glm::vec3 * trans, uint32_t num_joints,
+                             glm::mat4 * palette);
+
+private:
+    // Structure of arrays copy of a submesh for the skinning loops. Every
+    // vertex gets the same number of weight slots, unused ones weigh 0, and
+    // the arrays are padded so a kernel may load a full register past the end
+    struct Streams
+    {
+        uint32_t              slots;             // at most MAX_INFLUENCES
+        uint32_t              stride;            // elements per slot, vertex count plus padding
+        std::vector<float>    px, py, pz;
+        std::vector<float>    nx, ny, nz;
+        std::vector<uint8_t>  joints;            // [slot * stride + vertex]: 0-based joint
+        std::vector<uint16_t> weights;           // [slot * stride + vertex]: slots of a vertex sum to 65535
+    };
+
+    struct Output
+    {
+        uint32_t               numJoints;        // highest joint referenced, 0 if not skinnable
+        bool                   packed;           // streams filled, otherwise skinned from the source layout
+        Streams                streams;
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec3> normals;
+        glm::vec3 *            dstPositions;     // where Skin() writes, positions or a SetTarget() one
+        glm::vec3 *            dstNormals;       // null without normals
+    };
+
+    struct Job
+    {
+        uint32_t sub;
+        uint32_t begin;
+        uint32_t end;
+        uint32_t influences;             // kernel specialization, 0 for the generic one
+    };
+
+    // split [begin, end) of submesh sub into jobs for the thread pool
+    void AddJobs(uint32_t sub, uint32_t begin, uint32_t end, uint32_t influences);
+
+    // skin the vertices of a job into its output
+    void SkinRange(const Job & job);
+    void SkinRangeSource(uint32_t sub, uint32_t begin, uint32_t end);
+
+    // prune, renormalize and quantize the weights of one vertex into st, returns the weight error
+    static float PackVertex(const Mesh::SubMesh & sub_msh, uint32_t vertex, Streams & st);
+
+    const Mesh *                  _mesh;
+    Isa                           _isa;
+    std::unique_ptr<ThreadPool>   _pool;
+    uint32_t                      _minParallelVertices;
+    uint32_t                      _maxInfluences;
+    PackStats                     _packStats;
+    uint32_t                      _numVertices;      // in all skinnable submeshes
+    std::vector<Job>              _jobs;
+    Mesh::AnimSequence::JointNode _pose;
+    std::vector<glm::mat4>        _palette;
+    std::vector<float>            _rows;             // top three palette rows, 12 floats per joint
+    std::vector<Output>           _outputs;
+};
+
+#endif // SKINNINGENGINE_H
@@ -0,0 +1,1043 @@
+#include "SoftRasterizer.h"
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+// SSE2 is part of x86-64, its kernel needs no run-time check
+#if defined(CPU_X86) && (defined(__SSE2__) || defined(_M_X64))
+    #define RASTER_SSE2 1
+#endif
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const int32_t  SUBPIXEL_BITS = 4;
+    const int32_t  SUBPIXELS = 1 << SUBPIXEL_BITS;      // vertex positions snap to 1/16 pixel
+    const int32_t  HALF_PIXEL = SUBPIXELS / 2;
+    const float    GUARD_BAND = 4.0f;                   // NDC range kept by clipping, 1.5 images past each side
+    const uint32_t MAX_CLIP_VERTICES = 9;               // a triangle clipped by 6 planes
+    const uint32_t VERTEX_BLOCK = 4096;
+    const uint32_t CHUNK_TRIANGLES = 4096;
+
+    // The fixed-function state of the viewer: light 0 at (5, 1, 5, 0) in eye
+    // space, the default material with a specular highlight, global ambient
+    const glm::vec3 LIGHT_DIR = glm::normalize(glm::vec3(5.0f, 1.0f, 5.0f));
+    const glm::vec3 HALF_VECTOR = glm::normalize(LIGHT_DIR + glm::vec3(0.0f, 0.0f, 1.0f));
+    const float     SCENE_AMBIENT = 0.2f * 0.2f;        // light model ambient times material ambient
+    const float     MATERIAL_DIFFUSE = 0.8f;
+    const float     SHININESS = 50.0f;
+
+    typedef SoftRasterizer::Triangle Triangle;
+    typedef SoftRasterizer::Texture  Texture;
+
+    // Edge functions at the first pixel of a triangle's part of a tile and
+    // their steps per pixel; an edge the whole part is inside reads 0
+    struct TileEdges
+    {
+        int32_t e[3];
+        int32_t dx[3];
+        int32_t dy[3];
+    };
+
+    struct TileTarget
+    {
+        uint32_t * color;
+        float *    depth;
+        uint32_t   stride;
+    };
+
+    inline int32_t FloorDiv(int32_t a, int32_t b)
+    {
+        return a >= 0 ? a / b : -((-a + b - 1) / b);
+    }
+
+    // max / min operand order as MAXPS / MINPS take it, a NaN gives the
+    // second operand, so the scalar and SIMD kernels clamp alike
+    inline float MaxPs(float a, float b) { return a > b ? a : b; }
+    inline float MinPs(float a, float b) { return a < b ? a : b; }
+
+    CPU_INLINE uint32_t PackColor(float r, float g, float b, float a)
+    {
+        auto channel = [](float c) { return static_cast<uint32_t>(MinPs(MaxPs(c, 0.0f), 255.0f) + 0.5f); };
+        return channel(r) | channel(g) << 8 | channel(b) << 16 | channel(a) << 24;
+    }
+
+    CPU_INLINE float PlaneAt(const Triangle & t, int plane, float fx, float fy)
+    {
+        return t.planes[plane][0] + t.planes[plane][1] * fx + t.planes[plane][2] * fy;
+    }
+
+    // texture coordinates are clamped first, which keeps the floors within 32-bit integers
+    const float UV_LIMIT = 1048576.0f;
+
+    // bilinear, wrapping like GL_REPEAT; channels 0 to 255
+    CPU_INLINE void Sample(const Texture & tex, float u, float v, float rgb[3])
+    {
+        u = MinPs(MaxPs(u, -UV_LIMIT), UV_LIMIT);
+        v = MinPs(MaxPs(v, -UV_LIMIT), UV_LIMIT);
+        float x = (u - std::floor(u)) * tex.width - 0.5f;
+        float y = (v - std::floor(v)) * tex.height - 0.5f;
+        float fx = std::floor(x);
+        float fy = std::floor(y);
+        float s = x - fx;
+        float t = y - fy;
+
+        int32_t x0 = static_cast<int32_t>(fx);
+        int32_t y0 = static_cast<int32_t>(fy);
+        x0 = x0 < 0 ? static_cast<int32_t>(tex.width) - 1 : std::min(x0, static_cast<int32_t>(tex.width) - 1);
+        y0 = y0 < 0 ? static_cast<int32_t>(tex.height) - 1 : std::min(y0, static_cast<int32_t>(tex.height) - 1);
+        uint32_t x1 = x0 + 1 == static_cast<int32_t>(tex.width) ? 0 : x0 + 1;
+        uint32_t y1 = y0 + 1 == static_cast<int32_t>(tex.height) ? 0 : y0 + 1;
+
+        uint32_t c00 = tex.texels[static_cast<size_t>(y0) * tex.width + x0];
+        uint32_t c10 = tex.texels[static_cast<size_t>(y0) * tex.width + x1];
+        uint32_t c01 = tex.texels[static_cast<size_t>(y1) * tex.width + x0];
+        uint32_t c11 = tex.texels[static_cast<size_t>(y1) * tex.width + x1];
+        for(int c = 0; c < 3; c++)
+        {
+            int   shift = c * 8;
+            float bottom = static_cast<float>((c00 >> shift) & 0xFF) * (1.0f - s)
+                           + static_cast<float>((c10 >> shift) & 0xFF) * s;
+            float top = static_cast<float>((c01 >> shift) & 0xFF) * (1.0f - s)
+                        + static_cast<float>((c11 >> shift) & 0xFF) * s;
+            rgb[c] = bottom * (1.0f - t) + top * t;
+        }
+    }
+
+    // lit colour modulated by the texture, as GL_MODULATE does; drawn pixels are opaque
+    CPU_INLINE uint32_t ShadePixel(const Triangle & t, float fx, float fy)
+    {
+        float w = 1.0f / PlaneAt(t, SoftRasterizer::pl_invw, fx, fy);
+        float texel[3] = {255.0f, 255.0f, 255.0f};
+        if(t.texture)
+            Sample(*t.texture, PlaneAt(t, SoftRasterizer::pl_u, fx, fy) * w,
+                   PlaneAt(t, SoftRasterizer::pl_v, fx, fy) * w, texel);
+
+        return PackColor(PlaneAt(t, SoftRasterizer::pl_r, fx, fy) * w * texel[0],
+                         PlaneAt(t, SoftRasterizer::pl_g, fx, fy) * w * texel[1],
+                         PlaneAt(t, SoftRasterizer::pl_b, fx, fy) * w * texel[2], 255.0f);
+    }
+
+    inline uint32_t CountBits(uint32_t mask)
+    {
+        uint32_t count = 0;
+        for(; mask; mask &= mask - 1)
+            count++;
+        return count;
+    }
+
+    // Kernels cover a triangle's part of a tile, pixels xs..xe of rows ys..ye,
+    // and return the pixels drawn. They make the same float operations in the
+    // same order as ShadePixel(), depth along a row as zrow + dz/dx * fx, so
+    // all of them draw the same image. The SIMD ones step through whole
+    // registers aligned to the image, which never straddle two tiles, and
+    // write them back blended with the covered lanes: the rows are padded for
+    // the registers past the last pixel
+    typedef uint32_t (*RasterKernel)(const Triangle & t, const TileEdges & e, int32_t xs, int32_t ys,
+                                     int32_t xe, int32_t ye, const TileTarget & dst);
+
+    uint32_t RasterScalar(const Triangle & t, const TileEdges & e, int32_t xs, int32_t ys, int32_t xe, int32_t ye,
+                          const TileTarget & dst)
+    {
+        uint32_t pixels = 0;
+        for(int32_t y = ys; y <= ye; y++)
+        {
+            int32_t e0 = e.e[0] + e.dy[0] * (y - ys);
+            int32_t e1 = e.e[1] + e.dy[1] * (y - ys);
+            int32_t e2 = e.e[2] + e.dy[2] * (y - ys);
+            float   fy = static_cast<float>(y) + 0.5f - t.y0;
+            float   zrow = t.planes[SoftRasterizer::pl_z][0] + t.planes[SoftRasterizer::pl_z][2] * fy;
+            float *    depth = dst.depth + static_cast<size_t>(y) * dst.stride;
+            uint32_t * color = dst.color + static_cast<size_t>(y) * dst.stride;
+            for(int32_t x = xs; x <= xe; x++, e0 += e.dx[0], e1 += e.dx[1], e2 += e.dx[2])
+            {
+                if((e0 | e1 | e2) < 0)
+                    continue;
+
+                float fx = static_cast<float>(x) + 0.5f - t.x0;
+                float z = zrow + t.planes[SoftRasterizer::pl_z][1] * fx;
+                if(!(z <= depth[x]))
+                    continue;
+
+                depth[x] = z;
+                color[x] = ShadePixel(t, fx, fy);
+                pixels++;
+            }
+        }
+        return pixels;
+    }
+
+#ifdef RASTER_SSE2
+    inline __m128 PlaneSSE2(const Triangle & t, int plane, __m128 fx, float fy)
+    {
+        return _mm_add_ps(_mm_add_ps(_mm_set1_ps(t.planes[plane][0]), _mm_mul_ps(_mm_set1_ps(t.planes[plane][1]), fx)),
+                          _mm_set1_ps(t.planes[plane][2] * fy));
+    }
+
+    inline __m128 FloorSSE2(__m128 x)
+    {
+        // truncation rounds negative fractions up, take one off where it did
+        __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+        return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, x), _mm_set1_ps(1.0f)));
+    }
+
+    // texel coordinate and its neighbour of 4 lanes, wrapped into [0, size)
+    inline void WrapSSE2(__m128 coord, uint32_t size, __m128i & c0, __m128i & c1, __m128 & frac)
+    {
+        __m128 x = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(coord, FloorSSE2(coord)), _mm_set1_ps(static_cast<float>(size))),
+                              _mm_set1_ps(0.5f));
+        __m128 fx = FloorSSE2(x);
+        frac = _mm_sub_ps(x, fx);
+
+        __m128i last = _mm_set1_epi32(static_cast<int32_t>(size) - 1);
+        __m128i i = _mm_cvttps_epi32(fx);
+        __m128i clamp = _mm_or_si128(_mm_cmplt_epi32(i, _mm_setzero_si128()), _mm_cmpgt_epi32(i, last));
+        c0 = _mm_or_si128(_mm_andnot_si128(clamp, i), _mm_and_si128(clamp, last));
+        c1 = _mm_andnot_si128(_mm_cmpeq_epi32(c0, last), _mm_add_epi32(c0, _mm_set1_epi32(1)));
+    }
+
+    inline __m128 ChannelSSE2(__m128i texels, int shift)
+    {
+        return _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(texels, shift), _mm_set1_epi32(0xFF)));
+    }
+
+    inline __m128i ShadeSSE2(const Triangle & t, __m128 fx, float fy)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 limit = _mm_set1_ps(255.0f);
+        const __m128 one = _mm_set1_ps(1.0f);
+
+        __m128 w = _mm_div_ps(one, PlaneSSE2(t, SoftRasterizer::pl_invw, fx, fy));
+        __m128 texel[3] = {limit, limit, limit};
+        if(t.texture)
+        {
+            const Texture & tex = *t.texture;
+            __m128 u = _mm_mul_ps(PlaneSSE2(t, SoftRasterizer::pl_u, fx, fy), w);
+            __m128 v = _mm_mul_ps(PlaneSSE2(t, SoftRasterizer::pl_v, fx, fy), w);
+            u = _mm_min_ps(_mm_max_ps(u, _mm_set1_ps(-UV_LIMIT)), _mm_set1_ps(UV_LIMIT));
+            v = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-UV_LIMIT)), _mm_set1_ps(UV_LIMIT));
+
+            __m128i x0, x1, y0, y1;
+            __m128  s, r;
+            WrapSSE2(u, tex.width, x0, x1, s);
+            WrapSSE2(v, tex.height, y0, y1, r);
+
+            // no gather before AVX2, the four texels of each lane are loaded one by one
+            alignas(16) int32_t xs0[4], xs1[4], ys0[4], ys1[4];
+            alignas(16) uint32_t c[4][4];
+            _mm_store_si128(reinterpret_cast<__m128i *>(xs0), x0);
+            _mm_store_si128(reinterpret_cast<__m128i *>(xs1), x1);
+            _mm_store_si128(reinterpret_cast<__m128i *>(ys0), y0);
+            _mm_store_si128(reinterpret_cast<__m128i *>(ys1), y1);
+            for(int i = 0; i < 4; i++)
+            {
+                const uint32_t * row0 = tex.texels.data() + static_cast<size_t>(ys0[i]) * tex.width;
+                const uint32_t * row1 = tex.texels.data() + static_cast<size_t>(ys1[i]) * tex.width;
+                c[0][i] = row0[xs0[i]];
+                c[1][i] = row0[xs1[i]];
+                c[2][i] = row1[xs0[i]];
+                c[3][i] = row1[xs1[i]];
+            }
+            __m128i c00 = _mm_load_si128(reinterpret_cast<const __m128i *>(c[0]));
+            __m128i c10 = _mm_load_si128(reinterpret_cast<const __m128i *>(c[1]));
+            __m128i c01 = _mm_load_si128(reinterpret_cast<const __m128i *>(c[2]));
+            __m128i c11 = _mm_load_si128(reinterpret_cast<const __m128i *>(c[3]));
+
+            __m128 s1 = _mm_sub_ps(one, s);
+            __m128 r1 = _mm_sub_ps(one, r);
+            for(int ch = 0; ch < 3; ch++)
+            {
+                __m128 bottom = _mm_add_ps(_mm_mul_ps(ChannelSSE2(c00, ch * 8), s1),
+                                           _mm_mul_ps(ChannelSSE2(c10, ch * 8), s));
+                __m128 top = _mm_add_ps(_mm_mul_ps(ChannelSSE2(c01, ch * 8), s1),
+                                        _mm_mul_ps(ChannelSSE2(c11, ch * 8), s));
+                texel[ch] = _mm_add_ps(_mm_mul_ps(bottom, r1), _mm_mul_ps(top, r));
+            }
+        }
+
+        __m128i packed = _mm_set1_epi32(static_cast<int32_t>(0xFF000000u));
+        for(int ch = 0; ch < 3; ch++)
+        {
+            __m128 value = _mm_mul_ps(_mm_mul_ps(PlaneSSE2(t, SoftRasterizer::pl_r + ch, fx, fy), w), texel[ch]);
+            value = _mm_add_ps(_mm_min_ps(_mm_max_ps(value, zero), limit), _mm_set1_ps(0.5f));
+            packed = _mm_or_si128(packed, _mm_slli_epi32(_mm_cvttps_epi32(value), ch * 8));
+        }
+        return packed;
+    }
+
+    uint32_t RasterSSE2(const Triangle & t, const TileEdges & e, int32_t xs, int32_t ys, int32_t xe, int32_t ye,
+                        const TileTarget & dst)
+    {
+        const __m128i lane = _mm_setr_epi32(0, 1, 2, 3);
+        const __m128i bits = _mm_setr_epi32(1, 2, 4, 8);
+        const __m128  half = _mm_set1_ps(0.5f);
+        const __m128  x0 = _mm_set1_ps(t.x0);
+        const __m128  zdx = _mm_set1_ps(t.planes[SoftRasterizer::pl_z][1]);
+        const int32_t xa = xs & ~3;
+        __m128i step[3];
+        __m128i step4[3];
+        for(int k = 0; k < 3; k++)
+        {
+            step[k] = _mm_setr_epi32(0, e.dx[k], 2 * e.dx[k], 3 * e.dx[k]);
+            step4[k] = _mm_set1_epi32(4 * e.dx[k]);
+        }
+
+        uint32_t pixels = 0;
+        for(int32_t y = ys; y <= ye; y++)
+        {
+            __m128i ev[3];
+            for(int k = 0; k < 3; k++)
+                ev[k] = _mm_add_epi32(_mm_set1_epi32(e.e[k] + e.dy[k] * (y - ys) - e.dx[k] * (xs - xa)), step[k]);
+            float      fy = static_cast<float>(y) + 0.5f - t.y0;
+            __m128     zrow = _mm_set1_ps(t.planes[SoftRasterizer::pl_z][0] + t.planes[SoftRasterizer::pl_z][2] * fy);
+            float *    depth = dst.depth + static_cast<size_t>(y) * dst.stride;
+            uint32_t * color = dst.color + static_cast<size_t>(y) * dst.stride;
+            for(int32_t x = xa; x <= xe; x += 4)
+            {
+                // inside every edge where no sign bit is set, lanes outside xs..xe masked off
+                __m128i outside = _mm_or_si128(_mm_or_si128(ev[0], ev[1]), ev[2]);
+                int     lanes = (0xF << std::max(xs - x, 0)) & (0xF >> std::max(x + 3 - xe, 0));
+                int     covered = ~_mm_movemask_ps(_mm_castsi128_ps(outside)) & lanes;
+                for(int k = 0; k < 3; k++)
+                    ev[k] = _mm_add_epi32(ev[k], step4[k]);
+                if(!covered)
+                    continue;
+
+                __m128 fx = _mm_sub_ps(_mm_add_ps(_mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(x), lane)), half), x0);
+                __m128 z = _mm_add_ps(zrow, _mm_mul_ps(zdx, fx));
+                __m128 old_z = _mm_loadu_ps(depth + x);
+                int    visible = covered & _mm_movemask_ps(_mm_cmple_ps(z, old_z));
+                if(!visible)
+                    continue;
+
+                __m128i mask = _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(visible), bits), bits);
+                __m128i old_color = _mm_loadu_si128(reinterpret_cast<const __m128i *>(color + x));
+                __m128i new_color = ShadeSSE2(t, fx, fy);
+                _mm_storeu_ps(depth + x, _mm_or_ps(_mm_and_ps(_mm_castsi128_ps(mask), z),
+                                                   _mm_andnot_ps(_mm_castsi128_ps(mask), old_z)));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(color + x),
+                                 _mm_or_si128(_mm_and_si128(mask, new_color), _mm_andnot_si128(mask, old_color)));
+                pixels += CountBits(static_cast<uint32_t>(visible));
+            }
+        }
+        return pixels;
+    }
+#endif
+
+#ifdef CPU_X86
+    CPU_TARGET("avx2")
+    inline __m256 PlaneAVX2(const Triangle & t, int plane, __m256 fx, float fy)
+    {
+        return _mm256_add_ps(_mm256_add_ps(_mm256_set1_ps(t.planes[plane][0]),
+                                           _mm256_mul_ps(_mm256_set1_ps(t.planes[plane][1]), fx)),
+                             _mm256_set1_ps(t.planes[plane][2] * fy));
+    }
+
+    CPU_TARGET("avx2")
+    inline void WrapAVX2(__m256 coord, uint32_t size, __m256i & c0, __m256i & c1, __m256 & frac)
+    {
+        __m256 x = _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(coord, _mm256_floor_ps(coord)),
+                                               _mm256_set1_ps(static_cast<float>(size))),
+                                 _mm256_set1_ps(0.5f));
+        __m256 fx = _mm256_floor_ps(x);
+        frac = _mm256_sub_ps(x, fx);
+
+        __m256i last = _mm256_set1_epi32(static_cast<int32_t>(size) - 1);
+        __m256i i = _mm256_cvttps_epi32(fx);
+        c0 = _mm256_blendv_epi8(_mm256_min_epi32(i, last), last, _mm256_cmpgt_epi32(_mm256_setzero_si256(), i));
+        c1 = _mm256_andnot_si256(_mm256_cmpeq_epi32(c0, last), _mm256_add_epi32(c0, _mm256_set1_epi32(1)));
+    }
+
+    CPU_TARGET("avx2")
+    inline __m256 ChannelAVX2(__m256i texels, int shift)
+    {
+        return _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(texels, shift), _mm256_set1_epi32(0xFF)));
+    }
+
+    CPU_TARGET("avx2")
+    inline __m256i ShadeAVX2(const Triangle & t, __m256 fx, float fy)
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 limit = _mm256_set1_ps(255.0f);
+        const __m256 one = _mm256_set1_ps(1.0f);
+
+        __m256 w = _mm256_div_ps(one, PlaneAVX2(t, SoftRasterizer::pl_invw, fx, fy));
+        __m256 texel[3] = {limit, limit, limit};
+        if(t.texture)
+        {
+            const Texture & tex = *t.texture;
+            __m256 u = _mm256_mul_ps(PlaneAVX2(t, SoftRasterizer::pl_u, fx, fy), w);
+            __m256 v = _mm256_mul_ps(PlaneAVX2(t, SoftRasterizer::pl_v, fx, fy), w);
+            u = _mm256_min_ps(_mm256_max_ps(u, _mm256_set1_ps(-UV_LIMIT)), _mm256_set1_ps(UV_LIMIT));
+            v = _mm256_min_ps(_mm256_max_ps(v, _mm256_set1_ps(-UV_LIMIT)), _mm256_set1_ps(UV_LIMIT));
+
+            __m256i x0, x1, y0, y1;
+            __m256  s, r;
+            WrapAVX2(u, tex.width, x0, x1, s);
+            WrapAVX2(v, tex.height, y0, y1, r);
+
+            // wrapped indices stay within the texture, LoadTexture() keeps them in 32 bits
+            const int * texels = reinterpret_cast<const int *>(tex.texels.data());
+            __m256i     stride = _mm256_set1_epi32(static_cast<int32_t>(tex.width));
+            __m256i     row0 = _mm256_mullo_epi32(y0, stride);
+            __m256i     row1 = _mm256_mullo_epi32(y1, stride);
+            __m256i     c00 = _mm256_i32gather_epi32(texels, _mm256_add_epi32(row0, x0), 4);
+            __m256i     c10 = _mm256_i32gather_epi32(texels, _mm256_add_epi32(row0, x1), 4);
+            __m256i     c01 = _mm256_i32gather_epi32(texels, _mm256_add_epi32(row1, x0), 4);
+            __m256i     c11 = _mm256_i32gather_epi32(texels, _mm256_add_epi32(row1, x1), 4);
+
+            __m256 s1 = _mm256_sub_ps(one, s);
+            __m256 r1 = _mm256_sub_ps(one, r);
+            for(int ch = 0; ch < 3; ch++)
+            {
+                __m256 bottom = _mm256_add_ps(_mm256_mul_ps(ChannelAVX2(c00, ch * 8), s1),
+                                              _mm256_mul_ps(ChannelAVX2(c10, ch * 8), s));
+                __m256 top = _mm256_add_ps(_mm256_mul_ps(ChannelAVX2(c01, ch * 8), s1),
+                                           _mm256_mul_ps(ChannelAVX2(c11, ch * 8), s));
+                texel[ch] = _mm256_add_ps(_mm256_mul_ps(bottom, r1), _mm256_mul_ps(top, r));
+            }
+        }
+
+        __m256i packed = _mm256_set1_epi32(static_cast<int32_t>(0xFF000000u));
+        for(int ch = 0; ch < 3; ch++)
+        {
+            __m256 value = _mm256_mul_ps(_mm256_mul_ps(PlaneAVX2(t, SoftRasterizer::pl_r + ch, fx, fy), w), texel[ch]);
+            value = _mm256_add_ps(_mm256_min_ps(_mm256_max_ps(value, zero), limit), _mm256_set1_ps(0.5f));
+            packed = _mm256_or_si256(packed, _mm256_slli_epi32(_mm256_cvttps_epi32(value), ch * 8));
+        }
+        return packed;
+    }
+
+    CPU_TARGET("avx2")
+    uint32_t RasterAVX2(const Triangle & t, const TileEdges & e, int32_t xs, int32_t ys, int32_t xe, int32_t ye,
+                        const TileTarget & dst)
+    {
+        const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        const __m256  half = _mm256_set1_ps(0.5f);
+        const __m256  x0 = _mm256_set1_ps(t.x0);
+        const __m256  zdx = _mm256_set1_ps(t.planes[SoftRasterizer::pl_z][1]);
+        const int32_t xa = xs & ~7;
+        __m256i step[3];
+        __m256i step8[3];
+        for(int k = 0; k < 3; k++)
+        {
+            step[k] = _mm256_mullo_epi32(_mm256_set1_epi32(e.dx[k]), lane);
+            step8[k] = _mm256_set1_epi32(8 * e.dx[k]);
+        }
+
+        uint32_t pixels = 0;
+        for(int32_t y = ys; y <= ye; y++)
+        {
+            __m256i ev[3];
+            for(int k = 0; k < 3; k++)
+                ev[k] = _mm256_add_epi32(_mm256_set1_epi32(e.e[k] + e.dy[k] * (y - ys) - e.dx[k] * (xs - xa)), step[k]);
+            float      fy = static_cast<float>(y) + 0.5f - t.y0;
+            __m256     zrow = _mm256_set1_ps(t.planes[SoftRasterizer::pl_z][0]
+                                             + t.planes[SoftRasterizer::pl_z][2] * fy);
+            float *    depth = dst.depth + static_cast<size_t>(y) * dst.stride;
+            uint32_t * color = dst.color + static_cast<size_t>(y) * dst.stride;
+            for(int32_t x = xa; x <= xe; x += 8)
+            {
+                __m256i outside = _mm256_or_si256(_mm256_or_si256(ev[0], ev[1]), ev[2]);
+                int     lanes = (0xFF << std::max(xs - x, 0)) & (0xFF >> std::max(x + 7 - xe, 0));
+                int     covered = ~_mm256_movemask_ps(_mm256_castsi256_ps(outside)) & lanes;
+                for(int k = 0; k < 3; k++)
+                    ev[k] = _mm256_add_epi32(ev[k], step8[k]);
+                if(!covered)
+                    continue;
+
+                __m256 fx = _mm256_sub_ps(_mm256_add_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(x),
+                                                                                            lane)), half), x0);
+                __m256 z = _mm256_add_ps(zrow, _mm256_mul_ps(zdx, fx));
+                __m256 old_z = _mm256_loadu_ps(depth + x);
+                int    visible = covered & _mm256_movemask_ps(_mm256_cmp_ps(z, old_z, _CMP_LE_OQ));
+                if(!visible)
+                    continue;
+
+                __m256i mask = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(visible), bits), bits);
+                __m256i old_color = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(color + x));
+                __m256i new_color = ShadeAVX2(t, fx, fy);
+                _mm256_storeu_ps(depth + x, _mm256_blendv_ps(old_z, z, _mm256_castsi256_ps(mask)));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(color + x),
+                                    _mm256_blendv_epi8(old_color, new_color, mask));
+                pixels += CountBits(static_cast<uint32_t>(visible));
+            }
+        }
+        return pixels;
+    }
+#endif
+
+    RasterKernel PickKernel(SoftRasterizer::Isa isa)
+    {
+        switch(isa)
+        {
+#ifdef CPU_X86
+            case SoftRasterizer::Isa::isa_avx2:
+                return RasterAVX2;
+#endif
+#ifdef RASTER_SSE2
+            case SoftRasterizer::Isa::isa_sse2:
+                return RasterSSE2;
+#endif
+            default:
+                return RasterScalar;
+        }
+    }
+
+    // signed distance of a clip space position to plane p, negative outside;
+    // near, far, then the guard band left, right, bottom and top
+    inline float ClipDistance(int p, const glm::vec4 & c)
+    {
+        switch(p)
+        {
+            case 0:  return c.z + c.w;
+            case 1:  return c.w - c.z;
+            case 2:  return c.x + GUARD_BAND * c.w;
+            case 3:  return GUARD_BAND * c.w - c.x;
+            case 4:  return c.y + GUARD_BAND * c.w;
+            default: return GUARD_BAND * c.w - c.y;
+        }
+    }
+}
+
+SoftRasterizer::SoftRasterizer() : _isa(BestIsa()),
+                                   _pool(new ThreadPool()),
+                                   _width(0),
+                                   _height(0),
+                                   _tilesX(0),
+                                   _tilesY(0),
+                                   _stride(0),
+                                   _numChunks(0)
+{
+}
+
+bool SoftRasterizer::Resize(uint32_t width, uint32_t height)
+{
+    if(width == 0 || height == 0 || width > MAX_SIZE || height > MAX_SIZE)
+        return false;
+
+    _width = width;
+    _height = height;
+    _tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    _tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    _stride = (width + 7) / 8 * 8;
+    _color.assign(static_cast<size_t>(_stride) * height, 0);
+    _depth.assign(static_cast<size_t>(_stride) * height, 1.0f);
+    return true;
+}
+
+void SoftRasterizer::Clear(const glm::vec4 & color)
+{
+    std::fill(_color.begin(), _color.end(),
+              PackColor(color.x * 255.0f, color.y * 255.0f, color.z * 255.0f, color.w * 255.0f));
+    std::fill(_depth.begin(), _depth.end(), 1.0f);
+}
+
+bool SoftRasterizer::LoadMaterials(const Mesh & msh, const std::string & base_dir)
+{
+    _materials.clear();
+    _override = Texture();
+    if(msh._texData.Pixels())
+        LoadTexture(msh._texData, _override);
+
+    bool res = true;
+    for(const auto & sub_msh : msh._meshes)
+    {
+        const std::string & name = sub_msh._tex_name;
+        if(name.empty() || _materials.count(name) > 0)
+            continue;
+
+        fs::path p(name);
+        if(p.is_relative() && !base_dir.empty())
+            p = fs::path(base_dir) / p;
+
+        // a failed name keeps an empty texture, its submeshes are drawn untextured
+        ImageData id;
+        Texture & tex = _materials[name];
+        if(!ReadImage(p.string(), id) || !LoadTexture(id, tex))
+        {
+            std::cerr << "Fail to load texture " << p.string() << std::endl;
+            tex = Texture();
+            res = false;
+        }
+    }
+    return res;
+}
+
+bool SoftRasterizer::Draw(const Mesh & msh, const glm::mat4 & view, const glm::mat4 & proj, double time)
+{
+    _stats = Stats();
+    if(_width == 0 || msh._meshes.empty())
+        return false;
+
+    // the frame the viewer shows at this time
+    bool skinned = time >= 0.0 && !msh._anims.empty() && msh._anims[0].numFrames > 0;
+    if(skinned)
+    {
+        const Mesh::AnimSequence & anim = msh._anims[0];
+        double   frame_time = std::max(0.0, msh._controller.GetControlTime(time) * anim.frameRate);
+        uint32_t prev_frame = std::min(static_cast<uint32_t>(frame_time), anim.numFrames - 1);
+        uint32_t next_frame = prev_frame + 1 < anim.numFrames ? prev_frame + 1 : 0;
+        _skinning.Bind(msh);
+        skinned = _skinning.Update(prev_frame, next_frame, static_cast<float>(frame_time - prev_frame));
+    }
+
+    glm::mat4 mv = view * msh._modelMatrix;
+    glm::mat4 mvp = proj * mv;
+    glm::mat3 normal_matrix = glm::transpose(glm::inverse(glm::mat3(mv)));
+
+    _blocks.clear();
+    _vertexBase.assign(1, 0);
+    _subTextures.clear();
+    for(uint32_t i = 0; i < msh._meshes.size(); i++)
+    {
+        const auto & sub_msh = msh._meshes[i];
+        uint32_t     num_vertices = static_cast<uint32_t>(sub_msh._positions.size());
+        for(uint32_t begin = 0; begin < num_vertices; begin += VERTEX_BLOCK)
+            _blocks.push_back(Block{i, begin, std::min(begin + VERTEX_BLOCK, num_vertices)});
+        _vertexBase.push_back(_vertexBase.back() + num_vertices);
+
+        auto material = _materials.find(sub_msh._tex_name);
+        const Texture * texture = !_override.texels.empty() ? &_override
+                                  : material != _materials.end() && !material->second.texels.empty() ? &material->second
+                                  : nullptr;
+        _subTextures.push_back(texture);
+    }
+    _vertices.resize(_vertexBase.back());
+    _pool->ParallelFor(static_cast<uint32_t>(_blocks.size()), [&](uint32_t i)
+    {
+        TransformBlock(msh, _blocks[i], mvp, normal_matrix, skinned);
+    });
+
+    _numChunks = 0;
+    for(uint32_t i = 0; i < msh._meshes.size(); i++)
+    {
+        uint32_t num_tris = static_cast<uint32_t>(msh._meshes[i]._indices.size() / 3);
+        for(uint32_t begin = 0; begin < num_tris; begin += CHUNK_TRIANGLES)
+        {
+            if(_numChunks == _chunks.size())
+                _chunks.emplace_back();
+            _chunks[_numChunks++].range = Block{i, begin, std::min(begin + CHUNK_TRIANGLES, num_tris)};
+        }
+        _stats.triangles += num_tris;
+    }
+    _pool->ParallelFor(_numChunks, [&](uint32_t i)
+    {
+        SetupChunk(msh, _chunks[i]);
+    });
+
+    uint32_t num_tiles = _tilesX * _tilesY;
+    _tilePixels.assign(num_tiles, 0);
+    _pool->ParallelFor(num_tiles, [this](uint32_t tile)
+    {
+        RasterTile(tile);
+    });
+
+    for(uint32_t i = 0; i < _numChunks; i++)
+    {
+        const Chunk & chunk = _chunks[i];
+        _stats.culled += chunk.culled;
+        _stats.clipped += chunk.clipped;
+        _stats.binned += chunk.tris.size();
+        _stats.tileRefs += chunk.bins.size();
+    }
+    for(uint64_t pixels : _tilePixels)
+        _stats.pixels += pixels;
+    return true;
+}
+
+void SoftRasterizer::GetImage(ImageData & id) const
+{
+    id = ImageData();
+    id.width = _width;
+    id.height = _height;
+    id.type = ImageData::PixelType::pt_rgba;
+    id.data.reset(new uint8_t[static_cast<size_t>(_width) * _height * 4]);
+    for(uint32_t y = 0; y < _height; y++)
+        std::memcpy(id.data.get() + static_cast<size_t>(y) * _width * 4,
+                    _color.data() + static_cast<size_t>(y) * _stride, static_cast<size_t>(_width) * 4);
+}
+
+void SoftRasterizer::TransformBlock(const Mesh & msh, const Block & block, const glm::mat4 & mvp,
+                                    const glm::mat3 & normal_matrix, bool skinned)
+{
+    const auto &      sub_msh = msh._meshes[block.sub];
+    const glm::vec3 * positions = skinned ? _skinning.Positions(block.sub).data() : sub_msh._positions.data();
+    const glm::vec3 * normals = nullptr;
+    if(sub_msh._normals.size() == sub_msh._positions.size())
+        normals = skinned ? _skinning.Normals(block.sub).data() : sub_msh._normals.data();
+    const glm::vec2 * uvs = nullptr;
+    if(!sub_msh._uvs.empty() && sub_msh._uvs[0].size() == sub_msh._positions.size())
+        uvs = sub_msh._uvs[0].data();
+
+    Vertex * out = _vertices.data() + _vertexBase[block.sub];
+    for(uint32_t i = block.begin; i < block.end; i++)
+    {
+        // per vertex, like the fixed-function lighting the viewer uses
+        glm::vec3 n = normals ? glm::normalize(normal_matrix * normals[i]) : glm::vec3(0.0f, 0.0f, 1.0f);
+        float     diffuse = std::max(glm::dot(n, LIGHT_DIR), 0.0f);
+        float     light = SCENE_AMBIENT + MATERIAL_DIFFUSE * diffuse;
+        if(diffuse > 0.0f)
+            light += std::pow(std::max(glm::dot(n, HALF_VECTOR), 0.0f), SHININESS);
+        light = std::min(light, 1.0f);
+
+        out[i].clip = mvp * glm::vec4(positions[i], 1.0f);
+        out[i].color = glm::vec3(light);
+        out[i].uv = uvs ? uvs[i] : glm::vec2(0.0f);
+    }
+}
+
+void SoftRasterizer::SetupChunk(const Mesh & msh, Chunk & chunk)
+{
+    chunk.tris.clear();
+    chunk.culled = 0;
+    chunk.clipped = 0;
+
+    const auto &    sub_msh = msh._meshes[chunk.range.sub];
+    const Vertex *  vertices = _vertices.data() + _vertexBase[chunk.range.sub];
+    uint32_t        num_vertices = _vertexBase[chunk.range.sub + 1] - _vertexBase[chunk.range.sub];
+    const Texture * texture = _subTextures[chunk.range.sub];
+    for(uint32_t t = chunk.range.begin; t < chunk.range.end; t++)
+    {
+        const unsigned int * idx = sub_msh._indices.data() + 3 * t;
+        if(idx[0] >= num_vertices || idx[1] >= num_vertices || idx[2] >= num_vertices)
+        {
+            chunk.culled++;
+            continue;
+        }
+
+        const Vertex * v[3] = {vertices + idx[0], vertices + idx[1], vertices + idx[2]};
+        ClipTriangle(v, texture, chunk);
+    }
+
+    // counted, then filled, into one array of triangle indices per tile
+    const int32_t tile = static_cast<int32_t>(TILE_SIZE);
+    uint32_t      num_tiles = _tilesX * _tilesY;
+    chunk.binStart.assign(num_tiles + 1, 0);
+    for(const Triangle & tri : chunk.tris)
+    {
+        for(int32_t ty = tri.minY / tile; ty <= tri.maxY / tile; ty++)
+            for(int32_t tx = tri.minX / tile; tx <= tri.maxX / tile; tx++)
+                chunk.binStart[ty * _tilesX + tx + 1]++;
+    }
+    for(uint32_t i = 0; i < num_tiles; i++)
+        chunk.binStart[i + 1] += chunk.binStart[i];
+
+    chunk.bins.resize(chunk.binStart[num_tiles]);
+    chunk.cursor.assign(chunk.binStart.begin(), chunk.binStart.end() - 1);
+    for(uint32_t i = 0; i < chunk.tris.size(); i++)
+    {
+        const Triangle & tri = chunk.tris[i];
+        for(int32_t ty = tri.minY / tile; ty <= tri.maxY / tile; ty++)
+            for(int32_t tx = tri.minX / tile; tx <= tri.maxX / tile; tx++)
+                chunk.bins[chunk.cursor[ty * _tilesX + tx]++] = i;
+    }
+}
+
+void SoftRasterizer::ClipTriangle(const Vertex * v[3], const Texture * texture, Chunk & chunk) const
+{
+    // outside the view volume as a whole, or beyond a plane clipping must deal with
+    uint32_t view_out[3];
+    uint32_t clip_out = 0;
+    for(int i = 0; i < 3; i++)
+    {
+        const glm::vec4 & c = v[i]->clip;
+        view_out[i] = (c.x < -c.w) | (c.x > c.w) << 1 | (c.y < -c.w) << 2 | (c.y > c.w) << 3
+                      | (c.z < -c.w) << 4 | (c.z > c.w) << 5;
+        for(int p = 0; p < 6; p++)
+            clip_out |= (ClipDistance(p, c) < 0.0f) << p;
+    }
+    if(view_out[0] & view_out[1] & view_out[2])
+    {
+        chunk.culled++;
+        return;
+    }
+
+    Triangle tri;
+    if(!clip_out)
+    {
+        if(SetupTriangle(*v[0], *v[1], *v[2], texture, tri))
+            chunk.tris.push_back(tri);
+        else
+            chunk.culled++;
+        return;
+    }
+
+    // Sutherland-Hodgman against the planes crossed, attributes interpolated in clip space
+    chunk.clipped++;
+    Vertex   poly[2][MAX_CLIP_VERTICES];
+    uint32_t count = 3;
+    int      cur = 0;
+    for(int i = 0; i < 3; i++)
+        poly[0][i] = *v[i];
+
+    for(int p = 0; p < 6 && count >= 3; p++)
+    {
+        if(!(clip_out & (1u << p)))
+            continue;
+
+        const Vertex * in = poly[cur];
+        Vertex *       out = poly[1 - cur];
+        uint32_t       kept = 0;
+        for(uint32_t i = 0; i < count; i++)
+        {
+            const Vertex & a = in[i];
+            const Vertex & b = in[(i + 1) % count];
+            float da = ClipDistance(p, a.clip);
+            float db = ClipDistance(p, b.clip);
+            if(da >= 0.0f)
+                out[kept++] = a;
+            if((da >= 0.0f) != (db >= 0.0f))
+            {
+                float t = da / (da - db);
+                out[kept].clip = a.clip + (b.clip - a.clip) * t;
+                out[kept].color = a.color + (b.color - a.color) * t;
+                out[kept].uv = a.uv + (b.uv - a.uv) * t;
+                kept++;
+            }
+        }
+        count = kept;
+        cur = 1 - cur;
+    }
+
+    bool drawn = false;
+    for(uint32_t i = 1; i + 1 < count; i++)
+    {
+        if(SetupTriangle(poly[cur][0], poly[cur][i], poly[cur][i + 1], texture, tri))
+        {
+            chunk.tris.push_back(tri);
+            drawn = true;
+        }
+    }
+    if(!drawn)
+        chunk.culled++;
+}
+
+bool SoftRasterizer::SetupTriangle(const Vertex & v0, const Vertex & v1, const Vertex & v2, const Texture * texture,
+                                   Triangle & tri) const
+{
+    const Vertex * v[3] = {&v0, &v1, &v2};
+    int32_t        x[3];
+    int32_t        y[3];
+    float          values[pl_count][3];
+    for(int i = 0; i < 3; i++)
+    {
+        float     inv_w = 1.0f / v[i]->clip.w;
+        glm::vec3 ndc = glm::vec3(v[i]->clip) * inv_w;
+        x[i] = static_cast<int32_t>(std::lround((ndc.x * 0.5f + 0.5f) * _width * SUBPIXELS));
+        y[i] = static_cast<int32_t>(std::lround((ndc.y * 0.5f + 0.5f) * _height * SUBPIXELS));
+
+        values[pl_z][i] = ndc.z * 0.5f + 0.5f;
+        values[pl_invw][i] = inv_w;
+        values[pl_u][i] = v[i]->uv.x * inv_w;
+        values[pl_v][i] = v[i]->uv.y * inv_w;
+        values[pl_r][i] = v[i]->color.x * inv_w;
+        values[pl_g][i] = v[i]->color.y * inv_w;
+        values[pl_b][i] = v[i]->color.z * inv_w;
+    }
+
+    // counter-clockwise faces the viewer; back faces and slivers of no area go
+    int64_t area = int64_t(x[1] - x[0]) * (y[2] - y[0]) - int64_t(x[2] - x[0]) * (y[1] - y[0]);
+    if(area <= 0)
+        return false;
+
+    // pixels whose centres lie within the bounds
+    tri.minX = std::max(FloorDiv(std::min({x[0], x[1], x[2]}) - HALF_PIXEL + SUBPIXELS - 1, SUBPIXELS), 0);
+    tri.minY = std::max(FloorDiv(std::min({y[0], y[1], y[2]}) - HALF_PIXEL + SUBPIXELS - 1, SUBPIXELS), 0);
+    tri.maxX = std::min(FloorDiv(std::max({x[0], x[1], x[2]}) - HALF_PIXEL, SUBPIXELS),
+                        static_cast<int32_t>(_width) - 1);
+    tri.maxY = std::min(FloorDiv(std::max({y[0], y[1], y[2]}) - HALF_PIXEL, SUBPIXELS),
+                        static_cast<int32_t>(_height) - 1);
+    if(tri.minX > tri.maxX || tri.minY > tri.maxY)
+        return false;
+
+    for(int k = 0; k < 3; k++)
+    {
+        int i = (k + 1) % 3;
+        int j = (k + 2) % 3;
+        tri.a[k] = y[i] - y[j];
+        tri.b[k] = x[j] - x[i];
+        tri.c[k] = -int64_t(tri.a[k]) * x[i] - int64_t(tri.b[k]) * y[i];
+
+        // top-left rule: pixel centres on a left or top edge belong to the triangle, on the others they do not
+        bool top_left = tri.a[k] > 0 || (tri.a[k] == 0 && tri.b[k] < 0);
+        if(!top_left)
+            tri.c[k] -= 1;
+    }
+
+    float x0 = static_cast<float>(x[0]) / SUBPIXELS;
+    float y0 = static_cast<float>(y[0]) / SUBPIXELS;
+    float d1x = static_cast<float>(x[1]) / SUBPIXELS - x0;
+    float d1y = static_cast<float>(y[1]) / SUBPIXELS - y0;
+    float d2x = static_cast<float>(x[2]) / SUBPIXELS - x0;
+    float d2y = static_cast<float>(y[2]) / SUBPIXELS - y0;
+    float inv_area = static_cast<float>(SUBPIXELS * SUBPIXELS) / static_cast<float>(area);
+    for(int p = 0; p < pl_count; p++)
+    {
+        float da1 = values[p][1] - values[p][0];
+        float da2 = values[p][2] - values[p][0];
+        tri.planes[p][0] = values[p][0];
+        tri.planes[p][1] = (da1 * d2y - da2 * d1y) * inv_area;
+        tri.planes[p][2] = (da2 * d1x - da1 * d2x) * inv_area;
+    }
+    tri.x0 = x0;
+    tri.y0 = y0;
+    tri.texture = texture;
+    return true;
+}
+
+void SoftRasterizer::RasterTile(uint32_t tile)
+{
+    int32_t tile_x0 = static_cast<int32_t>(tile % _tilesX * TILE_SIZE);
+    int32_t tile_y0 = static_cast<int32_t>(tile / _tilesX * TILE_SIZE);
+    int32_t tile_x1 = std::min(tile_x0 + static_cast<int32_t>(TILE_SIZE), static_cast<int32_t>(_width)) - 1;
+    int32_t tile_y1 = std::min(tile_y0 + static_cast<int32_t>(TILE_SIZE), static_cast<int32_t>(_height)) - 1;
+
+    RasterKernel kernel = PickKernel(_isa);
+    TileTarget   dst{_color.data(), _depth.data(), _stride};
+    uint64_t     pixels = 0;
+    for(uint32_t c = 0; c < _numChunks; c++)
+    {
+        const Chunk & chunk = _chunks[c];
+        for(uint32_t b = chunk.binStart[tile]; b < chunk.binStart[tile + 1]; b++)
+        {
+            const Triangle & t = chunk.tris[chunk.bins[b]];
+            int32_t xs = std::max(tile_x0, t.minX);
+            int32_t ys = std::max(tile_y0, t.minY);
+            int32_t xe = std::min(tile_x1, t.maxX);
+            int32_t ye = std::min(tile_y1, t.maxY);
+
+            // Edges evaluated at the first pixel in 64 bits. Over a part of at
+            // most TILE_SIZE pixels an edge changes by less than 2^29, so one
+            // that is neither outside nor inside the whole part starts within
+            // that and its steps stay in 32 bits
+            TileEdges e;
+            bool      outside = false;
+            for(int k = 0; k < 3 && !outside; k++)
+            {
+                int64_t value = int64_t(t.a[k]) * (xs * SUBPIXELS + HALF_PIXEL)
+                                + int64_t(t.b[k]) * (ys * SUBPIXELS + HALF_PIXEL) + t.c[k];
+                int64_t span_x = int64_t(t.a[k]) * SUBPIXELS * (xe - xs);
+                int64_t span_y = int64_t(t.b[k]) * SUBPIXELS * (ye - ys);
+                int64_t lowest = value + std::min<int64_t>(span_x, 0) + std::min<int64_t>(span_y, 0);
+                int64_t highest = value + std::max<int64_t>(span_x, 0) + std::max<int64_t>(span_y, 0);
+                outside = highest < 0;
+                bool inside = lowest >= 0;
+                e.e[k] = inside ? 0 : static_cast<int32_t>(value);
+                e.dx[k] = inside ? 0 : t.a[k] * SUBPIXELS;
+                e.dy[k] = inside ? 0 : t.b[k] * SUBPIXELS;
+            }
+            if(!outside)
+                pixels += kernel(t, e, xs, ys, xe, ye, dst);
+        }
+    }
+    _tilePixels[tile] = pixels;
+}
+
+bool SoftRasterizer::LoadTexture(const ImageData & id, Texture & tex)
+{
+    if(!id.Pixels() || id.type == ImageData::PixelType::pt_none || id.width == 0 || id.height == 0)
+        return false;
+    // the AVX2 kernel gathers texels by 32-bit index
+    if(static_cast<uint64_t>(id.width) * id.height > static_cast<uint64_t>(INT32_MAX))
+        return false;
+
+    tex.width = id.width;
+    tex.height = id.height;
+    tex.texels.resize(static_cast<size_t>(id.width) * id.height);
+
+    uint32_t bytes_per_pixel = id.BytesPerPixel();
+    bool     bgr = id.order == ImageData::ChannelOrder::co_bgr;
+    for(uint32_t y = 0; y < id.height; y++)
+    {
+        const uint8_t * row = id.Row(y);
+        uint32_t *      dst = tex.texels.data() + static_cast<size_t>(y) * id.width;
+        for(uint32_t x = 0; x < id.width; x++)
+        {
+            const uint8_t * p = row + x * bytes_per_pixel;
+            uint32_t r = p[bgr ? 2 : 0];
+            uint32_t b = p[bgr ? 0 : 2];
+            uint32_t a = bytes_per_pixel == 4 ? p[3] : 255;
+            dst[x] = r | uint32_t(p[1]) << 8 | b << 16 | a << 24;
+        }
+    }
+    return true;
+}
+
+void SoftRasterizer::SetIsa(Isa isa)
+{
+    _isa = IsSupported(isa) ? isa : BestIsa();
+}
+
+void SoftRasterizer::SetNumThreads(unsigned int num_threads)
+{
+    _pool.reset(new ThreadPool(num_threads));
+    _skinning.SetNumThreads(num_threads);
+}
+
+bool SoftRasterizer::IsSupported(Isa isa)
+{
+    switch(isa)
+    {
+#ifdef RASTER_SSE2
+        case Isa::isa_sse2:
+            return true;
+#endif
+#ifdef CPU_X86
+        case Isa::isa_avx2:
+            return CpuFeatures::HasAVX2();
+#endif
+        case Isa::isa_scalar:
+            return true;
+        default:
+            return false;
+    }
+}
+
+SoftRasterizer::Isa SoftRasterizer::BestIsa()
+{
+    if(IsSupported(Isa::isa_avx2))
+        return Isa::isa_avx2;
+    if(IsSupported(Isa::isa_sse2))
+        return Isa::isa_sse2;
+    return Isa::isa_scalar;
+}
+
+const char * SoftRasterizer::IsaName(Isa isa)
+{
+    switch(isa)
+    {
+        case Isa::isa_sse2:
+            return "sse2";
+        case Isa::isa_avx2:
+            return "avx2";
+        default:
+            return "scalar";
+    }
+}
+
+void SoftRasterizer::FrameMesh(const Mesh & msh, float aspect, Camera & cam, glm::mat4 & proj)
+{
+    AABB box = msh._base_bbox;
+    box.transform(msh._modelMatrix);
+    glm::vec3 center = (box.min() + box.max()) * 0.5f;
+    float     radius = std::max(glm::length(box.max() - box.min()) * 0.5f, 1e-3f);
+
+    // far enough for the bounding sphere to fit the narrower field of view
+    const float fovy = glm::radians(45.0f);
+    float half_fov = aspect < 1.0f ? std::atan(std::tan(fovy * 0.5f) * aspect) : fovy * 0.5f;
+    float distance = radius / std::sin(half_fov);
+
+    glm::vec3 dir = glm::normalize(glm::vec3(0.0f, 0.35f, 1.0f));
+    cam = Camera(center + dir * distance, center, glm::vec3(0.0f, 1.0f, 0.0f));
+    proj = glm::perspective(fovy, aspect, std::max(distance - radius, distance * 0.01f), distance + radius);
+}
@@ -0,0 +1,204 @@
+#ifndef SOFTRASTERIZER_H
+#define SOFTRASTERIZER_H
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "camera.h"
+#include "ImageData.h"
+#include "Mesh.h"
+#include "SkinningEngine.h"
+#include "ThreadPool.h"
+
+//! Mesh renderer on the CPU, for previews on machines without a GPU
+/*!
+    Draw() renders depth-tested, textured triangles lit per vertex the way
+    the fixed-function pipeline of the viewer lights them: one directional
+    light, the default material, back faces culled. It runs in three
+    stages on the rasterizer's own thread pool:
+
+    - vertices are transformed, optionally skinned, and lit in blocks;
+    - triangles are clipped, culled and set up in chunks, each set up as
+      edge functions on vertices snapped to 1/16 pixel, and binned into
+      the TILE_SIZE square tiles their bounds touch;
+    - tiles are rasterized in parallel, each walking the bins of every
+      chunk in submission order, so the image does not depend on the
+      number of threads.
+
+    Within a tile the edge functions and the depth test cover 4 (SSE2) or
+    8 (AVX2) pixels per step in 32-bit integers; the pixels left are shaded
+    one at a time, perspective correct, with bilinear texture filtering.
+    Every kernel produces the same image. Edges follow the top-left fill
+    rule, so triangles sharing an edge neither overlap nor leave gaps.
+
+    The image has a lower-left origin like ImageData and the framebuffer
+    of the viewer; pixels not drawn keep the Clear() colour.
+*/
+class SoftRasterizer
+{
+public:
+    enum class Isa
+    {
+        isa_scalar,
+        isa_sse2,
+        isa_avx2
+    };
+
+    // counts of the last Draw()
+    struct Stats
+    {
+        uint64_t triangles;              // submitted
+        uint64_t culled;                 // outside the view, back facing or between pixel centres
+        uint64_t clipped;                // crossing the near or far plane or the guard band
+        uint64_t binned;                 // triangles set up, a clipped one may make several
+        uint64_t tileRefs;               // triangle and tile pairs
+        uint64_t pixels;                 // passed the depth test and shaded
+
+        Stats() : triangles(0), culled(0), clipped(0), binned(0), tileRefs(0), pixels(0) {}
+    };
+
+    static constexpr uint32_t TILE_SIZE = 32;
+    static constexpr uint32_t MAX_SIZE = 4096;       // keeps the edge functions of a tile in 32 bits
+
+    SoftRasterizer();
+
+    //! Colour and depth buffers of width x height, at most MAX_SIZE each way
+    bool     Resize(uint32_t width, uint32_t height);
+    uint32_t Width() const { return _width; }
+    uint32_t Height() const { return _height; }
+
+    //! Colour to glm::vec4 components in [0, 1], depth to the far plane
+    void Clear(const glm::vec4 & color);
+
+    //! Textures of the submesh materials, names relative to base_dir; false if any failed to load
+    /*!
+        A texture loaded into the mesh with Mesh::LoadTexture() replaces
+        every material, as in the viewer. Submeshes whose texture is missing
+        are drawn untextured.
+    */
+    bool LoadMaterials(const Mesh & msh, const std::string & base_dir);
+
+    //! Render msh over the current image; time in seconds skins its animation, a negative one draws the bind pose
+    bool Draw(const Mesh & msh, const glm::mat4 & view, const glm::mat4 & proj, double time = -1.0);
+
+    //! RGBA copy of the image
+    void GetImage(ImageData & id) const;
+
+    const Stats & GetStats() const { return _stats; }
+
+    //! Kernel used for the tiles, falls back to the best supported one
+    void SetIsa(Isa isa);
+    Isa  GetIsa() const { return _isa; }
+
+    //! Threads drawing, the caller included; 0 picks one per core
+    void         SetNumThreads(unsigned int num_threads);
+    unsigned int NumThreads() const { return _pool->NumThreads(); }
+
+    static bool        IsSupported(Isa isa);
+    static Isa         BestIsa();
+    static const char* IsaName(Isa isa);
+
+    //! Camera and projection showing the whole mesh in its bind pose, from the front and a little above
+    static void FrameMesh(const Mesh & msh, float aspect, Camera & cam, glm::mat4 & proj);
+
+    // Setup and tile data, shared with the kernels
+    struct Texture
+    {
+        uint32_t              width;
+        uint32_t              height;
+        std::vector<uint32_t> texels;    // RGBA8, lower-left origin
+    };
+
+    enum Plane
+    {
+        pl_z,                            // window depth, linear in screen space
+        pl_invw,                         // the rest are divided by w, for perspective correction
+        pl_u,
+        pl_v,
+        pl_r,
+        pl_g,
+        pl_b,
+        pl_count
+    };
+
+    // Edge k is opposite vertex k, positive inside: e = a * x + b * y + c
+    // in 1/16 pixel units, c already biased by the fill rule. Attributes
+    // are planes value + dx * (x - x0) + dy * (y - y0) in pixels
+    struct Triangle
+    {
+        int32_t         a[3];
+        int32_t         b[3];
+        int64_t         c[3];
+        int32_t         minX, minY;      // pixels whose centres may be covered, within the image
+        int32_t         maxX, maxY;
+        float           x0, y0;          // first vertex, origin of the planes
+        float           planes[pl_count][3];
+        const Texture * texture;         // null when untextured
+    };
+
+private:
+    struct Vertex
+    {
+        glm::vec4 clip;
+        glm::vec3 color;                 // lit, before texturing
+        glm::vec2 uv;
+    };
+
+    // range of vertices or triangles of one submesh
+    struct Block
+    {
+        uint32_t sub;
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    // triangles set up from one block, binned by tile: the indices of tile t
+    // are bins[binStart[t]] to bins[binStart[t + 1]]
+    struct Chunk
+    {
+        Block                 range;
+        std::vector<Triangle> tris;
+        std::vector<uint32_t> binStart;
+        std::vector<uint32_t> bins;
+        std::vector<uint32_t> cursor;
+        uint64_t              culled;
+        uint64_t              clipped;
+    };
+
+    void TransformBlock(const Mesh & msh, const Block & block, const glm::mat4 & mvp, const glm::mat3 & normal_matrix,
+                        bool skinned);
+    void SetupChunk(const Mesh & msh, Chunk & chunk);
+    // clip a triangle against the near and far planes and the guard band, then set up what is left
+    void ClipTriangle(const Vertex * v[3], const Texture * texture, Chunk & chunk) const;
+    bool SetupTriangle(const Vertex & v0, const Vertex & v1, const Vertex & v2, const Texture * texture,
+                       Triangle & tri) const;
+    void RasterTile(uint32_t tile);
+
+    static bool LoadTexture(const ImageData & id, Texture & tex);
+
+    Isa                            _isa;
+    std::unique_ptr<ThreadPool>    _pool;
+    uint32_t                       _width;
+    uint32_t                       _height;
+    uint32_t                       _tilesX;
+    uint32_t                       _tilesY;
+    uint32_t                       _stride;          // of both buffers, padded to whole 8-pixel registers
+    std::vector<uint32_t>          _color;           // RGBA8, lower-left origin, rows _stride apart
+    std::vector<float>             _depth;
+    std::map<std::string, Texture> _materials;       // by texture name
+    Texture                        _override;        // Mesh::LoadTexture() image, replaces the materials
+    SkinningEngine                 _skinning;
+    std::vector<Vertex>            _vertices;        // of all submeshes, per draw
+    std::vector<uint32_t>          _vertexBase;      // first vertex of each submesh in _vertices
+    std::vector<const Texture *>   _subTextures;
+    std::vector<Block>             _blocks;
+    std::vector<Chunk>             _chunks;
+    uint32_t                       _numChunks;       // in use this draw, _chunks keeps the storage of more
+    std::vector<uint64_t>          _tilePixels;
+    Stats                          _stats;
+};
+
+#endif // SOFTRASTERIZER_H
@@ -0,0 +1,225 @@
+#include "StreamBuffer.h"
+#include <QOpenGLContext>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <algorithm>
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+namespace
+{
+    typedef void (QOPENGLF_APIENTRYP BufferStorageProc)(GLenum target, GLsizeiptr size, const void * data,
+                                                        GLbitfield flags);
+
+    const size_t   REGION_ALIGNMENT = 256;               // any attribute offset inside a region stays aligned
+    const GLuint64 FENCE_TIMEOUT_NS = 100000000;         // per glClientWaitSync call, retried until signaled
+}
+
+StreamBuffer::StreamBuffer() : _gl(nullptr),
+                               _mode(Mode::sm_orphan),
+                               _buffer(0),
+                               _frameBytes(0),
+                               _region(0),
+                               _mapped(nullptr),
+                               _fences{}
+{
+}
+
+StreamBuffer::~StreamBuffer()
+{
+    // GL objects go with the context, Destroy() is for releasing them earlier
+}
+
+bool StreamBuffer::Create(size_t frame_bytes)
+{
+    Destroy();
+
+    QOpenGLContext * ctx = QOpenGLContext::currentContext();
+    if(!ctx || frame_bytes == 0)
+        return false;
+
+    _gl = ctx->extraFunctions();
+    _stats = Stats();
+
+    QPair<int, int> version = ctx->format().version();
+    bool desktop = !ctx->isOpenGLES();
+    bool sync = version >= qMakePair(3, 2) || (!desktop && version >= qMakePair(3, 0))
+                || ctx->hasExtension("GL_ARB_sync");
+    bool map_range = version >= qMakePair(3, 0) || ctx->hasExtension("GL_ARB_map_buffer_range");
+    BufferStorageProc buffer_storage = nullptr;
+    if(desktop && (version >= qMakePair(4, 4) || ctx->hasExtension("GL_ARB_buffer_storage")))
+        buffer_storage = reinterpret_cast<BufferStorageProc>(ctx->getProcAddress("glBufferStorage"));
+
+    _frameBytes = (frame_bytes + REGION_ALIGNMENT - 1) / REGION_ALIGNMENT * REGION_ALIGNMENT;
+    GLsizeiptr total = static_cast<GLsizeiptr>(_frameBytes * NUM_REGIONS);
+
+    _gl->glGenBuffers(1, &_buffer);
+    _gl->glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+    if(sync && map_range && buffer_storage)
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        buffer_storage(GL_ARRAY_BUFFER, total, nullptr, flags);
+        _mapped = static_cast<char*>(_gl->glMapBufferRange(GL_ARRAY_BUFFER, 0, total, flags));
+        if(!_mapped)
+        {
+            // immutable storage can not be respecified, start over with a plain buffer
+            _gl->glDeleteBuffers(1, &_buffer);
+            _gl->glGenBuffers(1, &_buffer);
+            _gl->glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+        }
+    }
+
+    if(_mapped)
+    {
+        _mode = Mode::sm_persistent;
+    }
+    else if(sync && map_range)
+    {
+        _mode = Mode::sm_unsynchronized;
+        _gl->glBufferData(GL_ARRAY_BUFFER, total, nullptr, GL_STREAM_DRAW);
+    }
+    else
+    {
+        _mode = Mode::sm_orphan;
+        _gl->glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(_frameBytes), nullptr, GL_STREAM_DRAW);
+        _staging.resize(_frameBytes);
+    }
+    _gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    _region = NUM_REGIONS - 1;              // the first BeginFrame() moves on to region 0
+    return true;
+}
+
+void StreamBuffer::Destroy()
+{
+    if(!_buffer)
+        return;
+
+    for(GLsync & fence : _fences)
+    {
+        if(fence)
+            _gl->glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    if(_mapped)
+    {
+        _gl->glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+        _gl->glUnmapBuffer(GL_ARRAY_BUFFER);
+        _gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+        _mapped = nullptr;
+    }
+
+    _gl->glDeleteBuffers(1, &_buffer);
+    _buffer = 0;
+    _staging.clear();
+    _staging.shrink_to_fit();
+}
+
+void * StreamBuffer::BeginFrame()
+{
+    _stats.frames++;
+    if(_mode == Mode::sm_orphan)
+        return _staging.data();
+
+    _region = (_region + 1) % NUM_REGIONS;
+    WaitRegion(_region);
+    if(_mode == Mode::sm_persistent)
+        return _mapped + _region * _frameBytes;
+
+    // the fence already guarantees the GPU is done with the range, the driver need not check
+    _gl->glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+    void * ptr = _gl->glMapBufferRange(GL_ARRAY_BUFFER, static_cast<GLintptr>(_region * _frameBytes),
+                                       static_cast<GLsizeiptr>(_frameBytes),
+                                       GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    _gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if(ptr)
+        return ptr;
+
+    qDebug() << "Fail to map stream buffer, falling back to orphaning";
+    for(GLsync & fence : _fences)
+    {
+        if(fence)
+            _gl->glDeleteSync(fence);
+        fence = nullptr;
+    }
+    _mode = Mode::sm_orphan;
+    _staging.resize(_frameBytes);
+    return _staging.data();
+}
+
+size_t StreamBuffer::EndFrame()
+{
+    // a coherent persistent mapping is visible to the GPU without any call
+    if(_mode == Mode::sm_persistent)
+        return _region * _frameBytes;
+
+    _gl->glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+    if(_mode == Mode::sm_unsynchronized)
+    {
+        _gl->glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+    else
+    {
+        // new storage for the buffer name, the previous one lives on while frames in flight read it
+        _gl->glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(_frameBytes), _staging.data(), GL_STREAM_DRAW);
+    }
+    _gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    return _mode == Mode::sm_orphan ? 0 : _region * _frameBytes;
+}
+
+void StreamBuffer::Fence()
+{
+    if(_mode == Mode::sm_orphan || !_buffer)
+        return;
+
+    if(_fences[_region])
+        _gl->glDeleteSync(_fences[_region]);
+    _fences[_region] = _gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void StreamBuffer::WaitRegion(uint32_t region)
+{
+    GLsync fence = _fences[region];
+    if(!fence)
+        return;
+    _fences[region] = nullptr;
+
+    // poll first so frames that do not wait are not counted
+    GLenum res = _gl->glClientWaitSync(fence, 0, 0);
+    if(res == GL_TIMEOUT_EXPIRED)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        do
+        {
+            res = _gl->glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+        } while(res == GL_TIMEOUT_EXPIRED);
+
+        double ms = timer.nsecsElapsed() / 1e6;
+        _stats.waits++;
+        _stats.waitMs += ms;
+        _stats.maxWaitMs = std::max(_stats.maxWaitMs, ms);
+    }
+
+    _gl->glDeleteSync(fence);
+}
+
+const char * StreamBuffer::ModeName(Mode mode)
+{
+    switch(mode)
+    {
+        case Mode::sm_persistent:
+            return "persistent";
+        case Mode::sm_unsynchronized:
+            return "unsynchronized";
+        default:
+            return "orphan";
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef STREAMBUFFER_H
+#define STREAMBUFFER_H
+
+#include <QOpenGLExtraFunctions>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//! GL buffer for vertex data rewritten every frame, without stalling on the previous frames
+/*!
+    The buffer holds three frame regions used in turn. Each frame the CPU
+    writes the next region through a pointer from BeginFrame() while the
+    GPU may still read the other two; Fence() after the draw calls marks
+    the region, and BeginFrame() waits on that fence before handing the
+    region out again three frames later. The time spent waiting is the
+    time the CPU ran ahead of the GPU.
+
+    The best mode the context supports is picked by Create():
+    persistent mapping (GL 4.4 / ARB_buffer_storage), unsynchronized
+    glMapBufferRange of one region at a time (GL 3.2 / ARB_sync), or, with
+    no sync objects, orphaning the whole buffer and uploading from system
+    memory every frame.
+*/
+class StreamBuffer
+{
+public:
+    enum class Mode
+    {
+        sm_persistent,
+        sm_unsynchronized,
+        sm_orphan
+    };
+
+    struct Stats
+    {
+        uint64_t frames;
+        uint64_t waits;                  // frames that found their region still in use
+        double   waitMs;                 // total time blocked on fences
+        double   maxWaitMs;
+
+        Stats() : frames(0), waits(0), waitMs(0.0), maxWaitMs(0.0) {}
+    };
+
+    static constexpr uint32_t NUM_REGIONS = 3;
+
+    StreamBuffer();
+    ~StreamBuffer();
+
+    //! Buffer for frame_bytes of data per frame, the context must be current
+    bool Create(size_t frame_bytes);
+    void Destroy();                      // context must be current
+    bool IsCreated() const { return _buffer != 0; }
+
+    //! Region to write this frame's data to, waits until the GPU is done with it
+    void * BeginFrame();
+    //! Finish writing, returns the offset of the region for the attribute pointers
+    size_t EndFrame();
+    //! Call after the last draw reading the region
+    void   Fence();
+
+    unsigned int  Buffer() const { return _buffer; }
+    //! Distance between regions, EndFrame() returns a multiple of it
+    size_t        RegionBytes() const { return _frameBytes; }
+    Mode          GetMode() const { return _mode; }
+    const Stats & GetStats() const { return _stats; }
+
+    static const char * ModeName(Mode mode);
+
+private:
+    void WaitRegion(uint32_t region);
+
+    QOpenGLExtraFunctions * _gl;
+    Mode                    _mode;
+    unsigned int            _buffer;
+    size_t                  _frameBytes;       // region size, aligned
+    uint32_t                _region;           // current region
+    char *                  _mapped;           // persistent mapping of the whole buffer
+    GLsync                  _fences[NUM_REGIONS];
+    std::vector<char>       _staging;          // sm_orphan: frame data kept in system memory
+    Stats                   _stats;
+};
+
+#endif // STREAMBUFFER_H
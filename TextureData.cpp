@@ -0,0 +1,629 @@
+#include "TextureData.h"
+#include "CpuFeatures.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// SSE2 is part of x86-64, its filters need no run-time check
+#if defined(CPU_X86) && (defined(__SSE2__) || defined(_M_X64))
+    #define TEXTURE_SSE2 1
+    #include <emmintrin.h>
+#endif
+
+namespace
+{
+    const int KAISER_TAPS = 6;               // source pixels per destination pixel and axis
+    const float KAISER_ALPHA = 4.0f;
+    const float KAISER_RADIUS = 3.0f;        // in source pixels
+    const float PI = 3.14159265358979f;
+
+    //==========================================================================
+    //         Mip filters, RGBA8 in and out
+    //==========================================================================
+    inline uint32_t Half(uint32_t size)
+    {
+        return std::max(1u, size / 2);
+    }
+
+    // modified Bessel function of the first kind, order 0
+    float BesselI0(float x)
+    {
+        float sum = 1.0f;
+        float term = 1.0f;
+        for(int k = 1; k < 20; k++)
+        {
+            term *= (x / (2.0f * k)) * (x / (2.0f * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    // A destination pixel i is centered on source coordinate 2i + 0.5, its
+    // taps are the source pixels 2i - 2 .. 2i + 3, the same weights for all
+    const float * KaiserWeights()
+    {
+        static const struct Weights
+        {
+            float w[KAISER_TAPS];
+
+            Weights()
+            {
+                float sum = 0.0f;
+                for(int k = 0; k < KAISER_TAPS; k++)
+                {
+                    float d = k - 2.5f;
+                    float t = d / 2.0f;                      // in destination pixels
+                    float sinc = std::sin(PI * t) / (PI * t);
+                    float r = d / KAISER_RADIUS;
+                    w[k] = sinc * BesselI0(KAISER_ALPHA * std::sqrt(std::max(0.0f, 1.0f - r * r)))
+                         / BesselI0(KAISER_ALPHA);
+                    sum += w[k];
+                }
+                for(int k = 0; k < KAISER_TAPS; k++)
+                    w[k] /= sum;
+            }
+        } weights;
+        return weights.w;
+    }
+
+    inline uint32_t Clamp(int64_t v, uint32_t size)
+    {
+        return static_cast<uint32_t>(std::min<int64_t>(std::max<int64_t>(v, 0), size - 1));
+    }
+
+    inline uint8_t ToByte(float v)
+    {
+        return static_cast<uint8_t>(std::min(255L, std::max(0L, std::lrintf(v))));
+    }
+
+#ifdef TEXTURE_SSE2
+    void DownsampleBoxSSE2(const uint8_t * src, uint32_t w, uint32_t h, uint8_t * dst)
+    {
+        uint32_t dw = Half(w);
+        uint32_t dh = Half(h);
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i two = _mm_set1_epi16(2);
+
+        for(uint32_t y = 0; y < dh; y++)
+        {
+            const uint8_t * row0 = src + size_t(Clamp(2 * int64_t(y), h)) * w * 4;
+            const uint8_t * row1 = src + size_t(Clamp(2 * int64_t(y) + 1, h)) * w * 4;
+            uint8_t *       out = dst + size_t(y) * dw * 4;
+
+            // 8 source pixels of both rows make 4 destination pixels
+            uint32_t x = 0;
+            for(; x + 4 <= w / 2; x += 4)
+            {
+                __m128i sums[2];
+                for(int half = 0; half < 2; half++)
+                {
+                    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + (2 * x + 4 * half) * 4));
+                    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + (2 * x + 4 * half) * 4));
+                    __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+                    __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+                    __m128i even = _mm_unpacklo_epi64(lo, hi);
+                    __m128i odd = _mm_unpackhi_epi64(lo, hi);
+                    sums[half] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(even, odd), two), 2);
+                }
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4), _mm_packus_epi16(sums[0], sums[1]));
+            }
+
+            for(; x < dw; x++)
+            {
+                uint32_t x0 = Clamp(2 * int64_t(x), w) * 4;
+                uint32_t x1 = Clamp(2 * int64_t(x) + 1, w) * 4;
+                for(int c = 0; c < 4; c++)
+                    out[x * 4 + c] = static_cast<uint8_t>((row0[x0 + c] + row0[x1 + c]
+                                                           + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+            }
+        }
+    }
+
+    inline __m128 LoadPixel(const uint8_t * p)
+    {
+        int32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        __m128i zero = _mm_setzero_si128();
+        return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(v), zero), zero));
+    }
+
+    void DownsampleKaiserSSE2(const uint8_t * src, uint32_t w, uint32_t h, uint8_t * dst)
+    {
+        uint32_t dw = Half(w);
+        uint32_t dh = Half(h);
+        const float * weights = KaiserWeights();
+        __m128 wk[KAISER_TAPS];
+        for(int k = 0; k < KAISER_TAPS; k++)
+            wk[k] = _mm_set1_ps(weights[k]);
+
+        // horizontal pass, one float RGBA pixel per register
+        std::vector<float> tmp(size_t(dw) * h * 4);
+        for(uint32_t y = 0; y < h; y++)
+        {
+            const uint8_t * row = src + size_t(y) * w * 4;
+            float *         out = &tmp[size_t(y) * dw * 4];
+            for(uint32_t x = 0; x < dw; x++)
+            {
+                int64_t first = 2 * int64_t(x) - 2;
+                __m128  acc = _mm_setzero_ps();
+                for(int k = 0; k < KAISER_TAPS; k++)
+                    acc = _mm_add_ps(acc, _mm_mul_ps(wk[k], LoadPixel(row + Clamp(first + k, w) * 4)));
+                _mm_storeu_ps(out + x * 4, acc);
+            }
+        }
+
+        for(uint32_t y = 0; y < dh; y++)
+        {
+            const float * rows[KAISER_TAPS];
+            for(int k = 0; k < KAISER_TAPS; k++)
+                rows[k] = &tmp[size_t(Clamp(2 * int64_t(y) - 2 + k, h)) * dw * 4];
+
+            uint8_t * out = dst + size_t(y) * dw * 4;
+            for(uint32_t x = 0; x < dw; x++)
+            {
+                __m128 acc = _mm_setzero_ps();
+                for(int k = 0; k < KAISER_TAPS; k++)
+                    acc = _mm_add_ps(acc, _mm_mul_ps(wk[k], _mm_loadu_ps(rows[k] + x * 4)));
+
+                __m128i v = _mm_cvtps_epi32(acc);
+                v = _mm_packs_epi32(v, v);
+                v = _mm_packus_epi16(v, v);
+                int32_t px = _mm_cvtsi128_si32(v);
+                std::memcpy(out + x * 4, &px, sizeof(px));
+            }
+        }
+    }
+#endif
+
+    void Downsample(const uint8_t * src, uint32_t w, uint32_t h, MipFilter filter, uint8_t * dst)
+    {
+#ifdef TEXTURE_SSE2
+        if(filter == MipFilter::mf_box)
+            DownsampleBoxSSE2(src, w, h, dst);
+        else
+            DownsampleKaiserSSE2(src, w, h, dst);
+#else
+        if(filter == MipFilter::mf_box)
+            DownsampleBoxScalar(src, w, h, dst);
+        else
+            DownsampleKaiserScalar(src, w, h, dst);
+#endif
+    }
+
+    //==========================================================================
+    //         BC1 / BC3 block encoding
+    //==========================================================================
+    inline uint16_t To565(const float * c)
+    {
+        int r = static_cast<int>(std::lrintf(std::min(255.0f, std::max(0.0f, c[0])) * 31.0f / 255.0f));
+        int g = static_cast<int>(std::lrintf(std::min(255.0f, std::max(0.0f, c[1])) * 63.0f / 255.0f));
+        int b = static_cast<int>(std::lrintf(std::min(255.0f, std::max(0.0f, c[2])) * 31.0f / 255.0f));
+        return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+    }
+
+    inline void From565(uint16_t c, int * rgb)
+    {
+        int r = (c >> 11) & 31;
+        int g = (c >> 5) & 63;
+        int b = c & 31;
+        rgb[0] = (r << 3) | (r >> 2);
+        rgb[1] = (g << 2) | (g >> 4);
+        rgb[2] = (b << 3) | (b >> 2);
+    }
+
+    // indices of the 16 texels for endpoints c0 > c1 (four colour mode), returns the squared error
+    uint32_t PickColorIndices(const uint8_t (*texels)[4], uint16_t c0, uint16_t c1, uint32_t & indices)
+    {
+        int palette[4][3];
+        From565(c0, palette[0]);
+        From565(c1, palette[1]);
+        for(int c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        uint32_t error = 0;
+        indices = 0;
+        for(int i = 0; i < 16; i++)
+        {
+            uint32_t best = UINT32_MAX;
+            uint32_t best_index = 0;
+            for(uint32_t p = 0; p < 4; p++)
+            {
+                int dr = texels[i][0] - palette[p][0];
+                int dg = texels[i][1] - palette[p][1];
+                int db = texels[i][2] - palette[p][2];
+                uint32_t d = static_cast<uint32_t>(dr * dr + dg * dg + db * db);
+                if(d < best)
+                {
+                    best = d;
+                    best_index = p;
+                }
+            }
+            indices |= best_index << (2 * i);
+            error += best;
+        }
+        return error;
+    }
+
+    // Endpoints along the principal axis of the block colours, then one
+    // least squares refit of the endpoints to the indices they produced
+    void EncodeColorBlock(const uint8_t (*texels)[4], uint8_t * out)
+    {
+        float mean[3] = {0.0f, 0.0f, 0.0f};
+        for(int i = 0; i < 16; i++)
+        {
+            for(int c = 0; c < 3; c++)
+                mean[c] += texels[i][c];
+        }
+        for(int c = 0; c < 3; c++)
+            mean[c] /= 16.0f;
+
+        float cov[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};       // rr rg rb gg gb bb
+        for(int i = 0; i < 16; i++)
+        {
+            float r = texels[i][0] - mean[0];
+            float g = texels[i][1] - mean[1];
+            float b = texels[i][2] - mean[2];
+            cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+            cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+        }
+
+        float axis[3] = {1.0f, 1.0f, 1.0f};
+        for(int iter = 0; iter < 8; iter++)
+        {
+            float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+            float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+            float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+            float len = std::max(std::fabs(x), std::max(std::fabs(y), std::fabs(z)));
+            if(len <= 0.0f)
+                break;
+            axis[0] = x / len;
+            axis[1] = y / len;
+            axis[2] = z / len;
+        }
+        float norm = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+        for(int c = 0; c < 3; c++)
+            axis[c] /= norm;
+
+        float lo = 0.0f;
+        float hi = 0.0f;
+        for(int i = 0; i < 16; i++)
+        {
+            float t = (texels[i][0] - mean[0]) * axis[0] + (texels[i][1] - mean[1]) * axis[1]
+                    + (texels[i][2] - mean[2]) * axis[2];
+            lo = std::min(lo, t);
+            hi = std::max(hi, t);
+        }
+
+        float e0[3], e1[3];
+        for(int c = 0; c < 3; c++)
+        {
+            e0[c] = mean[c] + axis[c] * hi;
+            e1[c] = mean[c] + axis[c] * lo;
+        }
+        uint16_t c0 = To565(e0);
+        uint16_t c1 = To565(e1);
+        if(c0 < c1)
+            std::swap(c0, c1);
+
+        uint32_t indices = 0;
+        uint32_t error = c0 == c1 ? UINT32_MAX : PickColorIndices(texels, c0, c1, indices);
+
+        // least squares endpoints for the chosen indices: texel = a * e0 + b * e1
+        if(c0 != c1)
+        {
+            static const float A[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+            float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+            float ax[3] = {0.0f, 0.0f, 0.0f};
+            float bx[3] = {0.0f, 0.0f, 0.0f};
+            for(int i = 0; i < 16; i++)
+            {
+                float a = A[(indices >> (2 * i)) & 3];
+                float b = 1.0f - a;
+                aa += a * a;
+                ab += a * b;
+                bb += b * b;
+                for(int c = 0; c < 3; c++)
+                {
+                    ax[c] += a * texels[i][c];
+                    bx[c] += b * texels[i][c];
+                }
+            }
+            float det = aa * bb - ab * ab;
+            if(std::fabs(det) > 1e-6f)
+            {
+                float f0[3], f1[3];
+                for(int c = 0; c < 3; c++)
+                {
+                    f0[c] = (ax[c] * bb - bx[c] * ab) / det;
+                    f1[c] = (bx[c] * aa - ax[c] * ab) / det;
+                }
+                uint16_t r0 = To565(f0);
+                uint16_t r1 = To565(f1);
+                if(r0 < r1)
+                    std::swap(r0, r1);
+
+                uint32_t refit = 0;
+                uint32_t refit_error = r0 == r1 ? UINT32_MAX : PickColorIndices(texels, r0, r1, refit);
+                if(refit_error < error)
+                {
+                    c0 = r0;
+                    c1 = r1;
+                    indices = refit;
+                }
+            }
+        }
+
+        if(c0 == c1)
+            indices = 0;
+
+        out[0] = static_cast<uint8_t>(c0);
+        out[1] = static_cast<uint8_t>(c0 >> 8);
+        out[2] = static_cast<uint8_t>(c1);
+        out[3] = static_cast<uint8_t>(c1 >> 8);
+        for(int k = 0; k < 4; k++)
+            out[4 + k] = static_cast<uint8_t>(indices >> (8 * k));
+    }
+
+    // eight alpha mode: a0 > a1, indices 2..7 interpolate between them
+    void EncodeAlphaBlock(const uint8_t (*texels)[4], uint8_t * out)
+    {
+        int a0 = 0;
+        int a1 = 255;
+        for(int i = 0; i < 16; i++)
+        {
+            a0 = std::max<int>(a0, texels[i][3]);
+            a1 = std::min<int>(a1, texels[i][3]);
+        }
+
+        uint64_t indices = 0;
+        if(a0 > a1)
+        {
+            int palette[8] = {a0, a1};
+            for(int p = 1; p < 7; p++)
+                palette[p + 1] = ((7 - p) * a0 + p * a1) / 7;
+
+            for(int i = 0; i < 16; i++)
+            {
+                int best = 256;
+                uint64_t best_index = 0;
+                for(int p = 0; p < 8; p++)
+                {
+                    int d = std::abs(texels[i][3] - palette[p]);
+                    if(d < best)
+                    {
+                        best = d;
+                        best_index = static_cast<uint64_t>(p);
+                    }
+                }
+                indices |= best_index << (3 * i);
+            }
+        }
+
+        out[0] = static_cast<uint8_t>(a0);
+        out[1] = static_cast<uint8_t>(a1);
+        for(int k = 0; k < 6; k++)
+            out[2 + k] = static_cast<uint8_t>(indices >> (8 * k));
+    }
+
+    void EncodeBlockRow(const TextureData::Level & level, uint32_t by, bool alpha, uint8_t * out)
+    {
+        uint32_t blocks_x = (level.width + 3) / 4;
+        for(uint32_t bx = 0; bx < blocks_x; bx++)
+        {
+            uint8_t texels[16][4];
+            for(uint32_t y = 0; y < 4; y++)
+            {
+                uint32_t sy = std::min(by * 4 + y, level.height - 1);
+                for(uint32_t x = 0; x < 4; x++)
+                {
+                    uint32_t sx = std::min(bx * 4 + x, level.width - 1);
+                    std::memcpy(texels[y * 4 + x], &level.data[(size_t(sy) * level.width + sx) * 4], 4);
+                }
+            }
+
+            if(alpha)
+            {
+                EncodeAlphaBlock(texels, out);
+                out += 8;
+            }
+            EncodeColorBlock(texels, out);
+            out += 8;
+        }
+    }
+}
+
+void DownsampleBoxScalar(const uint8_t * src, uint32_t w, uint32_t h, uint8_t * dst)
+{
+    uint32_t dw = Half(w);
+    uint32_t dh = Half(h);
+    for(uint32_t y = 0; y < dh; y++)
+    {
+        const uint8_t * row0 = src + size_t(Clamp(2 * int64_t(y), h)) * w * 4;
+        const uint8_t * row1 = src + size_t(Clamp(2 * int64_t(y) + 1, h)) * w * 4;
+        uint8_t *       out = dst + size_t(y) * dw * 4;
+        for(uint32_t x = 0; x < dw; x++)
+        {
+            uint32_t x0 = Clamp(2 * int64_t(x), w) * 4;
+            uint32_t x1 = Clamp(2 * int64_t(x) + 1, w) * 4;
+            for(int c = 0; c < 4; c++)
+                out[x * 4 + c] = static_cast<uint8_t>((row0[x0 + c] + row0[x1 + c]
+                                                       + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+        }
+    }
+}
+
+void DownsampleKaiserScalar(const uint8_t * src, uint32_t w, uint32_t h, uint8_t * dst)
+{
+    uint32_t dw = Half(w);
+    uint32_t dh = Half(h);
+    const float * weights = KaiserWeights();
+
+    std::vector<float> tmp(size_t(dw) * h * 4);
+    for(uint32_t y = 0; y < h; y++)
+    {
+        const uint8_t * row = src + size_t(y) * w * 4;
+        float *         out = &tmp[size_t(y) * dw * 4];
+        for(uint32_t x = 0; x < dw; x++)
+        {
+            for(int c = 0; c < 4; c++)
+            {
+                float acc = 0.0f;
+                for(int k = 0; k < KAISER_TAPS; k++)
+                    acc += weights[k] * row[Clamp(2 * int64_t(x) - 2 + k, w) * 4 + c];
+                out[x * 4 + c] = acc;
+            }
+        }
+    }
+
+    for(uint32_t y = 0; y < dh; y++)
+    {
+        uint8_t * out = dst + size_t(y) * dw * 4;
+        for(uint32_t x = 0; x < dw * 4; x++)
+        {
+            float acc = 0.0f;
+            for(int k = 0; k < KAISER_TAPS; k++)
+                acc += weights[k] * tmp[size_t(Clamp(2 * int64_t(y) - 2 + k, h)) * dw * 4 + x];
+            out[x] = ToByte(acc);
+        }
+    }
+}
+
+bool BuildTexture(const ImageData & id, TextureData & tex)
+{
+    if(!id.Pixels() || id.width == 0 || id.height == 0 || id.type == ImageData::PixelType::pt_none)
+        return false;
+
+    tex.format = TextureData::Format::tf_rgba8;
+    tex.opaque = true;
+    tex.levels.resize(1);
+    tex.image.reset();
+    tex.generateMips = false;
+
+    TextureData::Level & level = tex.levels[0];
+    level.width = id.width;
+    level.height = id.height;
+    level.data.resize(size_t(id.width) * id.height * 4);
+
+    // row by row, a view of a file may be padded and in BGR order
+    bool   bgr = id.order == ImageData::ChannelOrder::co_bgr;
+    size_t row_bytes = size_t(id.width) * 4;
+    for(uint32_t y = 0; y < id.height; y++)
+    {
+        const uint8_t * src = id.Row(y);
+        uint8_t *       dst = level.data.data() + y * row_bytes;
+        if(id.type == ImageData::PixelType::pt_rgba && !bgr)
+        {
+            std::memcpy(dst, src, row_bytes);
+            for(uint32_t i = 0; i < id.width && tex.opaque; i++)
+                tex.opaque = src[i * 4 + 3] == 255;
+        }
+        else if(id.type == ImageData::PixelType::pt_rgba)
+        {
+            for(uint32_t i = 0; i < id.width; i++)
+            {
+                dst[i * 4] = src[i * 4 + 2];
+                dst[i * 4 + 1] = src[i * 4 + 1];
+                dst[i * 4 + 2] = src[i * 4];
+                dst[i * 4 + 3] = src[i * 4 + 3];
+                tex.opaque = tex.opaque && src[i * 4 + 3] == 255;
+            }
+        }
+        else
+        {
+            for(uint32_t i = 0; i < id.width; i++)
+            {
+                dst[i * 4] = src[i * 3 + (bgr ? 2 : 0)];
+                dst[i * 4 + 1] = src[i * 3 + 1];
+                dst[i * 4 + 2] = src[i * 3 + (bgr ? 0 : 2)];
+                dst[i * 4 + 3] = 255;
+            }
+        }
+    }
+    return true;
+}
+
+bool BuildMipChain(const ImageData & id, MipFilter filter, TextureData & tex)
+{
+    if(!BuildTexture(id, tex))
+        return false;
+
+    while(tex.levels.back().width > 1 || tex.levels.back().height > 1)
+    {
+        const TextureData::Level & prev = tex.levels.back();
+        TextureData::Level next;
+        next.width = Half(prev.width);
+        next.height = Half(prev.height);
+        next.data.resize(size_t(next.width) * next.height * 4);
+        Downsample(prev.data.data(), prev.width, prev.height,
+                   filter == MipFilter::mf_driver ? MipFilter::mf_box : filter, next.data.data());
+        tex.levels.push_back(std::move(next));
+    }
+    return true;
+}
+
+bool CompressBC(TextureData & tex, ThreadPool * pool)
+{
+    if(tex.format != TextureData::Format::tf_rgba8 || tex.levels.empty() || tex.image || tex.generateMips)
+        return false;
+
+    ThreadPool & threads = pool ? *pool : ThreadPool::Global();
+    bool         alpha = !tex.opaque;
+    size_t       block_bytes = alpha ? 16 : 8;
+
+    for(TextureData::Level & level : tex.levels)
+    {
+        uint32_t blocks_x = (level.width + 3) / 4;
+        uint32_t blocks_y = (level.height + 3) / 4;
+        size_t   row_bytes = blocks_x * block_bytes;
+
+        std::vector<uint8_t> blocks(row_bytes * blocks_y);
+        threads.ParallelFor(blocks_y, [&](uint32_t by)
+        {
+            EncodeBlockRow(level, by, alpha, &blocks[by * row_bytes]);
+        });
+        level.data = std::move(blocks);
+    }
+
+    tex.format = alpha ? TextureData::Format::tf_bc3 : TextureData::Format::tf_bc1;
+    return true;
+}
+
+bool BuildTexture(const ImageData & id, const TextureOptions & opt, TextureData & tex, ThreadPool * pool)
+{
+    if(opt.ZeroCopy())
+    {
+        bool res = true;
+        if(id.IsView())
+        {
+            // the texture keeps the file mapped until it is uploaded
+            auto view = std::make_shared<ImageData>();
+            view->width = id.width;
+            view->height = id.height;
+            view->type = id.type;
+            view->order = id.order;
+            view->stride = id.stride;
+            view->view = id.view;
+            view->mapping = id.mapping;
+
+            tex.format = TextureData::Format::tf_rgba8;
+            tex.opaque = id.type == ImageData::PixelType::pt_rgb;
+            tex.levels.assign(1, TextureData::Level{id.width, id.height, std::vector<uint8_t>()});
+            tex.image = std::move(view);
+        }
+        else
+        {
+            res = BuildTexture(id, tex);
+        }
+        tex.generateMips = opt.mipmaps;
+        return res;
+    }
+
+    bool res = opt.mipmaps ? BuildMipChain(id, opt.filter, tex) : BuildTexture(id, tex);
+    if(res && opt.compress)
+        res = CompressBC(tex, pool);
+    return res;
+}
@@ -0,0 +1,83 @@
+#ifndef TEXTUREDATA_H
+#define TEXTUREDATA_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "ImageData.h"
+
+class ThreadPool;
+
+//! Texture ready for upload: a mip chain, raw or block compressed
+/*!
+    Levels go from the full image down to 1x1, each half the size of the
+    previous one rounded down. Raw levels are RGBA8 rows, lower-left
+    origin like ImageData; compressed levels are 4x4 blocks in the same
+    row order, partial blocks at the edges padded by repeating the last
+    row and column.
+
+    A raw level 0 may instead be left in the mapped image file, image
+    holds the view and levels[0] only its size; levels past 0 may be left
+    to the driver.
+*/
+struct TextureData
+{
+    enum class Format
+    {
+        tf_rgba8,
+        tf_bc1,                          // opaque, 8 bytes per block
+        tf_bc3,                          // with alpha, 16 bytes per block
+        tf_none
+    };
+
+    struct Level
+    {
+        uint32_t             width;
+        uint32_t             height;
+        std::vector<uint8_t> data;
+    };
+
+    Format                           format;
+    bool                             opaque;           // every alpha 255, BC1 loses nothing
+    std::vector<Level>               levels;
+    std::shared_ptr<const ImageData> image;            // level 0 still in its file, uploaded from there
+    bool                             generateMips;     // levels past 0 built by the driver at upload
+
+    TextureData() : format(Format::tf_none), opaque(true), generateMips(false) {}
+};
+
+enum class MipFilter
+{
+    mf_box,                              // 2x2 average
+    mf_kaiser,                           // 6-tap Kaiser windowed sinc, sharper minification
+    mf_driver                            // glGenerateMipmap at upload; box on the CPU for compressed textures
+};
+
+struct TextureOptions
+{
+    bool      mipmaps;
+    MipFilter filter;
+    bool      compress;                  // BC1 for opaque images, BC3 otherwise
+
+    TextureOptions() : mipmaps(true), filter(MipFilter::mf_kaiser), compress(false) {}
+
+    //! Level 0 goes to GL as the image is, so an image mapped from its file needs no copy
+    bool ZeroCopy() const { return !compress && (!mipmaps || filter == MipFilter::mf_driver); }
+};
+
+//! Level 0 from id, then every smaller level filtered from the previous one
+bool BuildMipChain(const ImageData & id, MipFilter filter, TextureData & tex);
+//! Level 0 from id only
+bool BuildTexture(const ImageData & id, TextureData & tex);
+//! Mip chain and compression as the options ask, pool null for the global one
+/*! A view from MapImage() is shared rather than converted when opt.ZeroCopy() */
+bool BuildTexture(const ImageData & id, const TextureOptions & opt, TextureData & tex, ThreadPool * pool = nullptr);
+
+//! Encode the raw levels of tex to BC1 or BC3, rows of blocks spread over pool
+bool CompressBC(TextureData & tex, ThreadPool * pool = nullptr);
+
+// Scalar versions of the filters, the reference for the SSE2 ones
+void DownsampleBoxScalar(const uint8_t * src, uint32_t w, uint32_t h, uint8_t * dst);
+void DownsampleKaiserScalar(const uint8_t * src, uint32_t w, uint32_t h, uint8_t * dst);
+
+#endif // TEXTUREDATA_H
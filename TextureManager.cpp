@@ -0,0 +1,345 @@
+#include "TextureManager.h"
+#include "AssetCache.h"
+#include "LoadMonitor.h"
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QtConcurrent>
+#include <QDebug>
+#include <algorithm>
+#include <filesystem>
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_TEXTURE_MAX_LEVEL
+#define GL_TEXTURE_MAX_LEVEL 0x813D
+#endif
+#ifndef GL_BGR
+#define GL_BGR 0x80E0
+#endif
+#ifndef GL_BGRA
+#define GL_BGRA 0x80E1
+#endif
+#ifndef GL_UNPACK_ROW_LENGTH
+#define GL_UNPACK_ROW_LENGTH 0x0CF2
+#endif
+
+namespace fs = std::filesystem;
+
+TextureManager::TextureManager(AssetCache * cache) : _cache(cache),
+                                                     _uploads(0),
+                                                     _shared(0)
+{
+}
+
+void TextureManager::SetOptions(const TextureOptions & opt)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _options = opt;
+}
+
+std::string TextureManager::ResolvePath(const std::string & base_dir, const std::string & name)
+{
+    fs::path p(name);
+    if(p.is_relative() && !base_dir.empty())
+        p = fs::path(base_dir) / p;
+
+    std::error_code ec;
+    fs::path canonical = fs::weakly_canonical(p, ec);
+    return (ec ? p : canonical).string();
+}
+
+bool TextureManager::Prefetch(const std::vector<std::string> & paths, LoadMonitor * monitor)
+{
+    struct Item
+    {
+        std::string path;
+        uint64_t    identity;
+        bool        hashed;
+        bool        decode;
+        bool        decoded;
+        TextureData texture;
+    };
+
+    // paths hashed before keep their identity, they are listed to be counted as needed below
+    std::vector<Item> items;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for(const std::string & path : paths)
+        {
+            bool listed = std::any_of(items.begin(), items.end(),
+                                      [&path](const Item & it) { return it.path == path; });
+            if(listed)
+                continue;
+
+            auto identity = _identities.find(path);
+            bool known = identity != _identities.end();
+            items.push_back(Item{path, known ? identity->second : 0, known, false, false, TextureData()});
+        }
+    }
+
+    // hashing maps each file once, cheap next to decoding but still worth spreading
+    QtConcurrent::blockingMap(items, [monitor](Item & it)
+    {
+        if(!it.hashed && (!monitor || !monitor->IsCancelled()))
+            it.hashed = AssetCache::HashFile(it.path, it.identity);
+    });
+
+    // decode each identity once, skipping the ones already alive or waiting
+    TextureOptions opt;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        opt = _options;
+        for(size_t i = 0; i < items.size(); i++)
+        {
+            Item & it = items[i];
+            if(!it.hashed)
+                continue;
+            bool known = _textures.count(it.identity) > 0 || _pending.count(it.identity) > 0;
+            bool repeated = std::any_of(items.begin(), items.begin() + i,
+                                        [&it](const Item & o) { return o.hashed && o.identity == it.identity; });
+            it.decode = !known && !repeated;
+            if(!repeated)
+                _inFlight[it.identity]++;
+        }
+    }
+
+    AssetCache * cache = _cache;
+    QtConcurrent::blockingMap(items, [cache, opt, monitor](Item & it)
+    {
+        if(!it.decode || (monitor && monitor->IsCancelled()))
+            return;
+
+        if(cache)
+        {
+            it.decoded = cache->LoadTexture(it.path, opt, it.texture);
+        }
+        else
+        {
+            ImageData id;
+            bool read = (opt.ZeroCopy() && MapImage(it.path, id)) || ReadImage(it.path, id);
+            it.decoded = read && BuildTexture(id, opt, it.texture);
+        }
+    });
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    for(size_t i = 0; i < items.size(); i++)
+    {
+        const Item & it = items[i];
+        bool repeated = std::any_of(items.begin(), items.begin() + i,
+                                    [&it](const Item & o) { return o.hashed && o.identity == it.identity; });
+        if(!it.hashed || repeated)
+            continue;
+
+        auto owners = _inFlight.find(it.identity);
+        if(--owners->second == 0)
+            _inFlight.erase(owners);
+    }
+
+    // an abandoned load records nothing, the images were not all decoded
+    if(monitor && monitor->IsCancelled())
+        return false;
+
+    bool res = true;
+    for(Item & it : items)
+    {
+        if(!it.hashed || (it.decode && !it.decoded))
+        {
+            // not recorded, the next Prefetch() or Acquire() tries again
+            qDebug() << "Fail to load texture" << it.path.c_str();
+            res = false;
+            continue;
+        }
+
+        _identities[it.path] = it.identity;
+        if(it.decode)
+            _pending[it.identity] = std::move(it.texture);
+    }
+    return res;
+}
+
+unsigned int TextureManager::Acquire(const std::string & path)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    auto identity = _identities.find(path);
+    if(identity == _identities.end())
+    {
+        // not prefetched, load it here
+        lock.unlock();
+        if(!Prefetch({path}))
+            return 0;
+        lock.lock();
+        identity = _identities.find(path);
+        if(identity == _identities.end())
+            return 0;
+    }
+
+    auto texture = _textures.find(identity->second);
+    if(texture != _textures.end())
+    {
+        texture->second.refs++;
+        _shared++;
+        return texture->second.tex;
+    }
+
+    auto pending = _pending.find(identity->second);
+    if(pending == _pending.end())
+    {
+        // hashed by a Prefetch() that is still decoding, or whose image failed
+        return 0;
+    }
+
+    const TextureData & data = pending->second;
+    Texture t;
+    t.tex = Upload(data);
+    t.refs = 1;
+    t.bytes = data.image ? uint64_t(data.image->Stride()) * data.image->height : 0;
+    for(const TextureData::Level & level : data.levels)
+        t.bytes += level.data.size();
+    _textures[identity->second] = t;
+    _pending.erase(pending);
+    _uploads++;
+    return t.tex;
+}
+
+void TextureManager::Release(unsigned int tex)
+{
+    if(tex == 0)
+        return;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    for(auto & entry : _textures)
+    {
+        if(entry.second.tex == tex)
+        {
+            if(entry.second.refs > 0)
+                entry.second.refs--;
+            return;
+        }
+    }
+}
+
+void TextureManager::Purge()
+{
+    QOpenGLFunctions * gl = QOpenGLContext::currentContext() ? QOpenGLContext::currentContext()->functions() : nullptr;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    for(auto entry = _textures.begin(); entry != _textures.end();)
+    {
+        if(entry->second.refs > 0 || _inFlight.count(entry->first) > 0)
+        {
+            ++entry;
+            continue;
+        }
+
+        if(gl)
+            gl->glDeleteTextures(1, &entry->second.tex);
+        entry = _textures.erase(entry);
+    }
+
+    // images a Prefetch() still running counts on stay, like the textures above: it found them
+    // known and did not decode them
+    for(auto entry = _pending.begin(); entry != _pending.end();)
+    {
+        if(_inFlight.count(entry->first) > 0)
+            ++entry;
+        else
+            entry = _pending.erase(entry);
+    }
+
+    // forget the paths of images gone, a file edited since is hashed anew
+    for(auto path = _identities.begin(); path != _identities.end();)
+    {
+        if(_textures.count(path->second) > 0 || _pending.count(path->second) > 0)
+            ++path;
+        else
+            path = _identities.erase(path);
+    }
+}
+
+TextureManager::Stats TextureManager::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    Stats st = Stats();
+    for(const auto & entry : _textures)
+    {
+        st.textures++;
+        st.references += entry.second.refs;
+        st.bytes += entry.second.bytes;
+    }
+    st.uploads = _uploads;
+    st.shared = _shared;
+    return st;
+}
+
+unsigned int TextureManager::Upload(const TextureData & tex)
+{
+    QOpenGLFunctions * gl = QOpenGLContext::currentContext()->functions();
+
+    unsigned int tex_name = 0;
+    gl->glGenTextures(1, &tex_name);
+    gl->glBindTexture(GL_TEXTURE_2D, tex_name);
+
+    GLenum compressed = tex.format == TextureData::Format::tf_bc1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+                                                                   : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for(size_t i = 0; i < tex.levels.size(); i++)
+    {
+        const TextureData::Level & level = tex.levels[i];
+        if(i == 0 && tex.image)
+        {
+            UploadView(*tex.image);
+        }
+        else if(tex.format == TextureData::Format::tf_rgba8)
+        {
+            gl->glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), GL_RGBA, level.width, level.height, 0,
+                             GL_RGBA, GL_UNSIGNED_BYTE, level.data.data());
+        }
+        else
+        {
+            gl->glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), compressed, level.width, level.height,
+                                       0, static_cast<GLsizei>(level.data.size()), level.data.data());
+        }
+    }
+    gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    // a chain ends at 1x1, a single level must not be sampled as incomplete
+    bool mipmapped = tex.levels.size() > 1 || tex.generateMips;
+    if(tex.generateMips)
+        gl->glGenerateMipmap(GL_TEXTURE_2D);
+    else
+        gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(tex.levels.size()) - 1);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mipmapped ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    gl->glBindTexture(GL_TEXTURE_2D, 0);
+    return tex_name;
+}
+
+void TextureManager::UploadView(const ImageData & id)
+{
+    QOpenGLFunctions * gl = QOpenGLContext::currentContext()->functions();
+
+    // rows as the file has them: packed, padded to the alignment, or a row length apart
+    GLint    alignment = 1;
+    GLint    row_length = 0;
+    uint32_t row_bytes = id.width * id.BytesPerPixel();
+    if(id.Stride() != row_bytes)
+    {
+        if(id.Stride() == ((row_bytes + 3) & ~3u))
+            alignment = 4;
+        else
+            row_length = static_cast<GLint>(id.Stride() / id.BytesPerPixel());
+    }
+
+    bool   bgr = id.order == ImageData::ChannelOrder::co_bgr;
+    GLenum format = id.type == ImageData::PixelType::pt_rgb ? (bgr ? GL_BGR : GL_RGB) : (bgr ? GL_BGRA : GL_RGBA);
+    gl->glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+    gl->glPixelStorei(GL_UNPACK_ROW_LENGTH, row_length);
+    gl->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, id.width, id.height, 0, format, GL_UNSIGNED_BYTE, id.Pixels());
+    gl->glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+}
@@ -0,0 +1,90 @@
+#ifndef TEXTUREMANAGER_H
+#define TEXTUREMANAGER_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "TextureData.h"
+
+class AssetCache;
+class LoadMonitor;
+
+//! GL textures shared by every user of the same image
+/*!
+    Images are identified by the hash of their file contents, so
+    submeshes naming the same material, and differently named copies of
+    one file, end up on a single GL texture uploaded once.
+
+    Prefetch() hashes and decodes a set of images in parallel on any
+    thread; Acquire() runs on the GUI thread with the context current,
+    uploads what was prefetched and counts a reference. Images are turned
+    into textures as SetOptions() asks, mip chain and BC compression
+    included, on the prefetching thread and through the asset cache;
+    options that take an image as it is leave it in its mapped file until
+    Acquire() uploads it from there.
+
+    Textures whose last reference is released stay alive until Purge(),
+    so a reload that acquires the new set before purging keeps the
+    textures both sets share without uploading them again.
+*/
+class TextureManager
+{
+public:
+    struct Stats
+    {
+        uint32_t textures;               // GL textures alive
+        uint32_t references;
+        uint64_t bytes;                  // pixel data held by the textures
+        uint64_t uploads;
+        uint64_t shared;                 // acquisitions served by a texture already alive
+    };
+
+    explicit TextureManager(AssetCache * cache = nullptr);
+
+    //! Processing of images decoded from now on; compress only where the context supports S3TC
+    void                   SetOptions(const TextureOptions & opt);
+    const TextureOptions & Options() const { return _options; }
+
+    //! Path of a material texture, names are relative to the directory of the mesh
+    static std::string ResolvePath(const std::string & base_dir, const std::string & name);
+
+    //! Decode the images not yet known, in parallel; false if any failed or the monitor was cancelled
+    bool Prefetch(const std::vector<std::string> & paths, LoadMonitor * monitor = nullptr);
+
+    //! Texture of an image with one more reference, 0 if it can not be loaded; context must be current
+    unsigned int Acquire(const std::string & path);
+    void         Release(unsigned int tex);
+
+    //! Delete the textures nobody references and drop decoded images never acquired
+    /*! Images and textures a Prefetch() still running needs are kept, it relies on them instead of decoding */
+    void Purge();
+
+    Stats GetStats() const;
+
+private:
+    struct Texture
+    {
+        unsigned int tex;
+        uint32_t     refs;
+        uint64_t     bytes;
+    };
+
+    // GL texture of all levels, the context must be current
+    static unsigned int Upload(const TextureData & tex);
+    // level 0 straight from a view of its file, in the order and row stride the file has
+    static void         UploadView(const ImageData & id);
+
+    AssetCache *                    _cache;
+    TextureOptions                  _options;
+    mutable std::mutex              _mutex;          // guards the maps, Prefetch() may run on any thread
+    std::map<std::string, uint64_t> _identities;     // path -> content hash
+    std::map<uint64_t, TextureData> _pending;        // decoded, not uploaded yet
+    std::map<uint64_t, uint32_t>    _inFlight;       // identity -> Prefetch() calls running that need it
+    std::map<uint64_t, Texture>     _textures;
+    uint64_t                        _uploads;
+    uint64_t                        _shared;
+};
+
+#endif // TEXTUREMANAGER_H
@@ -0,0 +1,107 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace
+{
+    // pool whose loop the current thread is working on
+    thread_local const ThreadPool * t_currentPool = nullptr;
+}
+
+ThreadPool::ThreadPool(unsigned int num_threads) : _task(nullptr),
+                                                   _ctx(nullptr),
+                                                   _count(0),
+                                                   _next(0),
+                                                   _busy(0),
+                                                   _generation(0),
+                                                   _quit(false)
+{
+    if(num_threads == 0)
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    _workers.reserve(num_threads - 1);
+    for(unsigned int i = 1; i < num_threads; i++)
+        _workers.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _quit = true;
+    }
+    _wake.notify_all();
+
+    for(auto & worker : _workers)
+        worker.join();
+}
+
+ThreadPool & ThreadPool::Global()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::Run(uint32_t count, TaskFunc task, void * ctx)
+{
+    if(count == 0)
+        return;
+
+    if(_workers.empty() || count == 1 || t_currentPool == this)
+    {
+        for(uint32_t i = 0; i < count; i++)
+            task(ctx, i);
+        return;
+    }
+
+    std::lock_guard<std::mutex> run_lock(_runMutex);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _task = task;
+        _ctx = ctx;
+        _count = count;
+        _next.store(0, std::memory_order_relaxed);
+        _busy = static_cast<uint32_t>(_workers.size());
+        _generation++;
+    }
+    _wake.notify_all();
+
+    const ThreadPool * prev_pool = t_currentPool;
+    t_currentPool = this;
+    Drain();
+    t_currentPool = prev_pool;
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _done.wait(lock, [this] { return _busy == 0; });
+}
+
+void ThreadPool::WorkerLoop()
+{
+    t_currentPool = this;
+
+    uint64_t seen_generation = 0;
+    for(;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wake.wait(lock, [&] { return _quit || _generation != seen_generation; });
+            if(_quit)
+                return;
+            seen_generation = _generation;
+        }
+
+        Drain();
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        if(--_busy == 0)
+            _done.notify_one();
+    }
+}
+
+void ThreadPool::Drain()
+{
+    for(uint32_t i = _next.fetch_add(1, std::memory_order_relaxed); i < _count;
+        i = _next.fetch_add(1, std::memory_order_relaxed))
+    {
+        _task(_ctx, i);
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+//! Fixed set of worker threads running data-parallel loops
+/*!
+    ParallelFor hands out loop indices through an atomic counter; the
+    calling thread works on the loop too and returns when every index
+    is done. Dispatching a loop does not allocate. Loops from different
+    threads run one after another, and a ParallelFor issued from inside
+    a running task is executed inline on the current thread.
+    Tasks must not throw.
+*/
+class ThreadPool
+{
+public:
+    //! \param[in] num_threads threads taking part in a loop, the caller included; 0 picks one per core
+    explicit ThreadPool(unsigned int num_threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned int NumThreads() const { return static_cast<unsigned int>(_workers.size()) + 1; }
+
+    //! Call func(i) for every i in [0, count) and wait for completion
+    template<typename Func>
+    void ParallelFor(uint32_t count, Func && func)
+    {
+        typedef typename std::remove_reference<Func>::type FuncType;
+        Run(count, [](void * ctx, uint32_t i) { (*static_cast<FuncType *>(ctx))(i); },
+            const_cast<void *>(static_cast<const void *>(&func)));
+    }
+
+    //! Pool shared by the asset loaders
+    static ThreadPool & Global();
+
+private:
+    typedef void (*TaskFunc)(void *, uint32_t);
+
+    void Run(uint32_t count, TaskFunc task, void * ctx);
+    void WorkerLoop();
+    void Drain();
+
+    std::vector<std::thread> _workers;
+    std::mutex               _runMutex;         // serializes loops from different callers
+    std::mutex               _mutex;
+    std::condition_variable  _wake;
+    std::condition_variable  _done;
+
+    TaskFunc                 _task;
+    void *                   _ctx;
+    uint32_t                 _count;
+    std::atomic<uint32_t>    _next;
+    uint32_t                 _busy;             // workers still inside the current loop
+    uint64_t                 _generation;
+    bool                     _quit;
+};
+
+#endif // THREADPOOL_H
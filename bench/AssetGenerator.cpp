@@ -0,0 +1,394 @@
+#include "AssetGenerator.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+    #pragma pack(push, 1)
+    struct BMPFILEHEADER
+    {
+        uint16_t bfType;
+        uint32_t bfSize;
+        uint16_t bfReserved1;
+        uint16_t bfReserved2;
+        uint32_t bfOffBits;
+    };
+
+    struct BMPINFOHEADER
+    {
+        uint32_t biSize;
+        int32_t  biWidth;
+        int32_t  biHeight;
+        uint16_t biPlanes;
+        uint16_t biBitCount;
+        uint32_t biCompression;
+        uint32_t biSizeImage;
+        int32_t  biXPelsPerMeter;
+        int32_t  biYPelsPerMeter;
+        uint32_t biClrUsed;
+        uint32_t biClrImportant;
+    };
+
+    struct TGAFILEHEADER
+    {
+        uint8_t  idlength;
+        uint8_t  colourmaptype;
+        uint8_t  datatypecode;
+        uint16_t colourmaporigin;
+        uint16_t colourmaplength;
+        uint8_t  colourmapdepth;
+        uint16_t x_origin;
+        uint16_t y_origin;
+        uint16_t width;
+        uint16_t height;
+        uint8_t  bitsperpixel;
+        uint8_t  imagedescriptor;
+    };
+    #pragma pack(pop)
+
+    const float PI = 3.14159265f;
+    const uint32_t RING_SEGMENTS = 64;
+
+    // line buffered text output, std::ofstream per value is several times slower
+    class TextWriter
+    {
+    public:
+        explicit TextWriter(const std::string & fname) : _ofs(fname, std::ios::out | std::ios::binary)
+        {
+            _buffer.reserve(1 << 20);
+        }
+
+        ~TextWriter() { Flush(); }
+
+        bool IsOpen() const { return _ofs.is_open(); }
+
+        template<typename... Args>
+        void Line(const char * format, Args... args)
+        {
+            char line[256];
+            int len = std::snprintf(line, sizeof(line), format, args...);
+            _buffer.insert(_buffer.end(), line, line + std::min<int>(len, sizeof(line) - 1));
+            _buffer.push_back('\n');
+            if(_buffer.size() >= (1 << 20))
+                Flush();
+        }
+
+        bool Flush()
+        {
+            _ofs.write(_buffer.data(), _buffer.size());
+            _buffer.clear();
+            return static_cast<bool>(_ofs);
+        }
+
+    private:
+        std::ofstream     _ofs;
+        std::vector<char> _buffer;
+    };
+
+    // small deterministic generator, identical output on every platform
+    struct Lcg
+    {
+        uint32_t state;
+
+        uint32_t Next()
+        {
+            state = state * 1664525u + 1013904223u;
+            return state >> 8;
+        }
+    };
+
+    uint32_t BytesPerPixel(const ImageData & id)
+    {
+        return id.type == ImageData::PixelType::pt_rgb ? 3 : 4;
+    }
+
+    // ImageData keeps RGB(A), files store BGR(A)
+    void ToBGR(const uint8_t * src, uint8_t * dst, uint32_t bytes_per_pixel)
+    {
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+        if(bytes_per_pixel == 4)
+            dst[3] = src[3];
+    }
+
+    // influences of a vertex at height y: with varying counts, vertices mid-bone
+    // are rigid and the count grows towards the joints at integer heights
+    uint32_t VertexInfluences(float y, uint32_t influences, bool varying)
+    {
+        if(!varying)
+            return influences;
+
+        float    frac = y - std::floor(y);
+        float    joint_dist = std::min(frac, 1.0f - frac);
+        uint32_t count = joint_dist > 0.25f ? 1 : joint_dist > 0.15f ? 2 : joint_dist > 0.05f ? 3 : 4;
+        return std::min(count, influences);
+    }
+}
+
+bool AssetGenerator::WriteMsh(const std::string & fname, const MeshParams & params, uint32_t * num_tris)
+{
+    TextWriter out(fname);
+    if(!out.IsOpen())
+    {
+        std::cerr << "Error opening file: " << fname << std::endl;
+        return false;
+    }
+
+    uint32_t influences = std::max(1u, std::min(4u, std::min(params.influences, params.bones)));
+    uint32_t rings = std::max(2u, params.vertices / RING_SEGMENTS);
+    float    height = static_cast<float>(params.bones);
+    float    ring_step = height / (rings - 1);
+
+    // only complete ring pairs are triangulated, a partial last ring stays unindexed
+    uint32_t full_rings = std::min(rings, params.vertices / RING_SEGMENTS);
+    uint32_t tris = full_rings > 1 ? (full_rings - 1) * RING_SEGMENTS * 2 : 0;
+    if(num_tris)
+        *num_tris = tris;
+
+    out.Line("meshes %u", params.submeshes);
+    for(uint32_t m = 0; m < params.submeshes; m++)
+    {
+        out.Line("mesh %u", m);
+        out.Line("material synthetic_%u.tga", m);
+        out.Line("bbox %g %g %g %g %g %g", -1.0f, 0.0f, -1.0f, 1.0f, height, 1.0f);
+        out.Line("tex_channels 1");
+        uint32_t num_weights = 0;
+        for(uint32_t i = 0; i < params.vertices; i++)
+            num_weights += VertexInfluences(std::min(height, (i / RING_SEGMENTS) * ring_step), influences, params.varying);
+        out.Line("weights %u", num_weights);
+
+        uint32_t weight_end = 0;
+        for(uint32_t i = 0; i < params.vertices; i++)
+        {
+            uint32_t ring = i / RING_SEGMENTS;
+            uint32_t seg = i % RING_SEGMENTS;
+            float    angle = 2.0f * PI * seg / RING_SEGMENTS;
+            float    c = std::cos(angle);
+            float    s = std::sin(angle);
+            float    y = std::min(height, ring * ring_step);
+            uint32_t count = VertexInfluences(y, influences, params.varying);
+
+            out.Line("vtx %.6f %.6f %.6f", c, y, s);
+            out.Line("vnr %.6f %.6f %.6f", c, 0.0f, s);
+            out.Line("tx 0 %.6f %.6f", static_cast<float>(seg) / RING_SEGMENTS, y / height);
+
+            // nearest bones along the axis, weights fall off linearly with distance
+            int first = static_cast<int>(std::floor(y)) - static_cast<int>(count - 1) / 2;
+            first = std::max(0, std::min(first, static_cast<int>(params.bones - count)));
+            float w[4];
+            float sum = 0.0f;
+            for(uint32_t k = 0; k < count; k++)
+            {
+                float center = first + k + 0.5f;
+                w[k] = std::max(0.05f, 1.0f - std::abs(y - center) / count);
+                sum += w[k];
+            }
+
+            weight_end += count;
+            out.Line("wgi %u", weight_end);
+            for(uint32_t k = 0; k < count; k++)
+                out.Line("wgh %u %.6f", first + k + 1, w[k] / sum);      // joints are 1-based
+        }
+
+        for(uint32_t r = 0; r + 1 < full_rings; r++)
+        {
+            for(uint32_t seg = 0; seg < RING_SEGMENTS; seg++)
+            {
+                uint32_t a = r * RING_SEGMENTS + seg;
+                uint32_t b = r * RING_SEGMENTS + (seg + 1) % RING_SEGMENTS;
+                out.Line("fcx %u %u %u", a, a + RING_SEGMENTS, b);
+                out.Line("fcx %u %u %u", b, a + RING_SEGMENTS, b + RING_SEGMENTS);
+            }
+        }
+    }
+
+    return out.Flush();
+}
+
+bool AssetGenerator::WriteAnm(const std::string & fname, const AnimParams & params)
+{
+    TextWriter out(fname);
+    if(!out.IsOpen())
+    {
+        std::cerr << "Error opening file: " << fname << std::endl;
+        return false;
+    }
+
+    out.Line("bones %u", params.bones);
+    out.Line("frames %u", params.frames);
+    out.Line("framerate %g", params.frameRate);
+    for(uint32_t f = 0; f < params.frames; f++)
+    {
+        float phase = 2.0f * PI * f / params.frames;
+        out.Line("frame %u", f);
+        out.Line("bbox %g %g %g %g %g %g", -2.0f, 0.0f, -2.0f, 2.0f, static_cast<float>(params.bones), 2.0f);
+        for(uint32_t b = 0; b < params.bones; b++)
+        {
+            float half = 0.15f * std::sin(phase + 0.4f * b);
+            out.Line("jtr %.6f %.6f %.6f %.6f %.4f %.4f %.4f",
+                     0.0f, 0.0f, std::sin(half), std::cos(half),
+                     0.1f * std::sin(phase), static_cast<float>(b), 0.0f);
+        }
+    }
+
+    return out.Flush();
+}
+
+ImageData AssetGenerator::MakeImage(uint32_t width, uint32_t height, ImageData::PixelType type)
+{
+    ImageData id;
+    id.width = width;
+    id.height = height;
+    id.type = type;
+    uint32_t bytes_per_pixel = BytesPerPixel(id);
+    id.data = std::make_unique<uint8_t[]>(static_cast<size_t>(width) * height * bytes_per_pixel);
+
+    // lower half: 24 pixel wide flat stripes, upper half: noise
+    Lcg rng{12345};
+    for(uint32_t y = 0; y < height; y++)
+    {
+        for(uint32_t x = 0; x < width; x++)
+        {
+            uint8_t * px = id.data.get() + (static_cast<size_t>(y) * width + x) * bytes_per_pixel;
+            if(y < height / 2)
+            {
+                uint32_t stripe = x / 24 + y / 8;
+                px[0] = static_cast<uint8_t>(stripe * 37);
+                px[1] = static_cast<uint8_t>(stripe * 91);
+                px[2] = static_cast<uint8_t>(stripe * 53);
+            }
+            else
+            {
+                uint32_t r = rng.Next();
+                px[0] = static_cast<uint8_t>(r);
+                px[1] = static_cast<uint8_t>(r >> 8);
+                px[2] = static_cast<uint8_t>(r >> 16);
+            }
+            if(bytes_per_pixel == 4)
+                px[3] = y < height / 2 ? 255 : static_cast<uint8_t>(x ^ y);
+        }
+    }
+
+    return id;
+}
+
+bool AssetGenerator::WriteTGA(const std::string & fname, const ImageData & id, bool rle)
+{
+    std::ofstream ofs(fname, std::ios::out | std::ios::binary);
+    if(!ofs.is_open())
+    {
+        std::cerr << "Error opening file: " << fname << std::endl;
+        return false;
+    }
+
+    uint32_t bytes_per_pixel = BytesPerPixel(id);
+    TGAFILEHEADER tga;
+    std::memset(&tga, 0, sizeof(tga));
+    tga.datatypecode = rle ? 10 : 2;
+    tga.width = id.width;
+    tga.height = id.height;
+    tga.bitsperpixel = bytes_per_pixel * 8;
+    tga.imagedescriptor = bytes_per_pixel == 4 ? 8 : 0;      // alpha bits, bottom-left origin
+    ofs.write(reinterpret_cast<const char *>(&tga), sizeof(tga));
+
+    std::vector<uint8_t> row;
+    row.reserve(id.width * (bytes_per_pixel + 1));
+    for(uint32_t y = 0; y < id.height; y++)
+    {
+        const uint8_t * src = id.data.get() + static_cast<size_t>(y) * id.width * bytes_per_pixel;
+        auto same = [&](uint32_t a, uint32_t b)
+        {
+            return std::memcmp(src + a * bytes_per_pixel, src + b * bytes_per_pixel, bytes_per_pixel) == 0;
+        };
+
+        row.clear();
+        uint32_t x = 0;
+        while(x < id.width)
+        {
+            if(!rle)
+            {
+                row.resize(row.size() + bytes_per_pixel);
+                ToBGR(src + x * bytes_per_pixel, &row[row.size() - bytes_per_pixel], bytes_per_pixel);
+                x++;
+                continue;
+            }
+
+            // packets stay within a scanline and hold at most 128 pixels
+            uint32_t run = 1;
+            while(x + run < id.width && run < 128 && same(x, x + run))
+                run++;
+
+            if(run > 1)
+            {
+                row.push_back(static_cast<uint8_t>(0x80 | (run - 1)));
+                row.resize(row.size() + bytes_per_pixel);
+                ToBGR(src + x * bytes_per_pixel, &row[row.size() - bytes_per_pixel], bytes_per_pixel);
+                x += run;
+                continue;
+            }
+
+            uint32_t count = 1;
+            while(x + count < id.width && count < 128
+                  && !(x + count + 1 < id.width && same(x + count, x + count + 1)))
+                count++;
+
+            row.push_back(static_cast<uint8_t>(count - 1));
+            for(uint32_t i = 0; i < count; i++)
+            {
+                row.resize(row.size() + bytes_per_pixel);
+                ToBGR(src + (x + i) * bytes_per_pixel, &row[row.size() - bytes_per_pixel], bytes_per_pixel);
+            }
+            x += count;
+        }
+
+        ofs.write(reinterpret_cast<const char *>(row.data()), row.size());
+    }
+
+    return static_cast<bool>(ofs);
+}
+
+bool AssetGenerator::WriteBMP(const std::string & fname, const ImageData & id)
+{
+    std::ofstream ofs(fname, std::ios::out | std::ios::binary);
+    if(!ofs.is_open())
+    {
+        std::cerr << "Error opening file: " << fname << std::endl;
+        return false;
+    }
+
+    uint32_t bytes_per_pixel = BytesPerPixel(id);
+    uint32_t line_length = (id.width * bytes_per_pixel + 3) & ~3u;
+
+    BMPFILEHEADER file;
+    BMPINFOHEADER info;
+    std::memset(&file, 0, sizeof(file));
+    std::memset(&info, 0, sizeof(info));
+    file.bfType = 0x4D42;
+    file.bfOffBits = sizeof(file) + sizeof(info);
+    file.bfSize = file.bfOffBits + line_length * id.height;
+    info.biSize = sizeof(info);
+    info.biWidth = id.width;
+    info.biHeight = id.height;                              // bottom-up, same as ImageData
+    info.biPlanes = 1;
+    info.biBitCount = bytes_per_pixel * 8;
+    info.biSizeImage = line_length * id.height;
+    ofs.write(reinterpret_cast<const char *>(&file), sizeof(file));
+    ofs.write(reinterpret_cast<const char *>(&info), sizeof(info));
+
+    std::vector<uint8_t> row(line_length, 0);
+    for(uint32_t y = 0; y < id.height; y++)
+    {
+        const uint8_t * src = id.data.get() + static_cast<size_t>(y) * id.width * bytes_per_pixel;
+        for(uint32_t x = 0; x < id.width; x++)
+            ToBGR(src + x * bytes_per_pixel, &row[x * bytes_per_pixel], bytes_per_pixel);
+        ofs.write(reinterpret_cast<const char *>(row.data()), row.size());
+    }
+
+    return static_cast<bool>(ofs);
+}
@@ -0,0 +1,42 @@
+#ifndef ASSETGENERATOR_H
+#define ASSETGENERATOR_H
+
+#include <cstdint>
+#include <string>
+#include "ImageData.h"
+
+//! Synthetic assets of controlled size for the benchmarks
+/*!
+    Meshes are skinned cylinders along +Y with one bone per unit of
+    height, animations sway every bone around Z, images mix flat runs
+    (which RLE compresses) with noise (which it does not). Output is
+    deterministic for a given set of parameters.
+*/
+namespace AssetGenerator
+{
+    struct MeshParams
+    {
+        uint32_t submeshes  = 1;
+        uint32_t vertices   = 10000;          // per submesh
+        uint32_t bones      = 32;
+        uint32_t influences = 4;              // per vertex, 1..4
+        bool     varying    = false;          // like a real rig: rigid mid-bone, up to influences near joints
+    };
+
+    struct AnimParams
+    {
+        uint32_t bones     = 32;
+        uint32_t frames    = 100;
+        float    frameRate = 30.0f;
+    };
+
+    //! Text .msh, returns the number of triangles per submesh through num_tris
+    bool WriteMsh(const std::string & fname, const MeshParams & params, uint32_t * num_tris = nullptr);
+    bool WriteAnm(const std::string & fname, const AnimParams & params);
+
+    ImageData MakeImage(uint32_t width, uint32_t height, ImageData::PixelType type);
+    bool WriteTGA(const std::string & fname, const ImageData & id, bool rle);
+    bool WriteBMP(const std::string & fname, const ImageData & id);
+}
+
+#endif // ASSETGENERATOR_H
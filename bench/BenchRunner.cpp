@@ -0,0 +1,100 @@
+#include "BenchRunner.h"
+#include <cstdio>
+#include <numeric>
+
+namespace
+{
+    double PerSecond(uint64_t amount, double ms)
+    {
+        return ms > 0.0 ? amount * 1000.0 / ms : 0.0;
+    }
+
+    std::string Escape(const std::string & s)
+    {
+        std::string out;
+        for(char c : s)
+        {
+            if(c == '"' || c == '\\')
+                out.push_back('\\');
+            out.push_back(c);
+        }
+        return out;
+    }
+
+    std::string Format(const char * format, double value)
+    {
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), format, value);
+        return buf;
+    }
+}
+
+BenchRunner::BenchRunner(uint32_t iterations, std::string filter) : _iterations(std::max(1u, iterations)),
+                                                                    _filter(std::move(filter))
+{
+}
+
+bool BenchRunner::Selected(const std::string & suite, const std::string & name) const
+{
+    return _filter.empty() || (suite + "/" + name).find(_filter) != std::string::npos;
+}
+
+BenchResult * BenchRunner::Add(BenchResult res, std::vector<double> & times)
+{
+    if(!times.empty())
+    {
+        std::sort(times.begin(), times.end());
+        res.min_ms = times.front();
+        res.median_ms = times[times.size() / 2];
+        res.mean_ms = std::accumulate(times.begin(), times.end(), 0.0) / times.size();
+    }
+    res.iterations = static_cast<uint32_t>(times.size());
+
+    _results.push_back(std::move(res));
+    return &_results.back();
+}
+
+void BenchRunner::WriteJSON(std::ostream & out) const
+{
+    out << "{\n  \"results\": [\n";
+    for(size_t i = 0; i < _results.size(); i++)
+    {
+        const BenchResult & r = _results[i];
+        out << "    {\"suite\": \"" << Escape(r.suite) << "\", \"name\": \"" << Escape(r.name)
+            << "\", \"params\": \"" << Escape(r.params) << "\", \"ok\": " << (r.ok ? "true" : "false")
+            << ", \"iterations\": " << r.iterations << ", \"bytes\": " << r.bytes << ", \"items\": " << r.items
+            << ", \"min_ms\": " << Format("%.4f", r.min_ms) << ", \"median_ms\": " << Format("%.4f", r.median_ms)
+            << ", \"mean_ms\": " << Format("%.4f", r.mean_ms) << ", \"max_error\": " << Format("%g", r.max_error)
+            << ", \"mb_per_s\": " << Format("%.2f", PerSecond(r.bytes, r.min_ms) / (1 << 20))
+            << ", \"items_per_s\": " << Format("%.0f", PerSecond(r.items, r.min_ms)) << "}"
+            << (i + 1 < _results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+void BenchRunner::WriteCSV(std::ostream & out) const
+{
+    out << "suite,name,params,ok,iterations,bytes,items,min_ms,median_ms,mean_ms,max_error,mb_per_s,items_per_s\n";
+    for(const BenchResult & r : _results)
+    {
+        out << r.suite << "," << r.name << ",\"" << r.params << "\"," << (r.ok ? 1 : 0) << ","
+            << r.iterations << "," << r.bytes << "," << r.items << ","
+            << Format("%.4f", r.min_ms) << "," << Format("%.4f", r.median_ms) << "," << Format("%.4f", r.mean_ms) << ","
+            << Format("%g", r.max_error) << ","
+            << Format("%.2f", PerSecond(r.bytes, r.min_ms) / (1 << 20)) << ","
+            << Format("%.0f", PerSecond(r.items, r.min_ms)) << "\n";
+    }
+}
+
+void BenchRunner::WriteSummary(std::ostream & out) const
+{
+    for(const BenchResult & r : _results)
+    {
+        char line[256];
+        std::snprintf(line, sizeof(line), "%-6s %-24s %-36s %10.3f ms %9.1f MB/s %12.0f items/s  err %-9.3g%s\n",
+                      r.suite.c_str(), r.name.c_str(), r.params.c_str(), r.min_ms,
+                      PerSecond(r.bytes, r.min_ms) / (1 << 20), PerSecond(r.items, r.min_ms),
+                      r.max_error, r.ok ? "" : "  FAILED");
+        out << line;
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef BENCHRUNNER_H
+#define BENCHRUNNER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+//! One timed case: every iteration runs the same work on the same input
+struct BenchResult
+{
+    std::string suite;
+    std::string name;
+    std::string params;                  // "key=value;key=value"
+    uint64_t    bytes;                   // input or output size of one iteration
+    uint64_t    items;                   // vertices, keys, pixels... of one iteration
+    uint32_t    iterations;
+    double      min_ms;
+    double      median_ms;
+    double      mean_ms;
+    double      max_error;               // deviation from a reference result, where one exists
+    bool        ok;
+};
+
+//! Times cases and writes the results as JSON or CSV
+/*!
+    Each case runs one untimed warm-up iteration and then the requested
+    number of timed ones. Throughput columns are derived from the best
+    (minimum) time, which is the least disturbed by the rest of the system.
+*/
+class BenchRunner
+{
+public:
+    BenchRunner(uint32_t iterations, std::string filter);
+
+    //! Skipped and null when "suite/name" does not contain the filter
+    template<typename Func>
+    BenchResult * Run(const std::string & suite, const std::string & name, const std::string & params,
+                      uint64_t bytes, uint64_t items, Func && func);
+
+    const std::vector<BenchResult> & Results() const { return _results; }
+
+    void WriteJSON(std::ostream & out) const;
+    void WriteCSV(std::ostream & out) const;
+    void WriteSummary(std::ostream & out) const;        // human readable, one line per case
+
+private:
+    bool Selected(const std::string & suite, const std::string & name) const;
+    BenchResult * Add(BenchResult res, std::vector<double> & times);
+
+    uint32_t                 _iterations;
+    std::string              _filter;
+    std::vector<BenchResult> _results;
+};
+
+template<typename Func>
+BenchResult * BenchRunner::Run(const std::string & suite, const std::string & name, const std::string & params,
+                               uint64_t bytes, uint64_t items, Func && func)
+{
+    if(!Selected(suite, name))
+        return nullptr;
+
+    BenchResult res{suite, name, params, bytes, items, _iterations, 0.0, 0.0, 0.0, 0.0, true};
+    std::vector<double> times;
+    times.reserve(_iterations);
+
+    res.ok = func();
+    for(uint32_t i = 0; i < _iterations && res.ok; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        res.ok = func();
+        auto stop = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double, std::milli>(stop - start).count());
+    }
+
+    return Add(std::move(res), times);
+}
+
+#endif // BENCHRUNNER_H
@@ -0,0 +1,55 @@
+#-------------------------------------------------
+#
+# Loader, codec, skinning and software rendering benchmarks, console only
+#
+#   qmake bench.pro && make && ./bench --sizes small
+#
+#-------------------------------------------------
+
+QT       -= core gui
+CONFIG   -= qt app_bundle
+CONFIG   += console c++17
+
+TARGET = bench
+TEMPLATE = app
+
+INCLUDEPATH += ..
+DEFINES += COUNT_ALLOCATIONS
+unix: LIBS += -pthread
+
+SOURCES += \
+        main.cpp \
+    AssetGenerator.cpp \
+    BenchRunner.cpp \
+    ../AssetCache.cpp \
+    ../ImageData.cpp \
+    ../TextureData.cpp \
+    ../Controller.cpp \
+    ../Mesh.cpp \
+    ../MappedFile.cpp \
+    ../ThreadPool.cpp \
+    ../LoadMonitor.cpp \
+    ../SkinningEngine.cpp \
+    ../SoftRasterizer.cpp \
+    ../camera.cpp \
+    ../CpuFeatures.cpp \
+    ../AllocationCounter.cpp
+
+HEADERS += \
+    AssetGenerator.h \
+    BenchRunner.h \
+    ../AssetCache.h \
+    ../ImageData.h \
+    ../TextureData.h \
+    ../AABB.h \
+    ../DataArray.h \
+    ../Controller.h \
+    ../Mesh.h \
+    ../MappedFile.h \
+    ../ThreadPool.h \
+    ../LoadMonitor.h \
+    ../SkinningEngine.h \
+    ../SoftRasterizer.h \
+    ../camera.h \
+    ../CpuFeatures.h \
+    ../AllocationCounter.h
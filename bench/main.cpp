@@ -0,0 +1,924 @@
+// Loader, image codec, skinning and software rendering benchmarks, runs without a display:
+//
+//   bench [--suite mesh|anim|image|texture|skin|raster|all] [--sizes small|medium|large]
+//         [--iterations N] [--threads N] [--filter TEXT] [--format json|csv]
+//         [--out FILE] [--dir DIR] [--keep]
+//
+// Synthetic inputs are generated first into a new run_N directory under
+// DIR, removed at the end unless --keep; results go to FILE (stdout by
+// default) and a readable summary to stderr.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "AssetCache.h"
+#include "AssetGenerator.h"
+#include "BenchRunner.h"
+#include "Mesh.h"
+#include "ImageData.h"
+#include "TextureData.h"
+#include "ThreadPool.h"
+#include "SkinningEngine.h"
+#include "SoftRasterizer.h"
+#include "AllocationCounter.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    struct BenchConfig
+    {
+        fs::path                                  dir;
+        uint32_t                                  submeshes;
+        std::vector<uint32_t>                     vertices;        // per submesh
+        std::vector<std::pair<uint32_t, uint32_t>> anims;          // bones, frames
+        std::vector<uint32_t>                     imageSizes;      // square edge in pixels
+        unsigned int                              threads;         // for multi-threaded cases, 0 = all cores
+    };
+
+    typedef void (*SuiteFunc)(BenchRunner &, const BenchConfig &);
+
+    uint64_t FileSize(const fs::path & p)
+    {
+        std::error_code ec;
+        uint64_t size = fs::file_size(p, ec);
+        return ec ? 0 : size;
+    }
+
+    // WriteTGA before the staging buffer, one stream write per channel, kept as the baseline
+    bool LegacyWriteTGA(const std::string & fname, const ImageData & id)
+    {
+        #pragma pack(push, 1)
+        struct
+        {
+            uint8_t  idlength;
+            uint8_t  colourmaptype;
+            uint8_t  datatypecode;
+            uint16_t colourmaporigin;
+            uint16_t colourmaplength;
+            uint8_t  colourmapdepth;
+            uint16_t x_origin;
+            uint16_t y_origin;
+            uint16_t width;
+            uint16_t height;
+            uint8_t  bitsperpixel;
+            uint8_t  imagedescriptor;
+        } tga;
+        #pragma pack(pop)
+        std::memset(&tga, 0, sizeof(tga));
+        uint32_t bytes_per_pixel = (id.type == ImageData::PixelType::pt_rgb ? 3 : 4);
+
+        std::ofstream ofs(fname, std::ios::out | std::ios::binary);
+        if(!ofs.is_open())
+            return false;
+
+        tga.datatypecode = 2;
+        tga.width = id.width;
+        tga.height = id.height;
+        tga.bitsperpixel = bytes_per_pixel * 8;
+        tga.imagedescriptor = bytes_per_pixel == 4 ? 8 : 0;
+        ofs.write(reinterpret_cast<char *>(&tga), sizeof(tga));
+
+        uint8_t * data_ptr = id.data.get();
+        uint8_t red, green, blue, alpha = 0;
+        for(uint32_t i = 0; i < id.width * id.height * bytes_per_pixel; i += bytes_per_pixel)
+        {
+            red = data_ptr[i + 0];
+            green = data_ptr[i + 1];
+            blue = data_ptr[i + 2];
+            if(bytes_per_pixel == 4)
+                alpha = data_ptr[i + 3];
+
+            ofs.write(reinterpret_cast<char *>(&blue), 1);
+            ofs.write(reinterpret_cast<char *>(&green), 1);
+            ofs.write(reinterpret_cast<char *>(&red), 1);
+            if(id.type == ImageData::PixelType::pt_rgba)
+                ofs.write(reinterpret_cast<char *>(&alpha), 1);
+        }
+
+        return static_cast<bool>(ofs);
+    }
+
+    std::string Params(std::initializer_list<std::pair<const char *, uint64_t>> values)
+    {
+        std::string s;
+        for(auto & v : values)
+        {
+            if(!s.empty())
+                s += ";";
+            s += v.first;
+            s += "=";
+            s += std::to_string(v.second);
+        }
+        return s;
+    }
+
+    // largest channel difference of b, decoded or a view, from a; 255 when they do not even match in size
+    double ImageError(const ImageData & a, const ImageData & b)
+    {
+        if(a.width != b.width || a.height != b.height || a.type != b.type || !b.Pixels())
+            return 255.0;
+
+        uint32_t bytes_per_pixel = a.BytesPerPixel();
+        bool     bgr = b.order == ImageData::ChannelOrder::co_bgr;
+        int      error = 0;
+        for(uint32_t y = 0; y < a.height; y++)
+        {
+            const uint8_t * pa = a.Row(y);
+            const uint8_t * pb = b.Row(y);
+            for(uint32_t i = 0; i < a.width * bytes_per_pixel; i++)
+            {
+                uint32_t c = i % bytes_per_pixel;
+                uint32_t j = bgr && c != 3 ? i - c + 2 - c : i;
+                error = std::max(error, std::abs(pa[i] - pb[j]));
+            }
+        }
+        return error;
+    }
+
+    //==========================================================================
+    //         Suites
+    //==========================================================================
+    void BenchMesh(BenchRunner & runner, const BenchConfig & cfg)
+    {
+        const std::pair<Mesh::MshReader, const char *> readers[] =
+        {
+            {Mesh::MshReader::mr_stream,   "LoadFromMsh/stream"},
+            {Mesh::MshReader::mr_mapped,   "LoadFromMsh/mapped"},
+            {Mesh::MshReader::mr_parallel, "LoadFromMsh/parallel"},
+        };
+
+        for(uint32_t vertices : cfg.vertices)
+        {
+            AssetGenerator::MeshParams mp;
+            mp.submeshes = cfg.submeshes;
+            mp.vertices = vertices;
+
+            std::string base = "mesh_" + std::to_string(vertices);
+            fs::path msh = cfg.dir / (base + ".msh");
+            fs::path mshb = cfg.dir / (base + ".mshb");
+            if(!AssetGenerator::WriteMsh(msh.string(), mp))
+                continue;
+
+            std::string params = Params({{"submeshes", mp.submeshes}, {"vertices", vertices}});
+            uint64_t items = static_cast<uint64_t>(mp.submeshes) * vertices;
+            for(auto & reader : readers)
+            {
+                runner.Run("mesh", reader.second, params, FileSize(msh), items, [&]
+                {
+                    Mesh m;
+                    return m.LoadFromMsh(msh.string().c_str(), reader.first);
+                });
+            }
+
+            Mesh src;
+            if(!src.LoadFromMsh(msh.string().c_str(), Mesh::MshReader::mr_mapped)
+               || !src.SaveToMshb(mshb.string().c_str()))
+                continue;
+
+            runner.Run("mesh", "LoadFromMsh/binary", params, FileSize(mshb), items, [&]
+            {
+                Mesh m;
+                return m.LoadFromMsh(mshb.string().c_str(), Mesh::MshReader::mr_binary);
+            });
+
+            // the cache stores a rig grouped by influence count, so a hit sorted as the viewer
+            // sorts it is left a view of the entry
+            mp.varying = true;
+            fs::path rig = cfg.dir / (base + "_rig.msh");
+            AssetCache cache;
+            Mesh stored;
+            if(!AssetGenerator::WriteMsh(rig.string(), mp)
+               || !cache.Open((cfg.dir / "cache").string(), uint64_t(1) << 30)
+               || !cache.LoadMesh(rig.string(), stored, Mesh::MshReader::mr_mapped))
+                continue;
+
+            uint64_t hits = cache.GetStats().hits;
+            BenchResult * res = runner.Run("mesh", "AssetCache/LoadMesh/hit", params, FileSize(rig), items, [&]
+            {
+                Mesh m;
+                return cache.LoadMesh(rig.string(), m, Mesh::MshReader::mr_mapped)
+                       && !m.SortVerticesByInfluence() && m.IsMapped();
+            });
+            if(res)
+                res->ok = res->ok && cache.GetStats().hits > hits;
+        }
+    }
+
+    void BenchAnim(BenchRunner & runner, const BenchConfig & cfg)
+    {
+        for(auto & anim : cfg.anims)
+        {
+            AssetGenerator::AnimParams ap;
+            ap.bones = anim.first;
+            ap.frames = anim.second;
+
+            std::string base = "anim_" + std::to_string(ap.bones) + "_" + std::to_string(ap.frames);
+            fs::path anm = cfg.dir / (base + ".anm");
+            fs::path anmb = cfg.dir / (base + ".anmb");
+            fs::path anmq = cfg.dir / (base + "_q.anmb");
+            if(!AssetGenerator::WriteAnm(anm.string(), ap))
+                continue;
+
+            std::string params = Params({{"bones", ap.bones}, {"frames", ap.frames}});
+            uint64_t items = static_cast<uint64_t>(ap.bones) * ap.frames;
+            runner.Run("anim", "LoadFromAnm", params, FileSize(anm), items, [&]
+            {
+                Mesh m;
+                return m.LoadFromAnm(anm.string().c_str());
+            });
+
+            Mesh src;
+            if(!src.LoadFromAnm(anm.string().c_str())
+               || !src.SaveToAnmb(anmb.string().c_str(), false)
+               || !src.SaveToAnmb(anmq.string().c_str(), true))
+                continue;
+
+            runner.Run("anim", "LoadFromAnmb/float", params, FileSize(anmb), items, [&]
+            {
+                Mesh m;
+                return m.LoadFromAnmb(anmb.string().c_str());
+            });
+            runner.Run("anim", "LoadFromAnmb/quantized", params, FileSize(anmq), items, [&]
+            {
+                Mesh m;
+                return m.LoadFromAnmb(anmq.string().c_str());
+            });
+        }
+    }
+
+    void BenchImage(BenchRunner & runner, const BenchConfig & cfg)
+    {
+        const std::pair<ImageData::PixelType, const char *> types[] =
+        {
+            {ImageData::PixelType::pt_rgb,  "rgb"},
+            {ImageData::PixelType::pt_rgba, "rgba"},
+        };
+
+        for(uint32_t size : cfg.imageSizes)
+        {
+            for(auto & type : types)
+            {
+                ImageData img = AssetGenerator::MakeImage(size, size, type.first);
+                std::string base = std::string("image_") + type.second + "_" + std::to_string(size);
+                fs::path tga = cfg.dir / (base + ".tga");
+                fs::path rle = cfg.dir / (base + "_rle.tga");
+                fs::path bmp = cfg.dir / (base + ".bmp");
+                fs::path out = cfg.dir / (base + "_out.tga");
+                if(!AssetGenerator::WriteTGA(tga.string(), img, false)
+                   || !AssetGenerator::WriteTGA(rle.string(), img, true)
+                   || !AssetGenerator::WriteBMP(bmp.string(), img))
+                    continue;
+
+                std::string params = std::string("format=") + type.second + ";" + Params({{"width", size}, {"height", size}});
+                uint64_t pixels = static_cast<uint64_t>(size) * size;
+                // each reader has to give back the generated image
+                const std::tuple<const char *, const fs::path &, bool (*)(std::string, ImageData &)> readers[] =
+                {
+                    {"ReadTGA/raw",  tga, ReadTGA},
+                    {"ReadTGA/rle",  rle, ReadTGA},
+                    {"ReadBMP",      bmp, ReadBMP},
+                    {"MapImage/tga", tga, MapImage},
+                    {"MapImage/bmp", bmp, MapImage},
+                };
+                for(auto & reader : readers)
+                {
+                    ImageData id;
+                    const fs::path & file = std::get<1>(reader);
+                    BenchResult * res = runner.Run("image", std::get<0>(reader), params, FileSize(file), pixels, [&]
+                    {
+                        return std::get<2>(reader)(file.string(), id);
+                    });
+                    if(!res || !res->ok)
+                        continue;
+                    res->max_error = ImageError(img, id);
+                    res->ok = res->max_error == 0.0;
+                }
+
+                // throughput over the image size for all three, so RLE is not credited for writing less;
+                // the writers have to read back as the image
+                uint64_t image_bytes = pixels * (type.first == ImageData::PixelType::pt_rgb ? 3 : 4);
+                runner.Run("image", "WriteTGA/legacy", params, image_bytes, pixels, [&]
+                {
+                    return LegacyWriteTGA(out.string(), img);
+                });
+                for(bool compress : {false, true})
+                {
+                    BenchResult * res = runner.Run("image", compress ? "WriteTGA/rle" : "WriteTGA/raw", params,
+                                                   image_bytes, pixels, [&]
+                    {
+                        return WriteTGA(out.string(), img, compress);
+                    });
+                    ImageData id;
+                    if(!res || !res->ok)
+                        continue;
+                    res->max_error = ReadTGA(out.string(), id) ? ImageError(img, id) : 255.0;
+                    res->ok = res->max_error == 0.0;
+                }
+            }
+        }
+    }
+
+    // root mean square difference of the BC blocks of a level from its raw pixels
+    double BCError(const TextureData::Level & raw, const TextureData::Level & bc, bool bc3)
+    {
+        uint32_t blocks_x = (raw.width + 3) / 4;
+        size_t   block_bytes = bc3 ? 16 : 8;
+        double   sum = 0.0;
+        for(uint32_t y = 0; y < raw.height; y++)
+        {
+            for(uint32_t x = 0; x < raw.width; x++)
+            {
+                const uint8_t * block = &bc.data[((y / 4) * blocks_x + x / 4) * block_bytes];
+                const uint8_t * color = block + (bc3 ? 8 : 0);
+                const uint8_t * px = &raw.data[(size_t(y) * raw.width + x) * 4];
+                uint32_t        texel = (y % 4) * 4 + x % 4;
+
+                int palette[4][3];
+                for(int e = 0; e < 2; e++)
+                {
+                    uint32_t c = color[2 * e] | (color[2 * e + 1] << 8);
+                    palette[e][0] = ((c >> 11) << 3) | (c >> 13);
+                    palette[e][1] = (((c >> 5) & 63) << 2) | (((c >> 5) & 63) >> 4);
+                    palette[e][2] = ((c & 31) << 3) | ((c & 31) >> 2);
+                }
+                for(int ch = 0; ch < 3; ch++)
+                {
+                    palette[2][ch] = (2 * palette[0][ch] + palette[1][ch]) / 3;
+                    palette[3][ch] = (palette[0][ch] + 2 * palette[1][ch]) / 3;
+                }
+                uint32_t index = (color[4 + texel / 4] >> (2 * (texel % 4))) & 3;
+                for(int ch = 0; ch < 3; ch++)
+                    sum += double(palette[index][ch] - px[ch]) * (palette[index][ch] - px[ch]);
+
+                if(bc3)
+                {
+                    uint64_t bits = 0;
+                    for(int k = 0; k < 6; k++)
+                        bits |= uint64_t(block[2 + k]) << (8 * k);
+                    int a0 = block[0];
+                    int a1 = block[1];
+                    int a_index = static_cast<int>((bits >> (3 * texel)) & 7);
+                    int alpha = a_index == 0 ? a0
+                              : a_index == 1 ? a1
+                              : ((8 - a_index) * a0 + (a_index - 1) * a1) / 7;
+                    sum += double(alpha - px[3]) * (alpha - px[3]);
+                }
+            }
+        }
+        return std::sqrt(sum / (double(raw.width) * raw.height * (bc3 ? 4 : 3)));
+    }
+
+    void BenchTexture(BenchRunner & runner, const BenchConfig & cfg)
+    {
+        const std::pair<MipFilter, const char *> filters[] =
+        {
+            {MipFilter::mf_box,    "BuildMipChain/box"},
+            {MipFilter::mf_kaiser, "BuildMipChain/kaiser"},
+        };
+        const std::pair<ImageData::PixelType, const char *> types[] =
+        {
+            {ImageData::PixelType::pt_rgb,  "rgb"},
+            {ImageData::PixelType::pt_rgba, "rgba"},
+        };
+        ThreadPool pool(cfg.threads);
+
+        for(uint32_t size : cfg.imageSizes)
+        {
+            for(auto & type : types)
+            {
+                ImageData img = AssetGenerator::MakeImage(size, size, type.first);
+                std::string params = std::string("format=") + type.second + ";" + Params({{"width", size}, {"height", size}});
+                uint64_t pixels = static_cast<uint64_t>(size) * size;
+
+                // the SSE2 filters against their scalar reference, level by level
+                for(auto & filter : filters)
+                {
+                    TextureData tex;
+                    BenchResult * res = runner.Run("texture", filter.second, params, pixels * 4, pixels, [&]
+                    {
+                        return BuildMipChain(img, filter.first, tex);
+                    });
+                    if(!res || !res->ok)
+                        continue;
+
+                    for(size_t l = 1; l < tex.levels.size(); l++)
+                    {
+                        const TextureData::Level & src = tex.levels[l - 1];
+                        std::vector<uint8_t> ref(tex.levels[l].data.size());
+                        if(filter.first == MipFilter::mf_box)
+                            DownsampleBoxScalar(src.data.data(), src.width, src.height, ref.data());
+                        else
+                            DownsampleKaiserScalar(src.data.data(), src.width, src.height, ref.data());
+                        for(size_t i = 0; i < ref.size(); i++)
+                        {
+                            int diff = std::abs(ref[i] - tex.levels[l].data[i]);
+                            res->max_error = std::max<double>(res->max_error, diff);
+                        }
+                    }
+                    res->ok = res->max_error == 0.0;
+                }
+
+                // block rows on one thread, then on the pool; the error is the RMSE of level 0
+                TextureData chain;
+                if(!BuildMipChain(img, MipFilter::mf_box, chain))
+                    continue;
+                const char * name = chain.opaque ? "CompressBC/bc1" : "CompressBC/bc3";
+                ThreadPool single(1);
+                for(ThreadPool * threads : {&single, &pool})
+                {
+                    if(threads == &pool && pool.NumThreads() == 1)
+                        continue;
+                    TextureData tex;
+                    BenchResult * res = runner.Run("texture", name,
+                                                   params + ";" + Params({{"threads", threads->NumThreads()}}),
+                                                   pixels * 4, pixels, [&]
+                    {
+                        tex = chain;
+                        return CompressBC(tex, threads);
+                    });
+                    if(res && res->ok)
+                        res->max_error = BCError(chain.levels[0], tex.levels[0], !chain.opaque);
+                }
+            }
+        }
+    }
+
+    const SkinningEngine::Isa SKIN_ISAS[] =
+    {
+        SkinningEngine::Isa::isa_scalar,
+        SkinningEngine::Isa::isa_sse41,
+        SkinningEngine::Isa::isa_avx2,
+    };
+
+    const double SKIN_TOLERANCE = 1e-3;          // absolute, the test rig is a few dozen units tall
+
+    double SkinError(const SkinningEngine & a, const SkinningEngine & b)
+    {
+        double error = 0.0;
+        for(uint32_t i = 0; i < a.NumSubMeshes(); i++)
+        {
+            for(size_t n = 0; n < a.Positions(i).size(); n++)
+                error = std::max<double>(error, glm::length(a.Positions(i)[n] - b.Positions(i)[n]));
+            for(size_t n = 0; n < a.Normals(i).size(); n++)
+                error = std::max<double>(error, glm::length(a.Normals(i)[n] - b.Normals(i)[n]));
+        }
+        return error;
+    }
+
+    void BenchSkin(BenchRunner & runner, const BenchConfig & cfg)
+    {
+        AssetGenerator::AnimParams ap;
+        ap.bones = 64;
+        fs::path anm = cfg.dir / "skin.anm";
+        if(!AssetGenerator::WriteAnm(anm.string(), ap))
+            return;
+
+        for(uint32_t vertices : cfg.vertices)
+        {
+            AssetGenerator::MeshParams mp;
+            mp.submeshes = cfg.submeshes;
+            mp.vertices = vertices;
+            mp.bones = ap.bones;
+
+            fs::path msh = cfg.dir / ("skin_" + std::to_string(vertices) + ".msh");
+            Mesh mesh;
+            if(!AssetGenerator::WriteMsh(msh.string(), mp)
+               || !mesh.LoadFromMsh(msh.string().c_str(), Mesh::MshReader::mr_mapped)
+               || !mesh.LoadFromAnm(anm.string().c_str()))
+                continue;
+
+            std::string params = Params({{"submeshes", mp.submeshes}, {"vertices", vertices},
+                                         {"influences", mp.influences}, {"bones", ap.bones}});
+            uint64_t items = static_cast<uint64_t>(mp.submeshes) * vertices;
+            uint64_t bytes = items * 2 * sizeof(glm::vec3);
+
+            // conversion to the packed layout, with the weight error pruning adds
+            for(uint32_t influences = SkinningEngine::MAX_INFLUENCES; influences > 0; influences--)
+            {
+                SkinningEngine engine;
+                engine.SetMaxInfluences(influences);
+                engine.Bind(mesh);
+                const SkinningEngine::PackStats & st = engine.GetPackStats();
+
+                BenchResult * res = runner.Run("skin", "SkinningEngine/bind",
+                                               params + ";" + Params({{"max_influences", influences},
+                                                                      {"source_bytes", st.sourceBytes}}),
+                                               st.packedBytes, items, [&]
+                {
+                    engine.Bind(mesh);
+                    return engine.IsBound();
+                });
+                if(res)
+                    res->max_error = st.maxWeightError;
+            }
+
+            // every kernel is checked against the scalar loop on the same pose
+            SkinningEngine reference;
+            reference.SetIsa(SkinningEngine::Isa::isa_scalar);
+            reference.SetNumThreads(1);
+            reference.Bind(mesh);
+            reference.Update(1, 2, 0.5f);
+
+            for(auto isa : SKIN_ISAS)
+            {
+                if(!SkinningEngine::IsSupported(isa))
+                    continue;
+
+                // kernels alone on one thread, then the best one on all threads
+                for(int mt = 0; mt < 2; mt++)
+                {
+                    unsigned int threads = mt ? cfg.threads : 1;
+                    if(mt && (isa != SkinningEngine::BestIsa() || threads == 1))
+                        continue;
+
+                    SkinningEngine engine;
+                    engine.SetIsa(isa);
+                    engine.SetNumThreads(threads);
+                    engine.Bind(mesh);
+                    engine.Update(1, 2, 0.5f);
+                    double error = SkinError(reference, engine);
+
+                    std::string name = std::string("SkinningEngine/") + SkinningEngine::IsaName(isa);
+                    if(mt)
+                        name += "/mt";
+
+                    uint32_t frame = 0;
+                    BenchResult * res = runner.Run("skin", name, params + ";" + Params({{"threads", engine.NumThreads()}}),
+                                                   bytes, items, [&]
+                    {
+                        frame = (frame + 1) % (ap.frames - 1);
+                        AllocationScope allocations;
+                        bool updated = engine.Update(frame, frame + 1, 0.5f);
+                        return updated && allocations.Allocations() == 0 && error <= SKIN_TOLERANCE;
+                    });
+                    if(res)
+                        res->max_error = error;
+                }
+            }
+
+            // influence counts of a real rig, skinned in file order and grouped by count
+            mp.varying = true;
+            fs::path mixed = cfg.dir / ("skin_mixed_" + std::to_string(vertices) + ".msh");
+            if(!AssetGenerator::WriteMsh(mixed.string(), mp))
+                continue;
+
+            for(int sorted = 0; sorted < 2; sorted++)
+            {
+                Mesh msh;
+                if(!msh.LoadFromMsh(mixed.string().c_str(), Mesh::MshReader::mr_mapped)
+                   || !msh.LoadFromAnm(anm.string().c_str()))
+                    break;
+                if(sorted)
+                    msh.SortVerticesByInfluence();
+
+                SkinningEngine ref;
+                ref.SetIsa(SkinningEngine::Isa::isa_scalar);
+                ref.SetNumThreads(1);
+                ref.Bind(msh);
+                ref.Update(1, 2, 0.5f);
+
+                const uint32_t * buckets = ref.GetPackStats().bucketVertices;
+                std::string mixed_params = params + ";" + Params({{"generic", buckets[0]}, {"rigid", buckets[1]},
+                                                                  {"two", buckets[2]}, {"three", buckets[3]},
+                                                                  {"four", buckets[4]}});
+
+                for(auto isa : SKIN_ISAS)
+                {
+                    if(!SkinningEngine::IsSupported(isa))
+                        continue;
+
+                    SkinningEngine engine;
+                    engine.SetIsa(isa);
+                    engine.SetNumThreads(1);
+                    engine.Bind(msh);
+                    engine.Update(1, 2, 0.5f);
+                    double error = SkinError(ref, engine);
+
+                    std::string name = std::string("SkinningEngine/") + SkinningEngine::IsaName(isa)
+                                       + (sorted ? "/sorted" : "/unsorted");
+                    uint32_t frame = 0;
+                    BenchResult * res = runner.Run("skin", name, mixed_params, bytes, items, [&]
+                    {
+                        frame = (frame + 1) % (ap.frames - 1);
+                        AllocationScope allocations;
+                        bool updated = engine.Update(frame, frame + 1, 0.5f);
+                        return updated && allocations.Allocations() == 0 && error <= SKIN_TOLERANCE;
+                    });
+                    if(res)
+                        res->max_error = error;
+                }
+            }
+        }
+    }
+
+    const SoftRasterizer::Isa RASTER_ISAS[] =
+    {
+        SoftRasterizer::Isa::isa_scalar,
+        SoftRasterizer::Isa::isa_sse2,
+        SoftRasterizer::Isa::isa_avx2,
+    };
+
+    void BenchRaster(BenchRunner & runner, const BenchConfig & cfg)
+    {
+        AssetGenerator::AnimParams ap;
+        ap.bones = 16;
+        fs::path anm = cfg.dir / "raster.anm";
+        if(!AssetGenerator::WriteAnm(anm.string(), ap))
+            return;
+
+        // every submesh names its own material, all the same generated image
+        ImageData texture = AssetGenerator::MakeImage(256, 256, ImageData::PixelType::pt_rgb);
+        for(uint32_t m = 0; m < cfg.submeshes; m++)
+        {
+            fs::path tga = cfg.dir / ("synthetic_" + std::to_string(m) + ".tga");
+            if(!AssetGenerator::WriteTGA(tga.string(), texture, false))
+                return;
+        }
+
+        for(uint32_t vertices : cfg.vertices)
+        {
+            AssetGenerator::MeshParams mp;
+            mp.submeshes = cfg.submeshes;
+            mp.vertices = vertices;
+            mp.bones = ap.bones;
+
+            fs::path msh = cfg.dir / ("raster_" + std::to_string(vertices) + ".msh");
+            uint32_t tris = 0;
+            Mesh mesh;
+            if(!AssetGenerator::WriteMsh(msh.string(), mp, &tris)
+               || !mesh.LoadFromMsh(msh.string().c_str(), Mesh::MshReader::mr_mapped)
+               || !mesh.LoadFromAnm(anm.string().c_str()))
+                continue;
+
+            uint64_t items = static_cast<uint64_t>(mp.submeshes) * tris;
+            const glm::vec4 background(0.2f, 0.2f, 0.3f, 1.0f);
+
+            for(uint32_t size : cfg.imageSizes)
+            {
+                Camera    cam;
+                glm::mat4 proj;
+                SoftRasterizer::FrameMesh(mesh, 1.0f, cam, proj);
+                glm::mat4 view = cam.GetViewMatrix();
+
+                std::string params = Params({{"submeshes", mp.submeshes}, {"vertices", vertices},
+                                             {"triangles", items}, {"width", size}, {"height", size}});
+                uint64_t bytes = static_cast<uint64_t>(size) * size * 4;
+
+                // every kernel has to draw the image of the scalar one on one thread, pixel for pixel
+                SoftRasterizer reference;
+                reference.SetIsa(SoftRasterizer::Isa::isa_scalar);
+                reference.SetNumThreads(1);
+                if(!reference.Resize(size, size) || !reference.LoadMaterials(mesh, cfg.dir.string()))
+                    continue;
+                reference.Clear(background);
+                reference.Draw(mesh, view, proj, 0.5);
+                ImageData expected;
+                reference.GetImage(expected);
+
+                for(auto isa : RASTER_ISAS)
+                {
+                    if(!SoftRasterizer::IsSupported(isa))
+                        continue;
+
+                    for(int mt = 0; mt < 2; mt++)
+                    {
+                        unsigned int threads = mt ? cfg.threads : 1;
+                        if(mt && isa != SoftRasterizer::BestIsa())
+                            continue;
+
+                        SoftRasterizer raster;
+                        raster.SetIsa(isa);
+                        raster.SetNumThreads(threads);
+                        if(mt && raster.NumThreads() == 1)
+                            continue;
+                        raster.Resize(size, size);
+                        raster.LoadMaterials(mesh, cfg.dir.string());
+
+                        std::string name = std::string("SoftRasterizer/") + SoftRasterizer::IsaName(isa);
+                        if(mt)
+                            name += "/mt";
+
+                        BenchResult * res = runner.Run("raster", name,
+                                                       params + ";" + Params({{"threads", raster.NumThreads()}}),
+                                                       bytes, items, [&]
+                        {
+                            raster.Clear(background);
+                            return raster.Draw(mesh, view, proj, 0.5) && raster.GetStats().pixels > 0;
+                        });
+                        if(res)
+                        {
+                            ImageData image;
+                            raster.GetImage(image);
+                            res->max_error = ImageError(expected, image);
+                            res->ok = res->ok && res->max_error == 0.0;
+                        }
+                    }
+                }
+
+                // a preview as the viewer would save it, read back to check the file
+                SoftRasterizer raster;
+                raster.SetNumThreads(cfg.threads);
+                raster.Resize(size, size);
+                raster.LoadMaterials(mesh, cfg.dir.string());
+                fs::path thumb = cfg.dir / ("raster_" + std::to_string(vertices) + "_" + std::to_string(size) + ".tga");
+                BenchResult * res = runner.Run("raster", "SoftRasterizer/thumbnail",
+                                               params + ";" + Params({{"threads", raster.NumThreads()}}),
+                                               bytes, items, [&]
+                {
+                    raster.Clear(background);
+                    if(!raster.Draw(mesh, view, proj, 0.5))
+                        return false;
+                    ImageData image;
+                    raster.GetImage(image);
+                    return WriteTGA(thumb.string(), image, true);
+                });
+                ImageData written;
+                if(res && res->ok)
+                {
+                    res->ok = ReadTGA(thumb.string(), written);
+                    res->max_error = ImageError(expected, written);
+                    res->ok = res->ok && res->max_error == 0.0;
+                }
+            }
+        }
+    }
+
+    const std::pair<const char *, SuiteFunc> SUITES[] =
+    {
+        {"mesh",  BenchMesh},
+        {"anim",  BenchAnim},
+        {"image", BenchImage},
+        {"texture", BenchTexture},
+        {"skin",  BenchSkin},
+        {"raster", BenchRaster},
+    };
+
+    bool SetSizes(const std::string & preset, BenchConfig & cfg)
+    {
+        if(preset == "small")
+        {
+            cfg.vertices = {10000};
+            cfg.anims = {{32, 100}};
+            cfg.imageSizes = {256};
+        }
+        else if(preset == "medium")
+        {
+            cfg.vertices = {10000, 100000};
+            cfg.anims = {{32, 100}, {64, 1000}};
+            cfg.imageSizes = {256, 1024};
+        }
+        else if(preset == "large")
+        {
+            cfg.vertices = {10000, 100000, 1000000};
+            cfg.anims = {{32, 100}, {64, 1000}, {128, 5000}};
+            cfg.imageSizes = {256, 1024, 4096};
+        }
+        else
+        {
+            return false;
+        }
+
+        return true;
+    }
+
+    void PrintUsage()
+    {
+        std::cerr << "Usage: bench [--suite mesh|anim|image|texture|skin|raster|all] [--sizes small|medium|large]\n"
+                     "             [--iterations N] [--threads N] [--filter TEXT] [--format json|csv]\n"
+                     "             [--out FILE] [--dir DIR] [--keep]" << std::endl;
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    BenchConfig cfg;
+    cfg.dir = fs::temp_directory_path() / "gl2test_bench";
+    cfg.submeshes = 4;
+    cfg.threads = 0;
+    SetSizes("medium", cfg);
+
+    std::string suite = "all";
+    std::string format = "json";
+    std::string out_name;
+    std::string filter;
+    uint32_t    iterations = 5;
+    bool        keep = false;
+
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if(arg == "--suite" && has_value)
+            suite = argv[++i];
+        else if(arg == "--sizes" && has_value)
+        {
+            if(!SetSizes(argv[++i], cfg))
+            {
+                PrintUsage();
+                return 1;
+            }
+        }
+        else if(arg == "--iterations" && has_value)
+            iterations = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if(arg == "--threads" && has_value)
+            cfg.threads = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        else if(arg == "--filter" && has_value)
+            filter = argv[++i];
+        else if(arg == "--format" && has_value)
+            format = argv[++i];
+        else if(arg == "--out" && has_value)
+            out_name = argv[++i];
+        else if(arg == "--dir" && has_value)
+            cfg.dir = argv[++i];
+        else if(arg == "--keep")
+            keep = true;
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if(format != "json" && format != "csv")
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    // the inputs go to a directory of this run's own, the only one removed afterwards
+    std::error_code ec;
+    fs::create_directories(cfg.dir, ec);
+    fs::path run_dir;
+    for(uint32_t n = 0; n < 10000 && run_dir.empty(); n++)
+    {
+        fs::path candidate = cfg.dir / ("run_" + std::to_string(n));
+        if(fs::create_directory(candidate, ec))
+            run_dir = candidate;
+        else if(ec)
+            break;
+    }
+    if(run_dir.empty())
+    {
+        std::cerr << "Cannot create directory in: " << cfg.dir.string() << std::endl;
+        return 1;
+    }
+    cfg.dir = run_dir;
+
+    BenchRunner runner(iterations, filter);
+    bool found = false;
+    for(auto & s : SUITES)
+    {
+        if(suite != "all" && suite != s.first)
+            continue;
+
+        found = true;
+        s.second(runner, cfg);
+    }
+
+    if(keep)
+        std::cerr << "Inputs kept in " << cfg.dir.string() << std::endl;
+    else
+        fs::remove_all(cfg.dir, ec);
+
+    if(!found)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    runner.WriteSummary(std::cerr);
+
+    std::ofstream ofs;
+    if(!out_name.empty())
+    {
+        ofs.open(out_name);
+        if(!ofs.is_open())
+        {
+            std::cerr << "Error opening file: " << out_name << std::endl;
+            return 1;
+        }
+    }
+
+    std::ostream & out = out_name.empty() ? std::cout : ofs;
+    if(format == "json")
+        runner.WriteJSON(out);
+    else
+        runner.WriteCSV(out);
+
+    for(auto & r : runner.Results())
+    {
+        if(!r.ok)
+            return 2;
+    }
+
+    return 0;
+}
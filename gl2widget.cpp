@@ -1,11 +1,85 @@
 #include "gl2widget.h"
+#include "AllocationCounter.h"
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <QFileDialog>
+#include <QFileInfo>
+#include <QtConcurrent>
 #include <QCoreApplication>
+#include <QDateTime>
 #include <QFrame>
+#include <QOpenGLContext>
+#include <QPointer>
+#include <QStandardPaths>
 #include <QDebug>
+#include <algorithm>
 #include <cassert>
+#include <cstddef>
+
+namespace
+{
+    // generic attribute slots not aliased by the fixed-function arrays on any driver
+    const int JOINT_ATTRIB = 6;
+    const int WEIGHT_ATTRIB = 7;
+
+    // frames between reports of the stream fence waits and the draw submission cost
+    const uint64_t REPORT_FRAMES = 600;
+
+    // One vertex of the static buffer: the bind pose drawn when nothing is
+    // skinned on the CPU, and the influences read by the skinning shader,
+    // 0-based joints and weights scaled to 65535 as the engine packs them
+    struct StaticVertex
+    {
+        glm::vec3 position;
+        glm::vec3 normal;
+        glm::vec2 uv;
+        uint8_t   joints[4];
+        uint16_t  weights[4];
+    };
+
+    // uniform vectors left for the built-in matrices and light state the shader reads
+    const int RESERVED_UNIFORM_VECTORS = 32;
+
+    // Linear blend skinning with 3x4 palette rows, followed by the per-vertex
+    // lighting the fixed-function pipeline does for the single directional
+    // light of the widget; texturing stays with the fixed-function fragment stage
+    const char * SKINNING_SHADER = R"(
+attribute vec4 jointIndices;
+attribute vec4 jointWeights;
+uniform vec4 paletteRows[3 * MAX_JOINTS];
+
+void main()
+{
+    vec4 row0 = vec4(0.0);
+    vec4 row1 = vec4(0.0);
+    vec4 row2 = vec4(0.0);
+    for(int k = 0; k < 4; k++)
+    {
+        int j = int(jointIndices[k]) * 3;
+        row0 += jointWeights[k] * paletteRows[j];
+        row1 += jointWeights[k] * paletteRows[j + 1];
+        row2 += jointWeights[k] * paletteRows[j + 2];
+    }
+
+    vec4 position = vec4(dot(row0, gl_Vertex), dot(row1, gl_Vertex), dot(row2, gl_Vertex), 1.0);
+    vec3 normal = vec3(dot(row0.xyz, gl_Normal), dot(row1.xyz, gl_Normal), dot(row2.xyz, gl_Normal));
+
+    gl_Position = gl_ModelViewProjectionMatrix * position;
+    gl_TexCoord[0] = gl_MultiTexCoord0;
+
+    vec3 n = normalize(gl_NormalMatrix * normal);
+    float diffuse = max(dot(n, normalize(gl_LightSource[0].position.xyz)), 0.0);
+    vec4 color = gl_FrontLightModelProduct.sceneColor + gl_FrontLightProduct[0].ambient
+               + gl_FrontLightProduct[0].diffuse * diffuse;
+    if(diffuse > 0.0)
+    {
+        float specular = max(dot(n, normalize(gl_LightSource[0].halfVector.xyz)), 0.0);
+        color += gl_FrontLightProduct[0].specular * pow(specular, gl_FrontMaterial.shininess);
+    }
+    gl_FrontColor = clamp(color, 0.0, 1.0);
+}
+)";
+}
 
 GL2Widget::GL2Widget(QWidget * parent)
         : QOpenGLWidget(parent),
@@ -16,7 +90,19 @@ GL2Widget::GL2Widget(QWidget * parent)
           _wire(false),
           _bbox_vbo_vertices(0),
           _bbox_ibo_elements(0),
-          _texLoaded(false)
+          _gpuSkinning(false),
+          _maxGpuJoints(0),
+          _paletteLocation(-1),
+          _frameLoopWarm(false),
+          _useVaos(true),
+          _vaosRecorded(false),
+          _overrideTex(0),
+          _staticbuffer(0),
+          _elementbuffer(0),
+          _indexType(GL_UNSIGNED_INT),
+          _streamNormals(0),
+          _multiDrawBaseVertex(nullptr),
+          _textures(&_cache)
 {
     timer.start();
 
@@ -24,18 +110,41 @@ GL2Widget::GL2Widget(QWidget * parent)
     connect(&_updateTimer, SIGNAL(timeout()), this, SLOT(update()));
     _updateTimer.start(16);
 
+    connect(&_meshJob.watcher, &QFutureWatcher<std::shared_ptr<Mesh>>::finished, this, &GL2Widget::meshLoaded);
+    connect(&_anmJob.watcher, &QFutureWatcher<std::shared_ptr<Mesh>>::finished, this, &GL2Widget::animationLoaded);
+    connect(&_texJob.watcher, &QFutureWatcher<std::shared_ptr<Mesh>>::finished, this, &GL2Widget::textureLoaded);
+
+    _cache.Open((QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/assets").toStdString(),
+                uint64_t(1) << 30);
+
     setFocusPolicy(Qt::StrongFocus);
 }
 
 GL2Widget::~GL2Widget()
 {
+    // loads abandoned for a newer one still run and report progress to the widget
+    for(LoadJob * job : {&_meshJob, &_anmJob, &_texJob})
+    {
+        if(job->monitor)
+            job->monitor->Cancel();
+        for(QFuture<std::shared_ptr<Mesh>> & future : job->running)
+            future.waitForFinished();
+        job->watcher.waitForFinished();
+    }
+
+    // the vertex array objects are released with the context current
+    makeCurrent();
+    _capture.Stop();
     if(!_glSubMeshes.empty())
     {
         ClearData();
     }
+    _textures.Release(_overrideTex);
+    _textures.Purge();
     
     glDeleteBuffers(1, &_bbox_vbo_vertices);
     glDeleteBuffers(1, &_bbox_ibo_elements);
+    doneCurrent();
 }
 
 QSize GL2Widget::minimumSizeHint() const
@@ -52,30 +161,107 @@ void GL2Widget::loadMesh()
 {
     QString fileName = QFileDialog::getOpenFileName(this, tr("Open Mesh"),
                                                     ".",
-                                                    tr("Mesh files (*.msh)"));
+                                                    tr("Mesh files (*.msh *.mshb)"));
 
     if(fileName.isEmpty())
             return;
 
     QByteArray ba = fileName.toUtf8();
-
-    _mainMesh = Mesh();
-    ClearData();
-
-    if(_mainMesh.LoadFromMsh(ba.data()))
+    Mesh::MshReader reader = QFileInfo(fileName).suffix().compare("mshb", Qt::CaseInsensitive) == 0
+                                                        ? Mesh::MshReader::mr_binary
+                                                        : Mesh::MshReader::mr_parallel;
+
+    AssetCache *     cache = &_cache;
+    TextureManager * textures = &_textures;
+    std::string      dir = QFileInfo(fileName).absolutePath().toStdString();
+    _meshJob.source = ba.data();
+    StartLoad(_meshJob, [cache, textures, ba, dir, reader](Mesh & msh, LoadMonitor & monitor)
     {
-        UploadData();
+        if(!cache->LoadMesh(ba.data(), msh, reader, &monitor))
+            return false;
 
-        int num_tri = 0;
-        for(auto & m : _mainMesh._meshes)
+        // one skinning kernel per influence count instead of the generic one; a no-op for
+        // meshes the cache loaded, they are stored grouped
+        msh.SortVerticesByInfluence();
+
+        // decode the materials here too, the hand-off then only uploads them;
+        // a missing image leaves its submeshes untextured
+        std::vector<std::string> materials;
+        for(const auto & sub_msh : msh._meshes)
         {
-            num_tri += m._indices.size()/3;
+            if(!sub_msh._tex_name.empty())
+                materials.push_back(TextureManager::ResolvePath(dir, sub_msh._tex_name));
         }
+        textures->Prefetch(materials, &monitor);
+        return true;
+    });
+}
 
-        emit numTriChanged(num_tri);
-        emit anmPresent(!_mainMesh._meshes[0]._wght_inds.empty());
-        emit anmLoaded(0);
-        emit stateBBoxCheck(false);
+void GL2Widget::meshLoaded()
+{
+    std::shared_ptr<Mesh> loaded = _meshJob.watcher.result();
+    std::shared_ptr<LoadMonitor> monitor = std::move(_meshJob.monitor);
+    if(!loaded)
+    {
+        if(monitor)
+            qDebug() << "Fail to load mesh";
+        return;
+    }
+
+    // a pending animation belongs to the mesh that is being replaced
+    if(_anmJob.monitor)
+    {
+        _anmJob.monitor->Cancel();
+        _anmJob.monitor.reset();
+    }
+
+    ReportCacheStats();
+
+    // textures shared with the previous mesh are released and acquired
+    // again before the purge, so they stay on the GPU
+    makeCurrent();
+    ClearData();
+    _mainMesh = std::move(*loaded);
+    _meshDir = QFileInfo(QString::fromStdString(_meshJob.source)).absolutePath().toStdString();
+    _skinning.Bind(_mainMesh);
+    _frameLoopWarm = false;
+    UploadData();
+    _textures.Purge();
+    doneCurrent();
+    ReportTextureStats();
+
+    const SkinningEngine::PackStats & pack = _skinning.GetPackStats();
+    if(pack.sourceBytes > 0)
+        qDebug() << "Skin weights packed:" << pack.sourceBytes << "->" << pack.packedBytes << "bytes,"
+                 << pack.prunedVertices << "vertices pruned, max weight error" << pack.maxWeightError;
+
+    int num_tri = 0;
+    for(auto & m : _mainMesh._meshes)
+    {
+        num_tri += m._indices.size()/3;
+    }
+
+    emit numTriChanged(num_tri);
+    emit anmPresent(!_mainMesh._meshes[0]._wght_inds.empty());
+    emit anmLoaded(0);
+    emit stateBBoxCheck(false);
+}
+
+void GL2Widget::saveMeshBinary()
+{
+    if(!isMshLoaded())
+        return;
+
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Save Mesh"),
+                                                    ".",
+                                                    tr("Binary mesh files (*.mshb)"));
+
+    if(fileName.isEmpty())
+            return;
+
+    if(!_mainMesh.SaveToMshb(fileName.toUtf8().data()))
+    {
+        qDebug() << "Fail to save mesh";
     }
 }
 
@@ -83,21 +269,66 @@ void GL2Widget::loadAnimation()
 {
     QString fileName = QFileDialog::getOpenFileName(this, tr("Open Mesh"),
                                                     ".",
-                                                    tr("Animation files (*.anm)"));
+                                                    tr("Animation files (*.anm *.anmb)"));
+
+    if(fileName.isEmpty())
+            return;
+
+    QByteArray ba = fileName.toUtf8();
+    AssetCache * cache = &_cache;
+
+    StartLoad(_anmJob, [cache, ba](Mesh & msh, LoadMonitor & monitor)
+    {
+        return cache->LoadAnimation(ba.data(), msh, &monitor);
+    });
+}
+
+void GL2Widget::animationLoaded()
+{
+    std::shared_ptr<Mesh> loaded = _anmJob.watcher.result();
+    std::shared_ptr<LoadMonitor> monitor = std::move(_anmJob.monitor);
+    // no monitor: dropped together with the mesh it was loaded for
+    if(!monitor || !isMshLoaded())
+        return;
+
+    if(!loaded)
+    {
+        qDebug() << "Fail to load animation";
+        return;
+    }
+
+    ReportCacheStats();
+
+    _mainMesh._anims = std::move(loaded->_anims);
+    _mainMesh._controller = loaded->_controller;
+    _frameLoopWarm = false;
+
+    emit anmLoaded(_mainMesh._anims[0].numFrames);
+}
+
+void GL2Widget::saveAnimationBinary()
+{
+    if(!isAnmLoaded())
+        return;
+
+    QString quantized = tr("Quantized animation (*.anmb)");
+    QString selectedFilter = quantized;
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Save Animation"),
+                                                    ".",
+                                                    quantized + ";;" + tr("Full precision animation (*.anmb)"),
+                                                    &selectedFilter);
 
     if(fileName.isEmpty())
             return;
 
-    if(_mainMesh.LoadFromAnm(fileName.toUtf8().data()))
+    if(!_mainMesh.SaveToAnmb(fileName.toUtf8().data(), selectedFilter == quantized))
     {
-        emit anmLoaded(_mainMesh._anims[0].frames.size());
+        qDebug() << "Fail to save animation";
     }
 }
 
 void GL2Widget::loadTexture()
 {
-    _texLoaded = false;
-
     QString fileName = QFileDialog::getOpenFileName(this, tr("Open Mesh"),
                                                     ".",
                                                     tr("Images (*.tga *.bmp)"));
@@ -105,31 +336,150 @@ void GL2Widget::loadTexture()
     if(fileName.isEmpty())
             return;
 
-    if(!_mainMesh.LoadTexture(fileName.toUtf8().data()))
+    std::string      path = TextureManager::ResolvePath(std::string(), fileName.toUtf8().data());
+    TextureManager * textures = &_textures;
+    _texJob.source = path;
+
+    StartLoad(_texJob, [textures, path](Mesh &, LoadMonitor & monitor)
     {
-        qDebug() << "Fail to load texture";
+        if(monitor.IsCancelled())
+            return false;
+
+        bool res = textures->Prefetch({path}, &monitor);
+        if(monitor.IsCancelled())
+            return false;
+        monitor.Finish();
+        return res;
+    });
+}
+
+void GL2Widget::textureLoaded()
+{
+    std::shared_ptr<Mesh> loaded = _texJob.watcher.result();
+    std::shared_ptr<LoadMonitor> monitor = std::move(_texJob.monitor);
+    if(!loaded)
+    {
+        if(monitor)
+            qDebug() << "Fail to load texture";
         return;
     }
 
-    _texLoaded = true;
-    if(isMshLoaded())
+    ReportCacheStats();
+
+    makeCurrent();
+    unsigned int tex = _textures.Acquire(_texJob.source);
+    if(tex != 0)
     {
-        for(auto & gl_msh : _glSubMeshes)
-        {
-            glGenTextures(1, &gl_msh._tex);
-            glBindTexture(GL_TEXTURE_2D, gl_msh._tex);
+        _textures.Release(_overrideTex);
+        _overrideTex = tex;
+    }
+    // a mesh load not handed off yet still has images to acquire, its hand-off purges
+    if(!_meshJob.monitor)
+        _textures.Purge();
+    doneCurrent();
 
-            glTexImage2D(GL_TEXTURE_2D, 0, _mainMesh._texData.type == ImageData::PixelType::pt_rgb ? 3 : 4,
-                         _mainMesh._texData.width, _mainMesh._texData.height, 0,
-                         _mainMesh._texData.type == ImageData::PixelType::pt_rgb ? GL_RGB : GL_RGBA,
-                         GL_UNSIGNED_BYTE, _mainMesh._texData.data.get());
+    if(tex == 0)
+        qDebug() << "Fail to load texture";
+    ReportTextureStats();
+}
 
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+void GL2Widget::ReportCacheStats() const
+{
+    AssetCache::Stats st = _cache.GetStats();
+    qDebug() << "Asset cache: hits" << st.hits << "misses" << st.misses
+             << "stores" << st.stores << "evictions" << st.evictions;
+}
 
-            glBindTexture(GL_TEXTURE_2D, 0);
-        }
+void GL2Widget::ReportTextureStats() const
+{
+    TextureManager::Stats st = _textures.GetStats();
+    qDebug() << "Textures:" << st.textures << "alive," << st.references << "references,"
+             << st.bytes / 1024 << "KB, uploads" << st.uploads << "shared" << st.shared;
+}
+
+void GL2Widget::ReportStreamStats() const
+{
+    const StreamBuffer::Stats & st = _stream.GetStats();
+    qDebug() << "Stream buffer:" << st.waits << "of" << st.frames << "frames waited for the GPU,"
+             << st.waitMs << "ms in total, longest" << st.maxWaitMs << "ms";
+}
+
+void GL2Widget::ReportCaptureStats() const
+{
+    FrameCapture::Stats st = _capture.GetStats();
+    qDebug() << "Capture:" << st.frames << "frames read back," << st.written << "written," << st.failed << "failed,"
+             << st.waits << "waited for the GPU" << st.waitMs << "ms," << st.stalls << "waited for the encoders"
+             << st.stallMs << "ms";
+}
+
+void GL2Widget::ToggleCapture()
+{
+    makeCurrent();
+    if(_capture.IsActive())
+    {
+        _capture.Stop();
+        ReportCaptureStats();
+        qDebug() << "Capture stopped," << _capture.Directory().c_str();
     }
+    else
+    {
+        QString dir = QStandardPaths::writableLocation(QStandardPaths::PicturesLocation) + "/GL2test/capture-"
+                      + QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss");
+        if(_capture.Start(dir.toStdString()))
+            qDebug() << "Capturing to" << dir << "through" << FrameCapture::ModeName(_capture.GetMode()) << "reads";
+    }
+    doneCurrent();
+}
+
+void GL2Widget::ReportDrawStats() const
+{
+    double frames = static_cast<double>(std::max<uint64_t>(_drawStats.frames, 1));
+    qDebug() << "Draw submission:" << (_useVaos && _vaosRecorded ? "vertex array objects," : "per draw arrays,")
+             << _drawStats.glCalls / frames << "GL calls," << _drawStats.drawCalls / frames << "draws and"
+             << _drawStats.cpuNs / frames / 1.0e6 << "ms per frame";
+}
+
+void GL2Widget::StartLoad(LoadJob & job, std::function<bool(Mesh&, LoadMonitor&)> load)
+{
+    // picking another file abandons the previous load of the same kind
+    if(job.monitor)
+        job.monitor->Cancel();
+
+    // progress goes to the GUI thread, where reports of an abandoned load are dropped
+    QPointer<GL2Widget> widget(this);
+    LoadJob *           target = &job;
+    auto                source = std::make_shared<std::weak_ptr<LoadMonitor>>();
+    auto monitor = std::make_shared<LoadMonitor>([widget, target, source](int percent)
+    {
+        if(!widget)
+            return;
+
+        QMetaObject::invokeMethod(widget.data(), [widget, target, source, percent]()
+        {
+            std::shared_ptr<LoadMonitor> reporting = source->lock();
+            if(widget && reporting && reporting == target->monitor)
+                emit widget->loadProgress(percent);
+        }, Qt::QueuedConnection);
+    });
+    *source = monitor;
+    job.monitor = monitor;
+    emit loadProgress(0);
+
+    QFuture<std::shared_ptr<Mesh>> future = QtConcurrent::run([load, monitor]() -> std::shared_ptr<Mesh>
+    {
+        auto msh = std::make_shared<Mesh>();
+        if(!load(*msh, *monitor) || monitor->IsCancelled())
+            return nullptr;
+
+        return msh;
+    });
+
+    // the watcher follows the latest load only, the destructor waits for all of them
+    job.running.erase(std::remove_if(job.running.begin(), job.running.end(),
+                                     [](const QFuture<std::shared_ptr<Mesh>> & f) { return f.isFinished(); }),
+                      job.running.end());
+    job.running.append(future);
+    job.watcher.setFuture(future);
 }
 
 void GL2Widget::drawBBox(int state)
@@ -137,6 +487,15 @@ void GL2Widget::drawBBox(int state)
     _mainMesh.DrawBBox(state == Qt::Checked);
 }
 
+void GL2Widget::gpuSkinning(int state)
+{
+    _gpuSkinning = state == Qt::Checked;
+    if(_gpuSkinning && _maxGpuJoints == 0)
+        qDebug() << "GPU skinning not available, skinning on the CPU";
+    else
+        qDebug() << "Skinning on the" << (_gpuSkinning ? "GPU" : "CPU");
+}
+
 void GL2Widget::initializeGL()
 {
     // connections
@@ -174,6 +533,48 @@ void GL2Widget::initializeGL()
     glMatrixMode(GL_MODELVIEW);
     auto viewMatrix = _cam.GetViewMatrix();
     glLoadMatrixf(glm::value_ptr(viewMatrix));
+
+    InitSkinningProgram();
+
+    // GL 3.2 / ARB_draw_elements_base_vertex draws a whole batch in one call
+    QOpenGLContext * ctx = context();
+    if(!ctx->isOpenGLES() && (ctx->format().version() >= qMakePair(3, 2)
+                              || ctx->hasExtension("GL_ARB_draw_elements_base_vertex")))
+    {
+        _multiDrawBaseVertex = reinterpret_cast<MultiDrawElementsBaseVertexProc>(
+                                   ctx->getProcAddress("glMultiDrawElementsBaseVertex"));
+    }
+
+    // mip chains always, BC1/BC3 blocks only where the driver takes them; uncompressed
+    // textures go to GL straight from their mapped files and the driver filters the levels
+    TextureOptions opt;
+    opt.compress = ctx->hasExtension("GL_EXT_texture_compression_s3tc");
+    if(!opt.compress)
+        opt.filter = MipFilter::mf_driver;
+    _textures.SetOptions(opt);
+}
+
+void GL2Widget::InitSkinningProgram()
+{
+    GLint components = 0;
+    glGetIntegerv(GL_MAX_VERTEX_UNIFORM_COMPONENTS, &components);
+    _maxGpuJoints = std::max(0, (components / 4 - RESERVED_UNIFORM_VECTORS) / 3);
+
+    QByteArray source = "#version 120\n#define MAX_JOINTS " + QByteArray::number(_maxGpuJoints) + "\n";
+    source += SKINNING_SHADER;
+
+    _skinProgram.bindAttributeLocation("jointIndices", JOINT_ATTRIB);
+    _skinProgram.bindAttributeLocation("jointWeights", WEIGHT_ATTRIB);
+    if(_maxGpuJoints == 0
+       || !_skinProgram.addShaderFromSourceCode(QOpenGLShader::Vertex, source)
+       || !_skinProgram.link())
+    {
+        qDebug() << "Fail to build skinning shader:" << _skinProgram.log();
+        _maxGpuJoints = 0;
+        return;
+    }
+
+    _paletteLocation = _skinProgram.uniformLocation("paletteRows");
 }
 
 void GL2Widget::paintGL()
@@ -183,6 +584,15 @@ void GL2Widget::paintGL()
     glEnable(GL_CULL_FACE);
 
     RenderMesh();
+
+    // the frame as drawn, read from the framebuffer of the widget before Qt composes it
+    if(_capture.IsActive())
+    {
+        _capture.Capture(static_cast<int>(width() * devicePixelRatioF()),
+                         static_cast<int>(height() * devicePixelRatioF()));
+        if(_capture.GetStats().frames % REPORT_FRAMES == 0)
+            ReportCaptureStats();
+    }
 }
 
 void GL2Widget::resizeGL(int w, int h)
@@ -240,129 +650,314 @@ void GL2Widget::UploadData()
 
     _glSubMeshes.clear();
     _glSubMeshes.resize(_mainMesh._meshes.size());
+    _glBatches.clear();
 
+    // lay the submeshes out one after the other and group them by texture
+    size_t   numVertices = 0;
+    size_t   numIndices = 0;
+    size_t   maxSubVertices = 0;
+    bool     skinned = false;
     for(unsigned int i = 0; i < _mainMesh._meshes.size(); i++)
     {
         auto & msh = _mainMesh._meshes[i];
 
         assert(msh._positions.size() > 0);
         assert(msh._uvs.size() > 0);
-        assert(msh._normals.size() > 0);
+        assert(msh._normals.size() == msh._positions.size());
         assert(msh._indices.size() > 0);
 
-        glGenBuffers(1, &_glSubMeshes[i]._vertexbuffer);
-        glBindBuffer(GL_ARRAY_BUFFER, _glSubMeshes[i]._vertexbuffer);
-        glBufferData(GL_ARRAY_BUFFER, msh._positions.size() * sizeof(glm::vec3), &msh._positions[0], GL_STREAM_DRAW);
+        _glSubMeshes[i]._baseVertex = static_cast<uint32_t>(numVertices);
+        numVertices += msh._positions.size();
+        numIndices += msh._indices.size();
+        maxSubVertices = std::max(maxSubVertices, msh._positions.size());
+        skinned = skinned || !msh._wght_inds.empty();
 
-        glGenBuffers(1, &_glSubMeshes[i]._uvbuffer);
-        glBindBuffer(GL_ARRAY_BUFFER, _glSubMeshes[i]._uvbuffer);
-        glBufferData(GL_ARRAY_BUFFER, msh._uvs[0].size() * sizeof(glm::vec2), msh._uvs[0].data(), GL_STATIC_DRAW);
+        auto batch = std::find_if(_glBatches.begin(), _glBatches.end(),
+                                  [&msh](const GLBatch & b) { return b._texName == msh._tex_name; });
+        if(batch == _glBatches.end())
+        {
+            _glBatches.emplace_back();
+            batch = _glBatches.end() - 1;
+            batch->_texName = msh._tex_name;
+        }
+        batch->_subMeshes.push_back(i);
+    }
 
-        glGenBuffers(1, &_glSubMeshes[i]._normalbuffer);
-        glBindBuffer(GL_ARRAY_BUFFER, _glSubMeshes[i]._normalbuffer);
-        glBufferData(GL_ARRAY_BUFFER, msh._normals.size() * sizeof(glm::vec3), &msh._normals[0], GL_STREAM_DRAW);
+    // with base vertices the indices stay local to their submesh, otherwise
+    // they are rebased and have to address the whole buffer
+    size_t indexRange = _multiDrawBaseVertex ? maxSubVertices : numVertices;
+    _indexType = indexRange <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    size_t indexSize = _indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+
+    std::vector<glm::vec4>    joints;
+    std::vector<glm::vec4>    weights;
+    std::vector<StaticVertex> vertices(numVertices);
+    std::vector<char>         indices(numIndices * indexSize);
+    size_t                    indexOffset = 0;
+    for(unsigned int i = 0; i < _mainMesh._meshes.size(); i++)
+    {
+        auto &      msh = _mainMesh._meshes[i];
+        GLSubMesh & gl_msh = _glSubMeshes[i];
 
-        // Generate a buffer for the indices as well
-        glGenBuffers(1, &_glSubMeshes[i]._elementbuffer);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _glSubMeshes[i]._elementbuffer);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, msh._indices.size() * sizeof(unsigned int), &msh._indices[0], GL_STATIC_DRAW);
+        // influences never change, the shader path only needs the palette per frame
+        gl_msh._skinAttribs = _maxGpuJoints > 0 && _skinning.Influences(i, joints, weights);
 
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        for(size_t v = 0; v < msh._positions.size(); v++)
+        {
+            StaticVertex & vtx = vertices[gl_msh._baseVertex + v];
+            vtx.position = msh._positions[v];
+            vtx.normal = msh._normals[v];
+            vtx.uv = msh._uvs[0][v];
+            for(int k = 0; gl_msh._skinAttribs && k < 4; k++)
+            {
+                vtx.joints[k] = static_cast<uint8_t>(joints[v][k]);
+                vtx.weights[k] = static_cast<uint16_t>(weights[v][k] * 65535.0f + 0.5f);
+            }
+        }
 
-        if(_texLoaded)
+        gl_msh._indexOffset = indexOffset;
+        uint32_t rebase = _multiDrawBaseVertex ? 0 : gl_msh._baseVertex;
+        for(size_t n = 0; n < msh._indices.size(); n++)
         {
-            glGenTextures(1, &_glSubMeshes[i]._tex);
-            glBindTexture(GL_TEXTURE_2D, _glSubMeshes[i]._tex);
+            uint32_t index = msh._indices[n] + rebase;
+            if(_indexType == GL_UNSIGNED_SHORT)
+                reinterpret_cast<uint16_t*>(&indices[indexOffset])[n] = static_cast<uint16_t>(index);
+            else
+                reinterpret_cast<uint32_t*>(&indices[indexOffset])[n] = index;
+        }
+        indexOffset += msh._indices.size() * indexSize;
+    }
 
-            glTexImage2D(GL_TEXTURE_2D, 0, _mainMesh._texData.type == ImageData::PixelType::pt_rgb ? 3 : 4,
-                         _mainMesh._texData.width, _mainMesh._texData.height, 0,
-                         _mainMesh._texData.type == ImageData::PixelType::pt_rgb ? GL_RGB : GL_RGBA,
-                         GL_UNSIGNED_BYTE, _mainMesh._texData.data.get());
+    for(GLBatch & batch : _glBatches)
+    {
+        for(uint32_t i : batch._subMeshes)
+        {
+            batch._counts.push_back(static_cast<GLsizei>(_mainMesh._meshes[i]._indices.size()));
+            batch._offsets.push_back((char*)NULL + _glSubMeshes[i]._indexOffset);
+            batch._baseVertices.push_back(static_cast<GLint>(_glSubMeshes[i]._baseVertex));
+        }
+    }
+    _splitCounts.resize(_glSubMeshes.size());
+    _splitOffsets.resize(_glSubMeshes.size());
+    _splitBaseVertices.resize(_glSubMeshes.size());
 
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glGenBuffers(1, &_staticbuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, _staticbuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(StaticVertex), vertices.data(), GL_STATIC_DRAW);
 
-            glBindTexture(GL_TEXTURE_2D, 0);
-        }
+    glGenBuffers(1, &_elementbuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _elementbuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size(), indices.data(), GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    // CPU skinning writes all positions, then all normals into one stream frame
+    _streamNormals = (numVertices * sizeof(glm::vec3) + 15) & ~size_t(15);
+    size_t streamBytes = _streamNormals + numVertices * sizeof(glm::vec3);
+    if(skinned && _stream.Create(streamBytes))
+        qDebug() << "Stream buffer:" << StreamBuffer::ModeName(_stream.GetMode()) << "mode,"
+                 << StreamBuffer::NUM_REGIONS << "x" << streamBytes << "bytes";
+
+    RecordVertexArrays();
+    qDebug() << "Mesh batches:" << _glSubMeshes.size() << "submeshes in" << _glBatches.size() << "batches,"
+             << (_indexType == GL_UNSIGNED_SHORT ? 16 : 32) << "bit indices";
+
+    AcquireTextures();
+}
+
+int GL2Widget::SetupArrays(bool streamed, size_t stream_offset)
+{
+    const GLsizei stride = sizeof(StaticVertex);
+    int calls = 7;
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _elementbuffer);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+
+    glBindBuffer(GL_ARRAY_BUFFER, _staticbuffer);
+    glTexCoordPointer(2, GL_FLOAT, stride, (char*)NULL + offsetof(StaticVertex, uv));
+    if(streamed)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, _stream.Buffer());
+        glNormalPointer(GL_FLOAT, 0, (char*)NULL + stream_offset + _streamNormals);
+        glVertexPointer(3, GL_FLOAT, 0, (char*)NULL + stream_offset);
+        return calls + 3;
     }
+
+    // generic slots 6 and 7 are ignored by the fixed-function path, they may stay enabled;
+    // submeshes without influences read zero weights there and are never drawn by the shader
+    glNormalPointer(GL_FLOAT, stride, (char*)NULL + offsetof(StaticVertex, normal));
+    glVertexPointer(3, GL_FLOAT, stride, (char*)NULL + offsetof(StaticVertex, position));
+    glVertexAttribPointer(JOINT_ATTRIB, 4, GL_UNSIGNED_BYTE, GL_FALSE, stride,
+                          (char*)NULL + offsetof(StaticVertex, joints));
+    glEnableVertexAttribArray(JOINT_ATTRIB);
+    glVertexAttribPointer(WEIGHT_ATTRIB, 4, GL_UNSIGNED_SHORT, GL_TRUE, stride,
+                          (char*)NULL + offsetof(StaticVertex, weights));
+    glEnableVertexAttribArray(WEIGHT_ATTRIB);
+    return calls + 6;
 }
 
-void GL2Widget::ClearData()
+int GL2Widget::ResetArrays()
+{
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableVertexAttribArray(JOINT_ATTRIB);
+    glDisableVertexAttribArray(WEIGHT_ATTRIB);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return 7;
+}
+
+void GL2Widget::RecordVertexArrays()
+{
+    // without VAO support (GL 3.0, ARB or APPLE_vertex_array_object) every frame sets up the arrays
+    _vaosRecorded = false;
+    _vao.reset(new QOpenGLVertexArrayObject);
+    if(!_vao->create())
+    {
+        qDebug() << "Vertex array objects not supported, arrays are set up per frame";
+        return;
+    }
+    _vao->bind();
+    SetupArrays(false, 0);
+    _vao->release();
+
+    for(uint32_t r = 0; _stream.IsCreated() && r < StreamBuffer::NUM_REGIONS; r++)
+    {
+        _streamVaos[r].reset(new QOpenGLVertexArrayObject);
+        _streamVaos[r]->create();
+        _streamVaos[r]->bind();
+        SetupArrays(true, r * _stream.RegionBytes());
+        _streamVaos[r]->release();
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    _vaosRecorded = true;
+}
+
+int GL2Widget::DrawSubMeshes(const GLsizei * counts, const void * const * offsets, const GLint * base_vertices,
+                             GLsizei num)
+{
+    if(num == 0)
+        return 0;
+
+    if(_multiDrawBaseVertex)
+    {
+        _multiDrawBaseVertex(GL_TRIANGLES, counts, _indexType, offsets, num, base_vertices);
+        return 1;
+    }
+
+    // indices were rebased at upload
+    for(GLsizei d = 0; d < num; d++)
+        glDrawElements(GL_TRIANGLES, counts[d], _indexType, offsets[d]);
+    return num;
+}
+
+GLsizei GL2Widget::SplitBatch(const GLBatch & batch, bool shaded)
+{
+    // submeshes whose weights do not fit the skeleton stay in the bind pose, as on the CPU
+    GLsizei num = 0;
+    for(size_t n = 0; n < batch._subMeshes.size(); n++)
+    {
+        uint32_t i = batch._subMeshes[n];
+        bool fits = _glSubMeshes[i]._skinAttribs && _skinning.NumJoints(i) <= _mainMesh._anims[0].numBones;
+        if(fits != shaded)
+            continue;
+        _splitCounts[num] = batch._counts[n];
+        _splitOffsets[num] = batch._offsets[n];
+        _splitBaseVertices[num] = batch._baseVertices[n];
+        num++;
+    }
+    return num;
+}
+
+void GL2Widget::AcquireTextures()
 {
-    for(auto & gl_msh : _glSubMeshes)
+    for(auto & batch : _glBatches)
     {
-        glDeleteBuffers(1, &gl_msh._vertexbuffer);
-        glDeleteBuffers(1, &gl_msh._normalbuffer);
-        glDeleteBuffers(1, &gl_msh._uvbuffer);
-        glDeleteBuffers(1, &gl_msh._elementbuffer);
-        if(_texLoaded)
-            glDeleteTextures(1, &gl_msh._tex);
+        if(!batch._texName.empty())
+            batch._tex = _textures.Acquire(TextureManager::ResolvePath(_meshDir, batch._texName));
     }
 }
 
+void GL2Widget::ReleaseTextures()
+{
+    for(auto & batch : _glBatches)
+    {
+        _textures.Release(batch._tex);
+        batch._tex = 0;
+    }
+}
+
+void GL2Widget::ClearData()
+{
+    glDeleteBuffers(1, &_staticbuffer);
+    glDeleteBuffers(1, &_elementbuffer);
+    _staticbuffer = 0;
+    _elementbuffer = 0;
+    _vao.reset();
+    for(auto & vao : _streamVaos)
+        vao.reset();
+    _vaosRecorded = false;
+    _stream.Destroy();
+
+    ReleaseTextures();
+
+    _glSubMeshes.clear();
+    _glBatches.clear();
+}
+
 void GL2Widget::RenderMesh()
 {
     if(!isMshLoaded())
         return;
+
+    // the first frame after a load sizes the pose, palette and skin
+    // buffers, every later one must skin and submit without allocating
+    AllocationScope frameAllocations;
+
     float        frameDelta(0.0f);
     unsigned int prevFrame = 0;
     unsigned int nextFrame = 0;
+    AABB         box = _mainMesh._base_bbox;
+    bool         gpuSkinned = false;
+    bool         streamed = false;
+    size_t       streamOffset = 0;
 
     if(isAnmLoaded())
     {
         double       controlTime = _mainMesh._controller.GetControlTime(elapsed());
         prevFrame = glm::floor(controlTime * _mainMesh._anims[0].frameRate);
         nextFrame = prevFrame + 1;
-        if(prevFrame == _mainMesh._anims[0].frames.size() - 1)
+        if(prevFrame == _mainMesh._anims[0].numFrames - 1)
             nextFrame = 0;
 
         frameDelta = controlTime * _mainMesh._anims[0].frameRate - prevFrame;
 
-        Mesh::AnimSequence::JointNode tr;
-        for(unsigned int i = 0; i < _mainMesh._anims[0].frames[0].rot.size(); i++)
+        // skeletons over the uniform budget fall back to the CPU
+        gpuSkinned = _gpuSkinning && _mainMesh._anims[0].numBones <= static_cast<uint32_t>(_maxGpuJoints);
+        if(gpuSkinned)
         {
-            tr.rot.push_back(glm::normalize(glm::slerp(_mainMesh._anims[0].frames[prevFrame].rot[i],
-                                                       _mainMesh._anims[0].frames[nextFrame].rot[i],
-                                                       frameDelta)));
-            tr.trans.push_back(glm::mix(_mainMesh._anims[0].frames[prevFrame].trans[i],
-                                        _mainMesh._anims[0].frames[nextFrame].trans[i],
-                                        frameDelta));
-
+            _skinning.UpdatePalette(prevFrame, nextFrame, frameDelta);
         }
-
-        for(unsigned int i = 0; i < _mainMesh._meshes.size(); i++)
+        else if(_stream.IsCreated())
         {
-            auto & sub_msh = _mainMesh._meshes[i];
-            std::vector<glm::vec3> curPosVec;
-            std::vector<glm::vec3> curNorVec;
-
-            for(unsigned int n = 0; n < sub_msh._positions.size(); n++)
+            // skin straight into the stream region, the bind pose buffers stay untouched
+            char * frame = static_cast<char*>(_stream.BeginFrame());
+            glm::vec3 * positions = reinterpret_cast<glm::vec3*>(frame);
+            glm::vec3 * normals = reinterpret_cast<glm::vec3*>(frame + _streamNormals);
+            for(unsigned int i = 0; i < _skinning.NumSubMeshes(); i++)
             {
-                glm::mat4 matTr(0.0f);
-                for(unsigned int j = 0; j < sub_msh._wght_inds[n].second
-                                            - sub_msh._wght_inds[n].first; j++)
-                {
-                    glm::mat4 mt = glm::mat4_cast(tr.rot[sub_msh._weights[sub_msh._wght_inds[n].first + j].jnt_index - 1]);
-                    mt = glm::column(mt, 3,
-                            glm::vec4(tr.trans[sub_msh._weights[sub_msh._wght_inds[n].first + j].jnt_index - 1], 1.0f));
-
-                    matTr += sub_msh._weights[sub_msh._wght_inds[n].first + j].w * mt;
-                }
-
-                glm::vec4 cpos = matTr * glm::vec4(sub_msh._positions[n], 1.0);
-                glm::vec3 norm = glm::mat3(matTr) * sub_msh._normals[n];
-
-                curPosVec.push_back(glm::vec3(cpos));
-                curNorVec.push_back(norm);
+                uint32_t base = _glSubMeshes[i]._baseVertex;
+                _skinning.SetTarget(i, positions + base, normals + base);
             }
-
-            glBindBuffer(GL_ARRAY_BUFFER_ARB, _glSubMeshes[i]._vertexbuffer);
-            glBufferSubData(GL_ARRAY_BUFFER_ARB, 0, curPosVec.size() * 3 * sizeof(float), &curPosVec[0]);
-
-            glBindBuffer(GL_ARRAY_BUFFER_ARB, _glSubMeshes[i]._normalbuffer);
-            glBufferSubData(GL_ARRAY_BUFFER_ARB, 0, curNorVec.size() * 3 * sizeof(float), &curNorVec[0]);
+            _skinning.Update(prevFrame, nextFrame, frameDelta);
+            streamOffset = _stream.EndFrame();
+            streamed = true;
         }
+        box = _skinning.BBox();
     }
 
     glMatrixMode(GL_MODELVIEW);
@@ -371,59 +966,81 @@ void GL2Widget::RenderMesh()
     glPushMatrix();
     glMultMatrixf(glm::value_ptr(_mainMesh._modelMatrix));
 
-    glPolygonMode( GL_FRONT_AND_BACK, _wire ? GL_LINE : GL_FILL );
-    for(unsigned int i = 0; i < _mainMesh._meshes.size(); i++)
+    if(gpuSkinned)
     {
-        assert(_glSubMeshes[i]._vertexbuffer > 0);
-        assert(_glSubMeshes[i]._normalbuffer > 0);
-        assert(_glSubMeshes[i]._uvbuffer > 0);
-        assert(_glSubMeshes[i]._elementbuffer > 0);
-
-        glBindTexture(GL_TEXTURE_2D, _glSubMeshes[i]._tex);
+        const std::vector<float> & rows = _skinning.PaletteRows();
+        _skinProgram.bind();
+        _skinProgram.setUniformValueArray(_paletteLocation, rows.data(), static_cast<int>(rows.size() / 4), 4);
+        _skinProgram.release();
+    }
 
-        glEnableClientState(GL_VERTEX_ARRAY);
-        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-        glEnableClientState(GL_NORMAL_ARRAY);
+    glPolygonMode( GL_FRONT_AND_BACK, _wire ? GL_LINE : GL_FILL );
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _glSubMeshes[i]._elementbuffer);
+    // one set of arrays for the whole mesh, one texture bind and multi-draw per batch
+    QElapsedTimer submitTime;
+    submitTime.start();
+    uint64_t calls = 0;
+    uint64_t draws = 0;
+    bool     vaos = _useVaos && _vaosRecorded;
+    if(vaos)
+    {
+        uint32_t region = streamed ? static_cast<uint32_t>(streamOffset / _stream.RegionBytes()) : 0;
+        (streamed ? _streamVaos[region] : _vao)->bind();
+        calls++;
+    }
+    else
+    {
+        calls += SetupArrays(streamed, streamOffset);
+    }
 
-        glBindBuffer(GL_ARRAY_BUFFER, _glSubMeshes[i]._normalbuffer);
-        glNormalPointer(GL_FLOAT, 0, (char*)NULL);
-        glBindBuffer(GL_ARRAY_BUFFER, _glSubMeshes[i]._uvbuffer);
-        glTexCoordPointer(2, GL_FLOAT, 0, (char*)NULL);
-        glBindBuffer(GL_ARRAY_BUFFER, _glSubMeshes[i]._vertexbuffer);
-        glVertexPointer(3, GL_FLOAT, 0, (char*)NULL);
+    for(const GLBatch & batch : _glBatches)
+    {
+        glBindTexture(GL_TEXTURE_2D, _overrideTex != 0 ? _overrideTex : batch._tex);
+        calls++;
 
-        glDrawElements(GL_TRIANGLES, _mainMesh._meshes[i]._indices.size(), GL_UNSIGNED_INT, (char*)NULL);
+        if(!gpuSkinned)
+        {
+            draws += DrawSubMeshes(batch._counts.data(), batch._offsets.data(), batch._baseVertices.data(),
+                                   static_cast<GLsizei>(batch._counts.size()));
+            continue;
+        }
 
-        glDisableClientState(GL_VERTEX_ARRAY);
-        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
-        glDisableClientState(GL_NORMAL_ARRAY);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        GLsizei num = SplitBatch(batch, true);
+        if(num > 0)
+        {
+            _skinProgram.bind();
+            draws += DrawSubMeshes(_splitCounts.data(), _splitOffsets.data(), _splitBaseVertices.data(), num);
+            _skinProgram.release();
+            calls += 2;
+        }
+        num = SplitBatch(batch, false);
+        draws += DrawSubMeshes(_splitCounts.data(), _splitOffsets.data(), _splitBaseVertices.data(), num);
+    }
 
-        glBindTexture(GL_TEXTURE_2D, 0);
+    if(vaos)
+    {
+        (streamed ? _streamVaos[0] : _vao)->release();
+        calls++;
+    }
+    else
+    {
+        calls += ResetArrays();
     }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    _drawStats.frames++;
+    _drawStats.glCalls += calls + draws + 1;
+    _drawStats.drawCalls += draws;
+    _drawStats.cpuNs += submitTime.nsecsElapsed();
 
     glPolygonMode( GL_FRONT_AND_BACK, GL_FILL );
     glPopMatrix();
 
+    if(streamed)
+        _stream.Fence();
+
     if(_mainMesh.isDrawBBox())
     {
-        AABB box;
-        if(isAnmLoaded())
-        {
-            glm::vec3 min = glm::mix(_mainMesh._anims[0].frames[prevFrame].bbox.min(),
-                                     _mainMesh._anims[0].frames[nextFrame].bbox.min(),
-                                     frameDelta);
-            glm::vec3 max = glm::mix(_mainMesh._anims[0].frames[prevFrame].bbox.max(),
-                                     _mainMesh._anims[0].frames[nextFrame].bbox.max(),
-                                     frameDelta);
-            box = AABB(min, max);
-        }
-        else
-            box = _mainMesh._base_bbox;
-
         box.transform(_mainMesh._modelMatrix);
 
         glm::vec3 size = box.max() - box.min();
@@ -465,6 +1082,18 @@ void GL2Widget::RenderMesh()
         glLineWidth(1);
         glEnable(GL_LIGHTING);
     }
+
+    assert(!_frameLoopWarm || frameAllocations.Allocations() == 0);
+    _frameLoopWarm = true;
+
+    // the periodic reports format text, they come after the check
+    if(_drawStats.frames == REPORT_FRAMES)
+    {
+        ReportDrawStats();
+        _drawStats = DrawStats();
+    }
+    if(streamed && _stream.GetStats().frames % REPORT_FRAMES == 0)
+        ReportStreamStats();
 }
 
 void GL2Widget::keyPressEvent(QKeyEvent * event)
@@ -485,6 +1114,14 @@ void GL2Widget::keyPressEvent(QKeyEvent * event)
         case Qt::Key_W:
             _wire = !_wire;
             break;
+        case Qt::Key_V:
+            // compare the submission cost of both paths
+            _useVaos = !_useVaos;
+            _drawStats = DrawStats();
+            break;
+        case Qt::Key_C:
+            ToggleCapture();
+            break;
         case Qt::Key_Escape:
             QCoreApplication::quit();
             break;
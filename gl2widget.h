@@ -3,12 +3,24 @@
 
 #include <QOpenGLWidget>
 #include <QElapsedTimer>
+#include <QFuture>
+#include <QFutureWatcher>
+#include <QList>
 #include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
 #include <QTimer>
 #include <QKeyEvent>
 #include <glm/glm.hpp>
+#include <functional>
+#include <memory>
 #include "camera.h"
 #include "Mesh.h"
+#include "AssetCache.h"
+#include "FrameCapture.h"
+#include "SkinningEngine.h"
+#include "StreamBuffer.h"
+#include "TextureManager.h"
 
 class GL2Widget : public QOpenGLWidget, protected QOpenGLFunctions
 {
@@ -26,11 +38,21 @@ public:
 
 public slots:
     void loadMesh();
+    void saveMeshBinary();
     void loadAnimation();
+    void saveAnimationBinary();
     void loadTexture();
     void drawBBox(int state);
+    void gpuSkinning(int state);
+
+private slots:
+    // hand-off of finished background loads, run on the GUI thread
+    void meshLoaded();
+    void animationLoaded();
+    void textureLoaded();
 
 signals:
+    void loadProgress(int percent);
     void numTriChanged(int numTri);
     void anmLoaded(int numFrames);
     void anmPresent(bool val);
@@ -48,9 +70,29 @@ protected:
 
     void RenderMesh();
     void UploadData();
+    void AcquireTextures();
+    void InitSkinningProgram();
+    void ReleaseTextures();
     void ClearData();
 
 private:
+    // Assets are parsed into a scratch Mesh on a worker thread while the
+    // current one keeps rendering; only the GL upload happens on hand-off
+    struct LoadJob
+    {
+        std::shared_ptr<LoadMonitor>          monitor;
+        QFutureWatcher<std::shared_ptr<Mesh>> watcher;
+        QList<QFuture<std::shared_ptr<Mesh>>> running;      // loads not finished, abandoned ones too
+        std::string                           source;       // file of the latest load
+    };
+
+    void StartLoad(LoadJob & job, std::function<bool(Mesh&, LoadMonitor&)> load);
+    void ReportCacheStats() const;
+    void ReportTextureStats() const;
+    void ReportStreamStats() const;
+    void ReportCaptureStats() const;
+    void ToggleCapture();
+
     QElapsedTimer timer;
     QTimer _updateTimer;
 
@@ -60,28 +102,102 @@ private:
 
     QPoint  _lastPos;
 
+    // All submeshes share one interleaved static buffer and one index
+    // buffer; a submesh is a base vertex and a range of indices in them
     struct GLSubMesh
     {
-        unsigned int  _vertexbuffer;
-        unsigned int  _normalbuffer;
-        unsigned int  _uvbuffer;
-        unsigned int  _elementbuffer;
-        unsigned int  _tex;
-
-        GLSubMesh() : _vertexbuffer(0),
-                      _normalbuffer(0),
-                      _uvbuffer(0),
-                      _elementbuffer(0),
-                      _tex(0) {}
+        uint32_t      _baseVertex;
+        size_t        _indexOffset;           // bytes into the element buffer
+        bool          _skinAttribs;           // influences filled, the submesh can be skinned on the GPU
+
+        GLSubMesh() : _baseVertex(0),
+                      _indexOffset(0),
+                      _skinAttribs(false) {}
+    };
+
+    // Submeshes sharing a texture, drawn with one multi-draw call; the
+    // arrays hold its arguments for all of them
+    struct GLBatch
+    {
+        std::string              _texName;
+        unsigned int             _tex;            // material texture, 0 without
+        std::vector<uint32_t>    _subMeshes;
+        std::vector<GLsizei>     _counts;
+        std::vector<const void*> _offsets;
+        std::vector<GLint>       _baseVertices;
+
+        GLBatch() : _tex(0) {}
+    };
 
+    // GL calls and CPU time spent submitting the meshes, reported every few hundred frames
+    struct DrawStats
+    {
+        uint64_t frames;
+        uint64_t glCalls;
+        uint64_t drawCalls;
+        qint64   cpuNs;
+
+        DrawStats() : frames(0), glCalls(0), drawCalls(0), cpuNs(0) {}
     };
 
+    typedef void (QOPENGLF_APIENTRYP MultiDrawElementsBaseVertexProc)(GLenum mode, const GLsizei * count,
+                                                                       GLenum type, const void * const * indices,
+                                                                       GLsizei drawcount, const GLint * basevertex);
+
+    // bind the attribute arrays of the mesh, recorded once into the VAOs
+    // or issued every frame without them; both return the GL calls made
+    int  SetupArrays(bool streamed, size_t stream_offset);
+    int  ResetArrays();
+    void RecordVertexArrays();
+    // draw submeshes of the bound arrays, returns the draw calls made
+    int  DrawSubMeshes(const GLsizei * counts, const void * const * offsets, const GLint * base_vertices,
+                       GLsizei num);
+    // gather the submeshes of a batch skinned, or not, by the shader into the split arrays
+    GLsizei SplitBatch(const GLBatch & batch, bool shaded);
+    void ReportDrawStats() const;
+
     unsigned int  _bbox_vbo_vertices;
     unsigned int  _bbox_ibo_elements;
 
+    // Skinning in the vertex shader: joint indices and weights are static
+    // attributes, only the palette is uploaded per frame
+    QOpenGLShaderProgram _skinProgram;
+    bool                 _gpuSkinning;
+    int                  _maxGpuJoints;
+    int                  _paletteLocation;
+
     Mesh                   _mainMesh;
-    bool                   _texLoaded;
+    SkinningEngine         _skinning;         // bound to _mainMesh
+    bool                   _frameLoopWarm;    // buffers sized by a frame since the last load
+    StreamBuffer           _stream;           // CPU skinned positions and normals, rewritten every frame
+    bool                   _useVaos;          // draw through the recorded VAOs, toggled with V
+    bool                   _vaosRecorded;     // VAOs exist for every source
+    DrawStats              _drawStats;
+    FrameCapture           _capture;          // rendered frames to numbered TGA files, toggled with C
+    unsigned int           _overrideTex;      // picked by hand, replaces the materials of every batch
+    std::string            _meshDir;          // material names are relative to it
     std::vector<GLSubMesh> _glSubMeshes;
+    std::vector<GLBatch>   _glBatches;
+
+    unsigned int           _staticbuffer;     // interleaved bind pose, uvs and GPU skinning influences
+    unsigned int           _elementbuffer;
+    unsigned int           _indexType;        // GL_UNSIGNED_SHORT when every index fits
+    size_t                 _streamNormals;    // skinned normals inside a stream frame, positions come first
+    std::unique_ptr<QOpenGLVertexArrayObject> _vao;
+    std::unique_ptr<QOpenGLVertexArrayObject> _streamVaos[StreamBuffer::NUM_REGIONS];
+
+    // null without GL 3.2 / ARB_draw_elements_base_vertex, indices are then
+    // rebased at upload and a batch is drawn one submesh at a time
+    MultiDrawElementsBaseVertexProc _multiDrawBaseVertex;
+    std::vector<GLsizei>           _splitCounts;      // GPU skinning: batch parts with and without the shader
+    std::vector<const void*>       _splitOffsets;
+    std::vector<GLint>             _splitBaseVertices;
+
+    AssetCache             _cache;            // parsed assets, shared by all load jobs
+    TextureManager         _textures;         // GL textures of the materials and the picked texture
+    LoadJob                _meshJob;
+    LoadJob                _anmJob;
+    LoadJob                _texJob;
 };
 
 #endif // GL2WIDGET_H
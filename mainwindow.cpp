@@ -16,15 +16,19 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->glWidgetLayout->addWidget(glWindow);
 
     connect(ui->loadMdlButton, &QPushButton::clicked, glWindow, &GL2Widget::loadMesh);
+    connect(glWindow, &GL2Widget::loadProgress, this, &MainWindow::updateLoadProgress);
+    connect(ui->saveMshbButton, &QPushButton::clicked, glWindow, &GL2Widget::saveMeshBinary);
     connect(glWindow, &GL2Widget::numTriChanged, this, &MainWindow::updateMeshTriangles);
     connect(glWindow, &GL2Widget::anmPresent, this, &MainWindow::animPresent);
 
     connect(ui->loadAnmButton, &QPushButton::clicked, glWindow, &GL2Widget::loadAnimation);
+    connect(ui->saveAnmbButton, &QPushButton::clicked, glWindow, &GL2Widget::saveAnimationBinary);
     connect(glWindow, &GL2Widget::anmLoaded, this, &MainWindow::updateFrames);
 
     connect(ui->loadTextureButton, &QPushButton::clicked, glWindow, &GL2Widget::loadTexture);
     connect(ui->checkDrawBBox, &QCheckBox::stateChanged, glWindow, &GL2Widget::drawBBox);
     connect(glWindow, &GL2Widget::stateBBoxCheck, this, &MainWindow::stateBBoxCheck);
+    connect(ui->checkGpuSkinning, &QCheckBox::stateChanged, glWindow, &GL2Widget::gpuSkinning);
 }
 
 MainWindow::~MainWindow()
@@ -38,6 +42,11 @@ void MainWindow::updateMeshTriangles(int numTri)
     ui->framesLabel->setText(QString("Frames: 0"));
 }
 
+void MainWindow::updateLoadProgress(int percent)
+{
+    ui->loadProgressBar->setValue(percent);
+}
+
 void MainWindow::animPresent(bool val)
 {
     ui->loadAnmButton->setEnabled(val);
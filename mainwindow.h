@@ -19,6 +19,7 @@ public:
 public slots:
     void updateMeshTriangles(int numTri);
     void updateFrames(int numFrames);
+    void updateLoadProgress(int percent);
     void animPresent(bool val);
     void stateBBoxCheck(bool val);
 